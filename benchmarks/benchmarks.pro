@@ -0,0 +1,20 @@
+#
+#  qmplayer - A Qt controller for embedding MPlayer
+#  Copyright (C) 2010 by Jonas Gehring
+#
+
+TEMPLATE = app
+TARGET = qmpbench
+DESTDIR = ..
+
+QT += network testlib
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../src
+QMAKE_LIBDIR += ..
+LIBS += -lqmplayer
+
+# header only, listed for moc
+HEADERS += ../src/qmpyuvreader.h
+SOURCES += qmpbench.cpp
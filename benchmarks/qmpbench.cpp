@@ -0,0 +1,436 @@
+#include <QtTest>
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+#include <stdlib.h>
+#include <string.h>
+#include "qmplayer.h"
+#include "qmplog.h"
+#include "qmpmediainfoparser.h"
+#include "qmptrace.h"
+#include "qmpyuvreader.h"
+
+// Throughput of the frame pipeline and the protocol parsers on synthetic
+// input. QtTest reports the time per iteration, the slots below add the
+// rate in frames/s, MB/s or lines/s. QMP_BENCH_RESULTS names a CSV file
+// the rates are appended to, for tracking them over releases.
+
+namespace {
+
+const qint32 sc_frames = 4;
+const qint32 sc_lines = 2000;
+const qint32 sc_readSize = 4096;
+
+// the same header QMPYuvReader::run() expects from -vo yuv4mpeg
+QByteArray yuvStream(qint32 a_width, qint32 a_height, qint32 a_frames) {
+    QByteArray l_stream = QString("YUV4MPEG2 W%1 H%2 F25:1 Ip A1:1\n").arg(a_width).arg(a_height).toAscii();
+
+    const qint32 l_ysize = a_width * a_height;
+    const qint32 l_csize = l_ysize / 4;
+    QByteArray l_frame(l_ysize + 2 * l_csize, 0);
+
+    for (qint32 f = 0; f < a_frames; ++f) {
+        char* l_data = l_frame.data();
+        // moving gradients, so no two frames are the same
+        for (qint32 y = 0; y < a_height; ++y) {
+            for (qint32 x = 0; x < a_width; ++x)
+                *l_data++ = char(16 + ((x + y + f * 8) % 220));
+        }
+        for (qint32 i = 0; i < l_csize; ++i)
+            *l_data++ = char(16 + ((i / 7 + f * 4) % 225));
+        for (qint32 i = 0; i < l_csize; ++i)
+            *l_data++ = char(240 - ((i / 5 + f * 4) % 225));
+
+        l_stream += "FRAME\n";
+        l_stream += l_frame;
+    }
+
+    return l_stream;
+}
+
+QStringList statusLines(qint32 a_count) {
+    QStringList l_lines;
+    for (qint32 i = 0; i < a_count; ++i) {
+        double l_time = i * 0.04;
+        l_lines += QString("A:%1 V:%1 A-V:  0.000 ct:  0.000 %2/%2  5%  1%  0.2% 0 0 ")
+            .arg(l_time, 6, 'f', 1).arg(i + 1, 4);
+    }
+    return l_lines;
+}
+
+QStringList identifyLines() {
+    QStringList l_lines;
+    l_lines << "ID_VIDEO_ID=0" << "ID_AUDIO_ID=1" << "ID_AID_1_LANG=eng" << "ID_AUDIO_ID=2" << "ID_AID_2_LANG=ger"
+            << "ID_SUBTITLE_ID=0" << "ID_SID_0_LANG=eng" << "ID_SID_0_NAME=English"
+            << "ID_CLIP_INFO_NAME0=title" << "ID_CLIP_INFO_VALUE0=Synthetic" << "ID_CLIP_INFO_N=1"
+            << "ID_CHAPTER_ID=0" << "ID_CHAPTER_0_START=0" << "ID_CHAPTER_0_END=600000" << "ID_CHAPTER_0_NAME=One"
+            << "ID_DEMUXER=mkv" << "ID_FILENAME=synthetic.mkv"
+            << "ID_VIDEO_FORMAT=avc1" << "ID_VIDEO_BITRATE=0" << "ID_VIDEO_WIDTH=1920" << "ID_VIDEO_HEIGHT=1080"
+            << "ID_VIDEO_FPS=25.000" << "ID_VIDEO_ASPECT=1.7778" << "ID_AUDIO_FORMAT=8192" << "ID_AUDIO_BITRATE=448000"
+            << "ID_AUDIO_RATE=48000" << "ID_AUDIO_NCH=6" << "ID_START_TIME=0.00" << "ID_LENGTH=5400.00"
+            << "ID_SEEKABLE=1" << "ID_CHAPTERS=1" << "ID_VIDEO_CODEC=ffh264" << "ID_AUDIO_CODEC=ffac3";
+    return l_lines;
+}
+
+QByteArray transcript(const QStringList& a_lines) {
+    return a_lines.join("\n").toUtf8() + '\n';
+}
+
+// the parsers see the output in the chunks the pipe delivers it in
+QList<QByteArray> chunks(const QByteArray& a_data) {
+    QList<QByteArray> l_chunks;
+    for (qint32 i = 0; i < a_data.size(); i += sc_readSize)
+        l_chunks += a_data.mid(i, sc_readSize);
+    return l_chunks;
+}
+
+}
+
+// The kernels are protected, the benchmark gets at them through subclasses
+class BenchYuvReader : public QMPYuvReader
+{
+public:
+    using QMPYuvReader::supersample;
+    using QMPYuvReader::yuvToQImage;
+};
+
+class BenchPlayer : public QMPlayer
+{
+public:
+    using QMPlayer::parseStandardOutput;
+    using QMPlayer::parseStandardError;
+    using QMPlayer::parsePosition;
+};
+
+class QMPBench : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void supersample_data();
+    void supersample();
+    void yuvToQImage_data();
+    void yuvToQImage();
+    void framePipeline_data();
+    void framePipeline();
+
+    void parsePosition();
+    void parseStandardOutput_data();
+    void parseStandardOutput();
+    void parseMediaInfo();
+    void replayTrace();
+
+private:
+    struct Result {
+        QString benchmark;
+        QString dataset;
+        QString unit;
+        qint64 count;
+        qint64 bytes;
+        qint64 nsecs;
+    };
+
+    void addFrameSizes();
+    void report(const QString& a_unit, qint64 a_count, qint64 a_bytes, qint64 a_nsecs);
+
+    QList<Result> m_results;
+};
+
+void QMPBench::initTestCase() {
+    m_results.clear();
+}
+
+void QMPBench::cleanupTestCase() {
+    QByteArray l_path = qgetenv("QMP_BENCH_RESULTS");
+    if (l_path.isEmpty()) return;
+
+    QFile l_file(QString::fromLocal8Bit(l_path));
+    bool l_header = !l_file.exists() || (l_file.size() == 0);
+    if (!l_file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        qWarning("cannot write %s", l_path.constData());
+        return;
+    }
+
+    QTextStream l_out(&l_file);
+    if (l_header)
+        l_out << "benchmark,dataset,unit,count,bytes,nsecs,per_second,mb_per_second\n";
+    foreach (const Result& l_result, m_results) {
+        double l_seconds = qMax<qint64>(l_result.nsecs, 1) / 1e9;
+        l_out << l_result.benchmark << ',' << l_result.dataset << ',' << l_result.unit << ','
+              << l_result.count << ',' << l_result.bytes << ',' << l_result.nsecs << ','
+              << QString::number(l_result.count / l_seconds, 'f', 1) << ','
+              << QString::number(l_result.bytes / l_seconds / (1024 * 1024), 'f', 2) << '\n';
+    }
+}
+
+void QMPBench::addFrameSizes() {
+    QTest::addColumn<qint32>("width");
+    QTest::addColumn<qint32>("height");
+
+    QTest::newRow("SD") << 720 << 576;
+    QTest::newRow("HD") << 1920 << 1080;
+    QTest::newRow("4K") << 3840 << 2160;
+}
+
+void QMPBench::report(const QString& a_unit, qint64 a_count, qint64 a_bytes, qint64 a_nsecs) {
+    Result l_result;
+    l_result.benchmark = QTest::currentTestFunction();
+    l_result.dataset = QTest::currentDataTag() ? QTest::currentDataTag() : "";
+    l_result.unit = a_unit;
+    l_result.count = a_count;
+    l_result.bytes = a_bytes;
+    l_result.nsecs = a_nsecs;
+    m_results += l_result;
+
+    double l_seconds = qMax<qint64>(a_nsecs, 1) / 1e9;
+    qDebug("%s %s: %.1f %s/s, %.2f MB/s", qPrintable(l_result.benchmark), qPrintable(l_result.dataset),
+           a_count / l_seconds, qPrintable(a_unit), a_bytes / l_seconds / (1024 * 1024));
+}
+
+void QMPBench::supersample_data() {
+    addFrameSizes();
+}
+
+void QMPBench::supersample() {
+    QFETCH(qint32, width);
+    QFETCH(qint32, height);
+
+    // one 420 chroma plane in a buffer large enough for its 444 result
+    BenchYuvReader l_reader;
+    QByteArray l_plane = yuvStream(width, height, 1).right(width * height / 2).left(width * height / 4);
+    QVector<uchar> l_buffer(width * height);
+
+    qint64 l_planes = 0;
+    QElapsedTimer l_timer;
+    l_timer.start();
+    QBENCHMARK {
+        memcpy(l_buffer.data(), l_plane.constData(), l_plane.size());
+        l_reader.supersample(l_buffer.data(), width, height);
+        ++l_planes;
+    }
+
+    report("planes", l_planes, l_planes * width * height, l_timer.nsecsElapsed());
+}
+
+void QMPBench::yuvToQImage_data() {
+    addFrameSizes();
+}
+
+void QMPBench::yuvToQImage() {
+    QFETCH(qint32, width);
+    QFETCH(qint32, height);
+
+    BenchYuvReader l_reader;
+    QVector<uchar> l_planes[3];
+    uchar* l_yuv[3];
+    for (qint32 i = 0; i < 3; ++i) {
+        l_planes[i].resize(width * height);
+        for (qint32 j = 0; j < width * height; ++j)
+            l_planes[i][j] = uchar(16 + ((j + i * 64) % 225));
+        l_yuv[i] = l_planes[i].data();
+    }
+    QImage l_image(width, height, QImage::Format_ARGB32);
+
+    qint64 l_frames = 0;
+    QElapsedTimer l_timer;
+    l_timer.start();
+    QBENCHMARK {
+        l_reader.yuvToQImage(l_yuv, &l_image, width, height);
+        ++l_frames;
+    }
+
+    report("frames", l_frames, l_frames * 3 * width * height, l_timer.nsecsElapsed());
+}
+
+void QMPBench::framePipeline_data() {
+    addFrameSizes();
+}
+
+// what QMPYuvReader::run() does per frame, reading from memory instead of
+// the fifo so the numbers do not depend on mplayer
+void QMPBench::framePipeline() {
+    QFETCH(qint32, width);
+    QFETCH(qint32, height);
+
+    BenchYuvReader l_reader;
+    QByteArray l_stream = yuvStream(width, height, sc_frames);
+    QBuffer l_buffer(&l_stream);
+    l_buffer.open(QIODevice::ReadOnly);
+
+    QByteArray l_header = l_buffer.readLine();
+    char c;
+    int l_width, l_height, l_fps, t1, t2;
+    int n = sscanf(l_header.constData(), "YUV4MPEG2 W%d H%d F%d:1 I%c A%d:%d", &l_width, &l_height, &l_fps, &c, &t1, &t2);
+    QVERIFY(n >= 3);
+    QCOMPARE(l_width, width);
+    QCOMPARE(l_height, height);
+    const qint64 l_start = l_buffer.pos();
+
+    QVector<uchar> l_planes[3];
+    uchar* l_yuv[3];
+    for (qint32 i = 0; i < 3; ++i) {
+        l_planes[i].resize(width * height);
+        l_yuv[i] = l_planes[i].data();
+    }
+    QImage l_image(width, height, QImage::Format_ARGB32);
+
+    const qint32 l_ysize = width * height;
+    const qint32 l_csize = l_ysize / 4;
+    qint64 l_frames = 0;
+    QElapsedTimer l_timer;
+    l_timer.start();
+    QBENCHMARK {
+        l_buffer.seek(l_start);
+        for (qint32 f = 0; f < sc_frames; ++f) {
+            l_buffer.read((char*)l_yuv[0], 6);
+            l_buffer.read((char*)l_yuv[0], l_ysize);
+            l_buffer.read((char*)l_yuv[1], l_csize);
+            l_buffer.read((char*)l_yuv[2], l_csize);
+            l_reader.supersample(l_yuv[1], width, height);
+            l_reader.supersample(l_yuv[2], width, height);
+            l_reader.yuvToQImage(l_yuv, &l_image, width, height);
+        }
+        l_frames += sc_frames;
+    }
+
+    report("frames", l_frames, l_frames * (6 + l_ysize + 2 * l_csize), l_timer.nsecsElapsed());
+}
+
+void QMPBench::parsePosition() {
+    // positions are only parsed once playing
+    BenchPlayer l_player;
+    l_player.parseStandardOutput("Starting playback...\n");
+    QCOMPARE(l_player.state(), QMPlayer::stPlaying);
+
+    QStringList l_lines = statusLines(sc_lines);
+    qint64 l_bytes = 0;
+    foreach (const QString& l_line, l_lines) {
+        l_bytes += l_line.size();
+    }
+
+    qint64 l_count = 0;
+    QElapsedTimer l_timer;
+    l_timer.start();
+    QBENCHMARK {
+        foreach (const QString& l_line, l_lines) {
+            l_player.parsePosition(l_line);
+        }
+        l_count += l_lines.count();
+    }
+
+    report("lines", l_count, l_count / l_lines.count() * l_bytes, l_timer.nsecsElapsed());
+}
+
+void QMPBench::parseStandardOutput_data() {
+    QTest::addColumn<QByteArray>("output");
+
+    QStringList l_status = statusLines(sc_lines);
+    QStringList l_identify;
+    while (l_identify.count() < sc_lines)
+        l_identify += identifyLines();
+
+    QTest::newRow("status") << transcript(l_status);
+    QTest::newRow("identify") << transcript(l_identify);
+    QTest::newRow("playback") << transcript(QStringList() << "Playing synthetic.mkv." << identifyLines()
+                                            << "Starting playback..." << l_status << "Exiting... (Quit)");
+}
+
+void QMPBench::parseStandardOutput() {
+    QFETCH(QByteArray, output);
+
+    BenchPlayer l_player;
+    l_player.parseStandardOutput("Starting playback...\n");
+
+    QList<QByteArray> l_chunks = chunks(output);
+    const qint64 l_lines = output.count('\n');
+
+    qint64 l_count = 0;
+    qint64 l_bytes = 0;
+    QElapsedTimer l_timer;
+    l_timer.start();
+    QBENCHMARK {
+        foreach (const QByteArray& l_chunk, l_chunks) {
+            l_player.parseStandardOutput(l_chunk);
+        }
+        l_count += l_lines;
+        l_bytes += output.size();
+    }
+
+    report("lines", l_count, l_bytes, l_timer.nsecsElapsed());
+}
+
+// formerly QMPlayer::parseMediaInfo()
+void QMPBench::parseMediaInfo() {
+    QStringList l_lines = identifyLines();
+    qint64 l_size = 0;
+    foreach (const QString& l_line, l_lines) {
+        l_size += l_line.size();
+    }
+
+    QMPlayer::MediaInfo l_info;
+    QMPMediaInfoParser l_parser(&l_info);
+
+    qint64 l_count = 0;
+    QElapsedTimer l_timer;
+    l_timer.start();
+    QBENCHMARK {
+        l_info = QMPlayer::MediaInfo();
+        l_parser.reset();
+        foreach (const QString& l_line, l_lines) {
+            l_parser.parse(l_line);
+        }
+        l_count += l_lines.count();
+    }
+
+    QCOMPARE(l_info.audioTracks.count(), 2);
+    report("lines", l_count, l_count / l_lines.count() * l_size, l_timer.nsecsElapsed());
+}
+
+// a trace recorded with QMPlayer::startTrace(), named by QMP_BENCH_TRACE
+void QMPBench::replayTrace() {
+    QByteArray l_path = qgetenv("QMP_BENCH_TRACE");
+    if (l_path.isEmpty())
+        QSKIP("QMP_BENCH_TRACE not set", SkipSingle);
+
+    QFile l_file(QString::fromLocal8Bit(l_path));
+    QVERIFY2(l_file.open(QIODevice::ReadOnly), qPrintable(l_file.errorString()));
+    QMPTraceReader l_reader(&l_file);
+    QVERIFY2(l_reader.readHeader(), qPrintable(l_reader.errorString()));
+
+    QList<QMPTrace::Record> l_records;
+    QMPTrace::Record l_record;
+    qint64 l_lines = 0;
+    qint64 l_size = 0;
+    while (l_reader.next(&l_record)) {
+        if ((l_record.stream != QMPTrace::tsStdout) && (l_record.stream != QMPTrace::tsStderr)) continue;
+        l_records += l_record;
+        l_lines += l_record.data.count('\n');
+        l_size += l_record.data.size();
+    }
+    QVERIFY(!l_records.isEmpty());
+
+    BenchPlayer l_player;
+    qint64 l_count = 0;
+    qint64 l_bytes = 0;
+    QElapsedTimer l_timer;
+    l_timer.start();
+    QBENCHMARK {
+        foreach (const QMPTrace::Record& l_replayed, l_records) {
+            if (l_replayed.stream == QMPTrace::tsStdout)
+                l_player.parseStandardOutput(l_replayed.data);
+            else
+                l_player.parseStandardError(l_replayed.data);
+        }
+        l_count += l_lines;
+        l_bytes += l_size;
+    }
+
+    report("lines", l_count, l_bytes, l_timer.nsecsElapsed());
+}
+
+QTEST_MAIN(QMPBench)
+#include "qmpbench.moc"
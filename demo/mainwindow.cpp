@@ -2,11 +2,19 @@
 #include "ui_mainwindow.h"
 
 #include <QFileDialog>
+#include <QDesktopServices>
+#include <QStyle>
+#include <QLabel>
 #include <QDebug>
 
+#ifndef Q_WS_WIN
+#include "qmpspritecache.h"
+#include "qmpmediaprobe.h"
+#endif
+
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
-    m_ui(new Ui::MainWindow)
+    m_ui(new Ui::MainWindow), m_sprites(0), m_preview(0)
 {
     m_ui->setupUi(this);
     m_mplayer = new QMPlayer(this);
@@ -23,6 +31,13 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(m_mplayer, SIGNAL(tick(qreal)), SLOT(mplayerTick(qreal)));
 
     connect(m_ui->btnMute, SIGNAL(toggled(bool)), m_mplayer, SLOT(setAudioMute(bool)));
+
+    // frames shown while dragging the progress slider
+    m_preview = new QLabel(this, Qt::ToolTip);
+#ifndef Q_WS_WIN
+    m_sprites = new QMPSpriteCache(this);
+    m_sprites->setCacheDirectory(QDesktopServices::storageLocation(QDesktopServices::CacheLocation) + "/sprites");
+#endif
 }
 
 MainWindow::~MainWindow()
@@ -42,6 +57,16 @@ void MainWindow::mplayerMediaInfoChanged() {
     m_ui->tabMediaInfo->setRowCount(0);
     m_ui->sldProgress->setEnabled(l_mi.seekable);
     m_ui->sldProgress->setRange(0, qRound(l_mi.length * 1000.0));
+#ifndef Q_WS_WIN
+    // streams would be opened once per tile, and could not be cached;
+    // they seek live
+    if (m_sprites->url() != l_mi.url) {
+        if (l_mi.valid && l_mi.hasVideo() && !QMPMediaProbe::cacheKey(l_mi.url).isEmpty())
+            m_sprites->load(l_mi.url, l_mi.length);
+        else
+            m_sprites->clear();
+    }
+#endif
     if (l_mi.valid) {
         addToTbMediaInfo("url", l_mi.url);
         if (l_mi.hasVideo()) {
@@ -156,5 +181,30 @@ void MainWindow::on_btnMute_clicked()
 
 void MainWindow::on_sldProgress_sliderMoved(int position)
 {
-    m_mplayer->seek(qreal(position) / 1000);
+    // without a preview the video itself has to follow the slider
+    QImage l_preview;
+#ifndef Q_WS_WIN
+    l_preview = m_sprites->previewAt(qreal(position) / 1000);
+#endif
+    if (l_preview.isNull()) {
+        m_preview->hide();
+        m_mplayer->seek(qreal(position) / 1000);
+        return;
+    }
+
+    QSlider* l_slider = m_ui->sldProgress;
+    qint32 l_x = QStyle::sliderPositionFromValue(l_slider->minimum(), l_slider->maximum(), position, l_slider->width());
+    m_preview->setPixmap(QPixmap::fromImage(l_preview));
+    m_preview->resize(l_preview.size());
+    m_preview->move(l_slider->mapToGlobal(QPoint(l_x - l_preview.width() / 2, -l_preview.height() - 4)));
+    m_preview->show();
+}
+
+void MainWindow::on_sldProgress_sliderReleased()
+{
+    // a drag without preview has already seeked while moving
+    bool l_previewed = m_preview->isVisible();
+    m_preview->hide();
+    if (l_previewed)
+        m_mplayer->seek(qreal(m_ui->sldProgress->value()) / 1000);
 }
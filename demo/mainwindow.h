@@ -4,6 +4,9 @@
 #include <QMainWindow>
 #include "qmplayer.h"
 
+class QLabel;
+class QMPSpriteCache;
+
 namespace Ui {
     class MainWindow;
 }
@@ -41,9 +44,13 @@ private slots:
 
     void on_sldProgress_sliderMoved(int position);
 
+    void on_sldProgress_sliderReleased();
+
 private:
     Ui::MainWindow* m_ui;
     QMPlayer* m_mplayer;
+    QMPSpriteCache* m_sprites;
+    QLabel* m_preview;
 };
 
 #endif // MAINWINDOW_H
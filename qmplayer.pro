@@ -4,6 +4,8 @@
 #
 
 TEMPLATE = subdirs
-SUBDIRS += src demo
+SUBDIRS += src demo benchmarks
+SUBDIRS += tools/qmpreplay
+unix:SUBDIRS += tools/fakemplayer
 
 CONFIG += ordered
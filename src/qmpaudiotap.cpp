@@ -0,0 +1,399 @@
+#include "qmpaudiotap.h"
+#include <QDir>
+#include <QFile>
+#include <QMutexLocker>
+#include <math.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define QMP_AUDIO_SSE2
+#include <emmintrin.h>
+#endif
+
+static const qint32 sc_waveHeaderSize = 44;
+static const qint32 sc_blockMs = 50;
+// how far reading may run ahead of the clock, and behind it before the
+// clock restarts, e.g. after a pause
+static const qint32 sc_paceLeadMs = 200;
+static const qint32 sc_paceSlackMs = 500;
+
+static qreal sl_dbfs(qreal a_level) {
+    return (a_level > 0) ? 20 * log10(a_level / 32768.0) : -200;
+}
+
+QMPAudioRing::QMPAudioRing(qint32 a_samples) :
+    m_buffer(), m_mask(0), m_read(0), m_write(0)
+{
+    quint32 l_size = 1;
+    while ((l_size < quint32(a_samples)) && (l_size < (1u << 30)))
+        l_size <<= 1;
+    m_buffer.resize(l_size);
+    m_mask = l_size - 1;
+}
+
+qint32 QMPAudioRing::capacity() const {
+    return m_buffer.size();
+}
+
+qint32 QMPAudioRing::available() const {
+    return quint32(int(m_write)) - quint32(int(m_read));
+}
+
+qint32 QMPAudioRing::write(const qint16* a_samples, qint32 a_count) {
+    quint32 l_write = quint32(int(m_write));
+    quint32 l_free = m_buffer.size() - (l_write - quint32(m_read.fetchAndAddAcquire(0)));
+    quint32 l_count = qMin(quint32(a_count), l_free);
+
+    // at most two pieces, the tail of the buffer and its head
+    quint32 l_start = l_write & m_mask;
+    quint32 l_first = qMin(l_count, quint32(m_buffer.size()) - l_start);
+    memcpy(m_buffer.data() + l_start, a_samples, l_first * sizeof(qint16));
+    memcpy(m_buffer.data(), a_samples + l_first, (l_count - l_first) * sizeof(qint16));
+
+    m_write.fetchAndStoreRelease(int(l_write + l_count));
+    return l_count;
+}
+
+qint32 QMPAudioRing::read(qint16* a_samples, qint32 a_count) {
+    quint32 l_read = quint32(int(m_read));
+    quint32 l_available = quint32(m_write.fetchAndAddAcquire(0)) - l_read;
+    quint32 l_count = qMin(quint32(a_count), l_available);
+
+    quint32 l_start = l_read & m_mask;
+    quint32 l_first = qMin(l_count, quint32(m_buffer.size()) - l_start);
+    memcpy(a_samples, m_buffer.constData() + l_start, l_first * sizeof(qint16));
+    memcpy(a_samples + l_first, m_buffer.constData(), (l_count - l_first) * sizeof(qint16));
+
+    m_read.fetchAndStoreRelease(int(l_read + l_count));
+    return l_count;
+}
+
+void QMPAudioRing::clear() {
+    m_read.fetchAndStoreRelease(m_write.fetchAndAddAcquire(0));
+}
+
+QMPAudioTap::QMPAudioTap(QObject* a_parent) :
+    QThread(a_parent), m_dir(), m_fifo(), m_ring(0), m_stop(0), m_sampleRate(0), m_channels(0), m_overruns(0),
+    m_header(), m_headerDone(false), m_partial(), m_paceClock(), m_pacedFrames(0), m_blockFrames(0), m_frames(0), m_sumSquares(), m_peaks(),
+    m_silentMs(0), m_mutex(), m_levels(), m_silenceThreshold(-60), m_silenceDuration(2000)
+{
+    QByteArray l_template = QFile::encodeName(QDir::temp().filePath("qmpaudio-XXXXXX"));
+    if (mkdtemp(l_template.data())) {
+        m_dir = QFile::decodeName(l_template);
+        m_fifo = QDir(m_dir).filePath("pcm");
+        if (mkfifo(QFile::encodeName(m_fifo).constData(), 0600) != 0)
+            qWarning("QMPAudioTap: cannot create %s: %s", qPrintable(m_fifo), strerror(errno));
+    } else {
+        qWarning("QMPAudioTap: cannot create a temporary directory: %s", strerror(errno));
+    }
+
+    m_ring = new QMPAudioRing(1 << 20);
+}
+
+QMPAudioTap::~QMPAudioTap() {
+    stop();
+    delete m_ring;
+    if (!m_dir.isEmpty()) {
+        QFile::remove(m_fifo);
+        QDir().rmdir(m_dir);
+    }
+}
+
+QString QMPAudioTap::fifoPath() const {
+    return m_fifo;
+}
+
+QString QMPAudioTap::audioOutput() const {
+    // %length% quotes the path, it may contain the ':' of a suboption
+    QByteArray l_path = QFile::encodeName(m_fifo);
+    return "pcm:file=%" + QString::number(l_path.size()) + "%" + m_fifo;
+}
+
+void QMPAudioTap::setRingSize(qint32 a_samples) {
+    if (isRunning()) {
+        qWarning("QMPAudioTap: the ring cannot be resized while running");
+        return;
+    }
+    delete m_ring;
+    m_ring = new QMPAudioRing(a_samples);
+}
+
+void QMPAudioTap::setSilenceThreshold(qreal a_dbfs, qint32 a_ms) {
+    QMutexLocker l_lock(&m_mutex);
+    m_silenceThreshold = a_dbfs;
+    m_silenceDuration = qMax(0, a_ms);
+}
+
+qreal QMPAudioTap::silenceThreshold() const {
+    QMutexLocker l_lock(&m_mutex);
+    return m_silenceThreshold;
+}
+
+qint32 QMPAudioTap::silenceDuration() const {
+    QMutexLocker l_lock(&m_mutex);
+    return m_silenceDuration;
+}
+
+qint32 QMPAudioTap::sampleRate() const {
+    return m_sampleRate;
+}
+
+qint32 QMPAudioTap::channels() const {
+    return m_channels;
+}
+
+qint32 QMPAudioTap::availableFrames() const {
+    qint32 l_channels = m_channels;
+    return l_channels ? m_ring->available() / l_channels : 0;
+}
+
+qint32 QMPAudioTap::readFrames(qint16* a_samples, qint32 a_frames) {
+    qint32 l_channels = m_channels;
+    if (l_channels == 0) return 0;
+
+    qint32 l_frames = qMin(a_frames, m_ring->available() / l_channels);
+    return m_ring->read(a_samples, l_frames * l_channels) / l_channels;
+}
+
+qint64 QMPAudioTap::overruns() const {
+    return quint32(int(m_overruns));
+}
+
+QMPAudioTap::Levels QMPAudioTap::levels() const {
+    QMutexLocker l_lock(&m_mutex);
+    return m_levels;
+}
+
+bool QMPAudioTap::isSilent() const {
+    QMutexLocker l_lock(&m_mutex);
+    return m_levels.silent;
+}
+
+void QMPAudioTap::measure(const qint16* a_samples, qint32 a_frames, qint32 a_channels,
+                          qint64* a_sumSquares, qint32* a_peaks) {
+    qint32 l_count = a_frames * a_channels;
+    qint32 i = 0;
+
+#ifdef QMP_AUDIO_SSE2
+    // with 1, 2, 4 or 8 channels lane j of every vector is channel j % a_channels
+    if ((8 % a_channels) == 0) {
+        const __m128i l_zero = _mm_setzero_si128();
+        const __m128i l_even = _mm_set1_epi32(0x0000ffff);
+        const __m128i l_odd = _mm_set1_epi32(int(0xffff0000));
+        __m128i l_evenLow = l_zero, l_evenHigh = l_zero;
+        __m128i l_oddLow = l_zero, l_oddHigh = l_zero;
+        __m128i l_peak = l_zero;
+
+        for (; i + 8 <= l_count; i += 8) {
+            __m128i l_samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a_samples + i));
+
+            // masking one factor keeps the squares of even and odd lanes apart,
+            // each fits 31 bits and is widened before adding up
+            __m128i l_squares = _mm_madd_epi16(l_samples, _mm_and_si128(l_samples, l_even));
+            l_evenLow = _mm_add_epi64(l_evenLow, _mm_unpacklo_epi32(l_squares, l_zero));
+            l_evenHigh = _mm_add_epi64(l_evenHigh, _mm_unpackhi_epi32(l_squares, l_zero));
+            l_squares = _mm_madd_epi16(l_samples, _mm_and_si128(l_samples, l_odd));
+            l_oddLow = _mm_add_epi64(l_oddLow, _mm_unpacklo_epi32(l_squares, l_zero));
+            l_oddHigh = _mm_add_epi64(l_oddHigh, _mm_unpackhi_epi32(l_squares, l_zero));
+
+            // saturating negation, -32768 counts as 32767
+            l_peak = _mm_max_epi16(l_peak, _mm_max_epi16(l_samples, _mm_subs_epi16(l_zero, l_samples)));
+        }
+
+        qint64 l_evenSums[4], l_oddSums[4];
+        qint16 l_peaks[8];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(l_evenSums), l_evenLow);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(l_evenSums + 2), l_evenHigh);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(l_oddSums), l_oddLow);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(l_oddSums + 2), l_oddHigh);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(l_peaks), l_peak);
+
+        for (qint32 j = 0; j < 4; ++j) {
+            a_sumSquares[(2 * j) % a_channels] += l_evenSums[j];
+            a_sumSquares[(2 * j + 1) % a_channels] += l_oddSums[j];
+        }
+        for (qint32 j = 0; j < 8; ++j) {
+            a_peaks[j % a_channels] = qMax(a_peaks[j % a_channels], qint32(l_peaks[j]));
+        }
+    }
+#endif
+
+    // i is a multiple of the frame size here
+    for (; i < l_count; ++i) {
+        qint32 l_sample = a_samples[i];
+        qint32 l_channel = i % a_channels;
+        a_sumSquares[l_channel] += l_sample * l_sample;
+        a_peaks[l_channel] = qMax(a_peaks[l_channel], qMin(qAbs(l_sample), 32767));
+    }
+}
+
+void QMPAudioTap::stop() {
+    if (isRunning()) {
+        m_stop = 1;
+        wait();
+        m_stop = 0;
+    }
+}
+
+void QMPAudioTap::run() {
+    QByteArray l_path = QFile::encodeName(m_fifo);
+    char l_buffer[16384];
+
+    while (!m_stop) {
+        // non-blocking, so that stop() is noticed while nobody writes
+        int l_fd = ::open(l_path.constData(), O_RDONLY | O_NONBLOCK);
+        if (l_fd < 0) {
+            msleep(100);
+            continue;
+        }
+
+        // mplayer reopens the output and writes a new header for every file
+        m_header.clear();
+        m_headerDone = false;
+        m_partial.clear();
+        bool l_connected = false;
+
+        while (!m_stop) {
+            pace();
+
+            struct pollfd l_poll;
+            l_poll.fd = l_fd;
+            l_poll.events = POLLIN;
+            l_poll.revents = 0;
+            if (poll(&l_poll, 1, 100) <= 0) continue;
+
+            ssize_t l_read = ::read(l_fd, l_buffer, sizeof(l_buffer));
+            if (l_read > 0) {
+                l_connected = true;
+                consume(l_buffer, l_read);
+            } else if (l_read == 0) {
+                // end of file once the writer is gone, until then nobody opened it
+                if (l_connected) break;
+                msleep(20);
+            } else if ((errno != EAGAIN) && (errno != EINTR)) {
+                qWarning("QMPAudioTap: reading %s: %s", l_path.constData(), strerror(errno));
+                break;
+            }
+        }
+
+        ::close(l_fd);
+    }
+}
+
+bool QMPAudioTap::parseHeader(const QByteArray& a_header) {
+    const uchar* l_data = reinterpret_cast<const uchar*>(a_header.constData());
+    if ((memcmp(l_data, "RIFF", 4) != 0)
+    ||  (memcmp(l_data + 8, "WAVE", 4) != 0)) {
+        qWarning("QMPAudioTap: no wave header");
+        return false;
+    }
+
+    qint32 l_channels = l_data[22] | (l_data[23] << 8);
+    qint32 l_rate = l_data[24] | (l_data[25] << 8) | (l_data[26] << 16) | (l_data[27] << 24);
+    qint32 l_bits = l_data[34] | (l_data[35] << 8);
+    if ((l_bits != 16) || (l_channels < 1) || (l_rate < 1)) {
+        qWarning("QMPAudioTap: unsupported format, %d bits %d channels at %d Hz", l_bits, l_channels, l_rate);
+        return false;
+    }
+
+    m_sampleRate = l_rate;
+    m_channels = l_channels;
+    m_blockFrames = qMax(1, l_rate * sc_blockMs / 1000);
+    m_frames = 0;
+    m_paceClock.start();
+    m_pacedFrames = 0;
+    m_sumSquares.fill(0, l_channels);
+    m_peaks.fill(0, l_channels);
+    emit formatChange(l_rate, l_channels);
+    return true;
+}
+
+void QMPAudioTap::consume(const char* a_data, qint32 a_size) {
+    if (!m_headerDone) {
+        qint32 l_missing = qMin(a_size, sc_waveHeaderSize - m_header.size());
+        m_header.append(a_data, l_missing);
+        a_data += l_missing;
+        a_size -= l_missing;
+        if (m_header.size() < sc_waveHeaderSize) return;
+
+        m_headerDone = true;
+        if (!parseHeader(m_header)) {
+            // samples of an unknown layout are of no use, skip the file
+            m_channels = 0;
+        }
+    }
+    qint32 l_channels = m_channels;
+    if (l_channels == 0) return;
+
+    // reads do not end on frame boundaries, keep the rest for the next one
+    qint32 l_frameSize = l_channels * sizeof(qint16);
+    m_partial.append(a_data, a_size);
+    qint32 l_frames = m_partial.size() / l_frameSize;
+    const qint16* l_samples = reinterpret_cast<const qint16*>(m_partial.constData());
+    m_pacedFrames += l_frames;
+
+    // whole frames only, the reader may free more meanwhile but never less
+    qint32 l_fit = qMin(l_frames, (m_ring->capacity() - m_ring->available()) / l_channels);
+    m_ring->write(l_samples, l_fit * l_channels);
+    if (l_fit < l_frames)
+        m_overruns.fetchAndAddRelaxed(l_frames - l_fit);
+
+    while (l_frames > 0) {
+        qint32 l_chunk = qMin(l_frames, m_blockFrames - m_frames);
+        measure(l_samples, l_chunk, l_channels, m_sumSquares.data(), m_peaks.data());
+        l_samples += l_chunk * l_channels;
+        l_frames -= l_chunk;
+        m_frames += l_chunk;
+        if (m_frames == m_blockFrames) finishBlock();
+    }
+
+    m_partial.remove(0, m_partial.size() - m_partial.size() % l_frameSize);
+}
+
+void QMPAudioTap::pace() {
+    qint32 l_rate = m_sampleRate;
+    if (!m_headerDone || (int(m_channels) == 0) || (l_rate <= 0)) return;
+
+    qint64 l_ahead = m_pacedFrames * 1000 / l_rate - m_paceClock.elapsed();
+    if (l_ahead < -sc_paceSlackMs) {
+        // mplayer paused or fell behind, real time goes on from here
+        m_paceClock.start();
+        m_pacedFrames = 0;
+    } else if (l_ahead > sc_paceLeadMs) {
+        // short sleeps, stop() is checked in between
+        msleep(qMin<qint64>(l_ahead - sc_paceLeadMs, 100));
+    }
+}
+
+void QMPAudioTap::finishBlock() {
+    qint32 l_channels = m_sumSquares.size();
+    Levels l_levels;
+    l_levels.rms.resize(l_channels);
+    l_levels.peak.resize(l_channels);
+
+    QMutexLocker l_lock(&m_mutex);
+    bool l_quiet = true;
+    for (qint32 i = 0; i < l_channels; ++i) {
+        l_levels.rms[i] = sl_dbfs(sqrt(qreal(m_sumSquares[i]) / m_frames));
+        l_levels.peak[i] = sl_dbfs(m_peaks[i]);
+        l_quiet = l_quiet && (l_levels.rms[i] < m_silenceThreshold);
+    }
+
+    bool l_wasSilent = m_levels.silent;
+    m_silentMs = l_quiet ? qMin(m_silentMs + m_frames * 1000 / m_sampleRate, m_silenceDuration) : 0;
+    l_levels.silent = l_quiet && (m_silentMs >= m_silenceDuration);
+    m_levels = l_levels;
+    l_lock.unlock();
+
+    m_frames = 0;
+    m_sumSquares.fill(0);
+    m_peaks.fill(0);
+
+    emit levelsChange();
+    if (l_levels.silent != l_wasSilent) emit silenceChange(l_levels.silent);
+}
@@ -0,0 +1,132 @@
+#ifndef QMPAUDIOTAP_H
+#define QMPAUDIOTAP_H
+
+#include <QThread>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QVector>
+#include <QString>
+
+// Single producer, single consumer ring of samples. Both indices only
+// grow, their difference is the fill level, so neither side locks.
+class QMPAudioRing
+{
+public:
+    // rounded up to a power of two
+    explicit QMPAudioRing(qint32 a_samples);
+
+    qint32 capacity() const;
+    qint32 available() const;
+
+    // producer side, returns how many samples fit
+    qint32 write(const qint16* a_samples, qint32 a_count);
+    // consumer side
+    qint32 read(qint16* a_samples, qint32 a_count);
+    void clear();
+
+private:
+    QVector<qint16> m_buffer;
+    quint32 m_mask;
+    QAtomicInt m_read;
+    QAtomicInt m_write;
+};
+
+// Reads what "mplayer -ao pcm" writes to a fifo on a thread of its own:
+// samples go to a ring the application reads at its own pace, levels
+// are measured per block of 50 ms. Samples are forced to signed 16 bit,
+// the layout comes from the wave header mplayer writes for every file.
+// "-ao pcm" writes as fast as it can, so the fifo is read no faster than
+// the sample rate: the full pipe holds mplayer back to real time.
+class QMPAudioTap : public QThread
+{
+    Q_OBJECT
+
+public:
+    // dBFS per channel of the last block
+    struct Levels {
+        QVector<qreal> rms;
+        QVector<qreal> peak;
+        bool silent;
+
+        Levels() : rms(), peak(), silent(false) {}
+    };
+
+public:
+    explicit QMPAudioTap(QObject* a_parent = 0);
+    virtual ~QMPAudioTap();
+
+    QString fifoPath() const;
+    // the -ao argument that routes mplayer into the fifo
+    QString audioOutput() const;
+
+    // only before the thread is started, default one million samples
+    void setRingSize(qint32 a_samples);
+
+    // silence is every channel below a_dbfs for a_ms
+    void setSilenceThreshold(qreal a_dbfs, qint32 a_ms);
+    qreal silenceThreshold() const;
+    qint32 silenceDuration() const;
+
+    qint32 sampleRate() const;
+    qint32 channels() const;
+
+    // interleaved frames, formatChange() marks where the layout changes
+    qint32 availableFrames() const;
+    qint32 readFrames(qint16* a_samples, qint32 a_frames);
+    // frames lost because the ring was full
+    qint64 overruns() const;
+
+    QMPAudioTap::Levels levels() const;
+    bool isSilent() const;
+
+    // adds the squares and raises the peaks of a_frames interleaved
+    // frames to the per channel values, SSE2 where available
+    static void measure(const qint16* a_samples, qint32 a_frames, qint32 a_channels,
+                        qint64* a_sumSquares, qint32* a_peaks);
+
+public slots:
+    void stop();
+
+signals:
+    void formatChange(qint32 a_sampleRate, qint32 a_channels);
+    void levelsChange();
+    void silenceChange(bool a_silent);
+
+protected:
+    void run();
+
+private:
+    bool parseHeader(const QByteArray& a_header);
+    void consume(const char* a_data, qint32 a_size);
+    void finishBlock();
+    void pace();
+
+    QString m_dir;
+    QString m_fifo;
+    QMPAudioRing* m_ring;
+    QAtomicInt m_stop;
+
+    // written by the thread only
+    QAtomicInt m_sampleRate;
+    QAtomicInt m_channels;
+    QAtomicInt m_overruns;
+    QByteArray m_header;
+    bool m_headerDone;
+    QByteArray m_partial;
+    QElapsedTimer m_paceClock;
+    qint64 m_pacedFrames;
+
+    qint32 m_blockFrames;
+    qint32 m_frames;
+    QVector<qint64> m_sumSquares;
+    QVector<qint32> m_peaks;
+    qint32 m_silentMs;
+
+    mutable QMutex m_mutex;
+    Levels m_levels;
+    qreal m_silenceThreshold;
+    qint32 m_silenceDuration;
+};
+
+#endif // QMPAUDIOTAP_H
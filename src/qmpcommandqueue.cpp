@@ -0,0 +1,203 @@
+#include "qmpcommandqueue.h"
+#include "qmplog.h"
+#include <QIODevice>
+
+QMPCommandQueue::QMPCommandQueue(QIODevice* a_device, QObject* a_parent) :
+    QObject(a_parent), m_device(a_device), m_logSource(this), m_queuedBytes(0), m_maxPendingBytes(64 * 1024), m_flushCount(0), m_flush()
+{
+    m_flush.setInterval(0);
+    m_flush.setSingleShot(true);
+    connect(&m_flush, SIGNAL(timeout()), SLOT(flush()));
+
+    connect(m_device, SIGNAL(bytesWritten(qint64)), SLOT(deviceBytesWritten(qint64)));
+}
+
+QMPCommandQueue::~QMPCommandQueue() {
+}
+
+bool QMPCommandQueue::enqueue(const QByteArray& a_cmd) {
+    bool l_ok = true;
+
+    foreach (QByteArray l_cmd, a_cmd.split('\n')) {
+        l_cmd = l_cmd.trimmed();
+        if (l_cmd.isEmpty()) continue;
+
+        l_ok &= enqueue(l_cmd, priorityOf(l_cmd), coalesceKeyOf(l_cmd));
+    }
+
+    return l_ok;
+}
+
+bool QMPCommandQueue::enqueue(const QByteArray& a_cmd, Priority a_priority, const QByteArray& a_key) {
+    Command l_cmd;
+    l_cmd.key = a_key;
+    l_cmd.data = a_cmd;
+    if (!l_cmd.data.endsWith("\n")) l_cmd.data += "\n";
+
+    // a newer command of the same kind drops the queued one and goes last,
+    // it must not overtake what was queued after the old one
+    if (!l_cmd.key.isEmpty()) {
+        for (qint32 i = 0; i < m_commands.count(); ++i) {
+            if (m_commands.at(i).key == l_cmd.key) {
+                m_queuedBytes -= m_commands.at(i).data.size();
+                m_commands.removeAt(i);
+                break;
+            }
+        }
+    }
+
+    qint64 l_limit = m_maxPendingBytes;
+    if (a_priority == prCosmetic) l_limit /= 2;
+    if ((a_priority != prTransport)
+    &&  (pendingBytes() + l_cmd.data.size() > l_limit)) {
+        emit overflow(pendingBytes());
+        return false;
+    }
+
+    m_commands += l_cmd;
+    m_queuedBytes += l_cmd.data.size();
+
+    if (m_flush.timerId() == -1)
+        m_flush.start();
+
+    return true;
+}
+
+void QMPCommandQueue::clear() {
+    m_commands.clear();
+    m_queuedBytes = 0;
+    m_flush.stop();
+}
+
+void QMPCommandQueue::setDevice(QIODevice* a_device) {
+    m_device->disconnect(this);
+    m_device = a_device;
+    connect(m_device, SIGNAL(bytesWritten(qint64)), SLOT(deviceBytesWritten(qint64)));
+
+    if ((m_queuedBytes > 0)
+    &&  (m_flush.timerId() == -1)) {
+        m_flush.start();
+    }
+}
+
+QIODevice* QMPCommandQueue::device() const {
+    return m_device;
+}
+
+void QMPCommandQueue::setLogSource(const void* a_source) {
+    m_logSource = a_source;
+}
+
+void QMPCommandQueue::setMaxPendingBytes(qint64 a_bytes) {
+    m_maxPendingBytes = a_bytes;
+}
+
+qint64 QMPCommandQueue::maxPendingBytes() const {
+    return m_maxPendingBytes;
+}
+
+qint64 QMPCommandQueue::pendingBytes() const {
+    return m_queuedBytes + m_device->bytesToWrite();
+}
+
+quint32 QMPCommandQueue::flushCount() const {
+    return m_flushCount;
+}
+
+QMPCommandQueue::Priority QMPCommandQueue::priorityOf(const QByteArray& a_cmd) {
+    QList<QByteArray> l_args = a_cmd.simplified().split(' ');
+    if (l_args.first().startsWith("pausing")) l_args.removeFirst();
+    if (l_args.isEmpty()) return prNormal;
+
+    const QByteArray& l_verb = l_args.first();
+    if ((l_verb == "loadfile")
+    ||  (l_verb == "loadlist")
+    ||  (l_verb == "pause")
+    ||  (l_verb == "stop")
+    ||  (l_verb == "quit")
+    ||  (l_verb == "seek")
+    ||  (l_verb == "seek_chapter")
+    ||  (l_verb == "frame_step")
+    ||  (l_verb == "pt_step")) {
+        return prTransport;
+    }
+
+    if ((l_verb == "brightness")
+    ||  (l_verb == "contrast")
+    ||  (l_verb == "gamma")
+    ||  (l_verb == "hue")
+    ||  (l_verb == "saturation")
+    ||  (l_verb == "panscan")
+    ||  l_verb.startsWith("osd")
+    ||  l_verb.startsWith("sub_")
+    ||  l_verb.startsWith("vo_")) {
+        return prCosmetic;
+    }
+
+    return prNormal;
+}
+
+QByteArray QMPCommandQueue::coalesceKeyOf(const QByteArray& a_cmd) {
+    QList<QByteArray> l_args = a_cmd.simplified().split(' ');
+    if (l_args.first().startsWith("pausing")) l_args.removeFirst();
+    if (l_args.count() < 2) return QByteArray();
+
+    const QByteArray& l_verb = l_args.first();
+
+    // only absolute commands can replace each other, relative ones add up
+    if (l_verb == "seek") {
+        if ((l_args.count() > 2) && (l_args.at(2) != "0")) return l_verb;
+        return QByteArray();
+    }
+    if ((l_verb == "volume")
+    ||  (l_verb == "audio_delay")
+    ||  (l_verb == "brightness")
+    ||  (l_verb == "contrast")
+    ||  (l_verb == "gamma")
+    ||  (l_verb == "hue")
+    ||  (l_verb == "saturation")) {
+        if ((l_args.count() > 2) && (l_args.at(2) != "0")) return l_verb;
+        return QByteArray();
+    }
+    if (l_verb == "mute") {
+        return l_verb;
+    }
+    if ((l_verb == "set_property") && (l_args.count() > 2)) {
+        return l_verb + " " + l_args.at(1);
+    }
+
+    return QByteArray();
+}
+
+void QMPCommandQueue::flush() {
+    if (m_queuedBytes == 0) return;
+
+    // wait for the reader to catch up, deviceBytesWritten() resumes us
+    if (m_device->bytesToWrite() >= m_maxPendingBytes) return;
+
+    bool l_log = QMPLog::isEnabled(QMPLog::lcStdin);
+
+    QByteArray l_batch;
+    l_batch.reserve(m_queuedBytes);
+    foreach (const Command& l_cmd, m_commands) {
+        l_batch += l_cmd.data;
+        if (l_log)
+            QMPLog::write(QMPLog::lcStdin, m_logSource, l_cmd.data.constData(), l_cmd.data.size() - 1);
+    }
+    m_commands.clear();
+    m_queuedBytes = 0;
+    m_flush.stop();
+
+    m_device->write(l_batch);
+    ++m_flushCount;
+    emit flushed(l_batch);
+}
+
+void QMPCommandQueue::deviceBytesWritten(qint64 a_bytes) {
+    Q_UNUSED(a_bytes);
+
+    if ((m_queuedBytes > 0)
+    &&  (m_flush.timerId() == -1)) {
+        m_flush.start();
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef QMPCOMMANDQUEUE_H
+#define QMPCOMMANDQUEUE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QList>
+#include <QTimer>
+
+class QIODevice;
+
+// Slave command queue: everything queued during one event loop turn is
+// written to the device at once, in the order it was queued, since
+// replies are matched by order. The newest absolute command of a kind
+// replaces the older one, at its own place in the queue. Outstanding
+// bytes are capped; the priority only decides what the cap may refuse.
+class QMPCommandQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    // prCosmetic is refused from half the cap on, prNormal at the cap,
+    // prTransport (quit, stop, seek, ...) never
+    enum Priority {
+        prTransport = 0,
+        prNormal,
+        prCosmetic,
+
+        prCount
+    };
+
+    explicit QMPCommandQueue(QIODevice* a_device, QObject* a_parent = 0);
+    virtual ~QMPCommandQueue();
+
+    // a_cmd may hold several newline separated commands
+    bool enqueue(const QByteArray& a_cmd);
+    bool enqueue(const QByteArray& a_cmd, Priority a_priority, const QByteArray& a_key = QByteArray());
+
+    void clear();
+
+    // queued commands stay and go to the new device
+    void setDevice(QIODevice* a_device);
+    QIODevice* device() const;
+
+    // identifies the writer in QMPLog records, the queue itself by default
+    void setLogSource(const void* a_source);
+
+    void setMaxPendingBytes(qint64 a_bytes);
+    qint64 maxPendingBytes() const;
+    qint64 pendingBytes() const;
+    // number of writes so far, a command queued now goes out with write
+    // flushCount() + 1 at the earliest
+    quint32 flushCount() const;
+
+    static Priority priorityOf(const QByteArray& a_cmd);
+    static QByteArray coalesceKeyOf(const QByteArray& a_cmd);
+
+public slots:
+    void flush();
+
+signals:
+    void overflow(qint64 a_pendingBytes);
+    // what was written to the device
+    void flushed(const QByteArray& a_data);
+
+private slots:
+    void deviceBytesWritten(qint64 a_bytes);
+
+private:
+    struct Command {
+        QByteArray key;
+        QByteArray data;
+    };
+
+    QIODevice* m_device;
+    const void* m_logSource;
+    QList<Command> m_commands;
+    qint64 m_queuedBytes;
+    qint64 m_maxPendingBytes;
+    quint32 m_flushCount;
+    QTimer m_flush;
+};
+
+#endif // QMPCOMMANDQUEUE_H
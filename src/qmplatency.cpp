@@ -0,0 +1,78 @@
+#include "qmplatency.h"
+#include <string.h>
+
+QMPLatencyHistogram::QMPLatencyHistogram() {
+    clear();
+}
+
+void QMPLatencyHistogram::add(qint32 a_ms) {
+    a_ms = qMax(0, a_ms);
+
+    ++m_buckets[bucketOf(a_ms)];
+    if (m_count == 0) {
+        m_min = a_ms;
+        m_max = a_ms;
+    } else {
+        m_min = qMin(m_min, a_ms);
+        m_max = qMax(m_max, a_ms);
+    }
+    ++m_count;
+    m_sum += a_ms;
+}
+
+void QMPLatencyHistogram::clear() {
+    memset(m_buckets, 0, sizeof(m_buckets));
+    m_count = 0;
+    m_sum = 0;
+    m_min = 0;
+    m_max = 0;
+}
+
+qint64 QMPLatencyHistogram::count() const {
+    return m_count;
+}
+
+qint32 QMPLatencyHistogram::min() const {
+    return m_min;
+}
+
+qint32 QMPLatencyHistogram::max() const {
+    return m_max;
+}
+
+qreal QMPLatencyHistogram::mean() const {
+    return m_count ? qreal(m_sum) / m_count : 0;
+}
+
+qint32 QMPLatencyHistogram::percentile(qreal a_percent) const {
+    if (m_count == 0) return 0;
+
+    // the rank of the value asked for, 1 based
+    qint64 l_rank = qMax<qint64>(1, qint64(qBound<qreal>(0, a_percent, 100) / 100 * m_count + 0.5));
+    qint64 l_seen = 0;
+    for (qint32 i = 0; i < sc_buckets; ++i) {
+        l_seen += m_buckets[i];
+        if (l_seen >= l_rank)
+            return qBound(m_min, upperBound(i), m_max);
+    }
+    return m_max;
+}
+
+qint32 QMPLatencyHistogram::bucketOf(qint32 a_ms) {
+    if (a_ms < 16) return a_ms;
+
+    qint32 l_exponent = 4;
+    while ((l_exponent < 30) && (a_ms >> (l_exponent + 1)))
+        ++l_exponent;
+
+    qint32 l_bucket = 16 + (l_exponent - 4) * 8 + ((a_ms >> (l_exponent - 3)) & 7);
+    return qMin(l_bucket, sc_buckets - 1);
+}
+
+qint32 QMPLatencyHistogram::upperBound(qint32 a_bucket) {
+    if (a_bucket < 16) return a_bucket;
+
+    qint32 l_exponent = 4 + (a_bucket - 16) / 8;
+    qint32 l_sub = (a_bucket - 16) % 8;
+    return ((8 + l_sub + 1) << (l_exponent - 3)) - 1;
+}
@@ -0,0 +1,37 @@
+#ifndef QMPLATENCY_H
+#define QMPLATENCY_H
+
+#include <QtGlobal>
+
+// Histogram of ms values: exact up to 16 ms, then 8 buckets per doubling
+// up to ~4 min, so a percentile is off by at most 1/8. Adding is a few
+// instructions and the whole thing is a fixed 512 bytes.
+class QMPLatencyHistogram
+{
+public:
+    QMPLatencyHistogram();
+
+    void add(qint32 a_ms);
+    void clear();
+
+    qint64 count() const;
+    qint32 min() const;
+    qint32 max() const;
+    qreal mean() const;
+    // a_percent in [0, 100], the upper bound of the bucket it falls in
+    qint32 percentile(qreal a_percent) const;
+
+    static const qint32 sc_buckets = 16 + 14 * 8;
+
+private:
+    static qint32 bucketOf(qint32 a_ms);
+    static qint32 upperBound(qint32 a_bucket);
+
+    quint32 m_buckets[sc_buckets];
+    qint64 m_count;
+    qint64 m_sum;
+    qint32 m_min;
+    qint32 m_max;
+};
+
+#endif // QMPLATENCY_H
@@ -1,31 +1,83 @@
 #include "qmplayer.h"
-#include <QDebug>
+#include "qmpmediaprobe.h"
+#include "qmpmediainfoparser.h"
+#include "qmplog.h"
+#ifdef QMP_USE_AUDIOTAP
+#include "qmpaudiotap.h"
+#endif
+#ifdef QMP_USE_THUMBNAILER
+#include "qmpthumbnailer.h"
+#endif
+#include <QFile>
+#include <QFileInfo>
 #include <QRegExp>
-#include <QCoreApplication>
+#include <QMetaObject>
 
 QString QMPlayer::sm_mplayerPath = "mplayer";
 QString QMPlayer::sm_mplayerVersion;
+QSet<QString> QMPlayer::sm_mplayerOptions;
+QMPProcess::Backend QMPlayer::sm_processBackend = QMPProcess::bkQProcess;
 
 QMPlayer::QMPlayer(QObject *parent) :
-    QObject(parent), m_process(), m_mode(mdAuto), m_mediaInfo(), m_state(stNotStarted),
-    m_notifyErrors(), m_parameterValues(), m_sendPendingParameter(),
-    m_pendingParameter(paNone, 0), m_error(etNoErr, "No Error")
+    QObject(parent), m_process(QMPProcess::create(sm_processBackend, this)), m_commands(m_process),
+    m_processArgs(), m_stopRequested(false), m_mode(mdAuto), m_mediaInfo(), m_mediaInfoParser(0),
+    m_state(stNotStarted), m_clock(),
+    m_notifyErrors(), m_parameterValues(), m_parameterDelays(), m_sendPendingParameter(),
+    m_pendingParameters(), m_seekMode(smFast), m_hasPendingSeek(false), m_seekInFlight(false),
+    m_seekSettling(false), m_seekPauseAfterLoad(false), m_lastSeekLatency(-1), m_seekTimeout(),
+    m_nextQueryId(0), m_pendingQueries(), m_sentQueries(), m_sendPendingQueries(),
+    m_playlist(), m_nextStaged(false), m_nextMediaInfo(), m_probe(0),
+    m_watchdog(false), m_prewarm(false), m_restartBudget(5), m_restartWindow(60000), m_backoffInitial(250),
+    m_backoffMax(10000), m_restartCount(0), m_restarts(), m_restore(), m_restartTimer(), m_spare(0), m_respawnRequested(false),
+    m_stallTimeout(3000), m_stallRecovery(srNudge), m_stallCheck(), m_lastProgress(0), m_stalled(false), m_stallRecovering(false),
+    m_stallStart(0), m_stallCount(0), m_stallTime(0), m_lastStallDuration(0), m_error(etNoErr, "No Error"),
+    m_diagnostics(), m_diagnosticKeys(), m_diagnosticEmitted(), m_diagnosticIds(), m_nextDiagnostic(0), m_pendingErrors(),
+    m_pendingErrorIds(), m_diagnosticNumbers("0x[0-9a-fA-F]+|[0-9]+([.][0-9]+)?"),
+    m_errorRate(10), m_errorTokens(10), m_errorTokensAt(0), m_traceFile(0), m_trace(0),
+    m_latencyReport(), m_latencyChanged(false), m_seekTimeouts(0), m_volumeProbe(-1),
+    m_volumeProbeAt(0), m_volumeProbeFlush(0),
+    m_audioTap(0), m_snapshotEncoder(0), m_snapshotFrames(0), m_pendingSnapshots()
 {
-    m_sendPendingParameter.setInterval(50);
     m_sendPendingParameter.setSingleShot(true);
     connect(&m_sendPendingParameter, SIGNAL(timeout()), SLOT(sendPendingParameter()));
+    m_clock.start();
+
+    m_seekTimeout.setInterval(2000);
+    m_seekTimeout.setSingleShot(true);
+    connect(&m_seekTimeout, SIGNAL(timeout()), SLOT(seekTimedOut()));
+
+    // queries issued in the same event loop turn go out in a single write
+    m_sendPendingQueries.setInterval(0);
+    m_sendPendingQueries.setSingleShot(true);
+    connect(&m_sendPendingQueries, SIGNAL(timeout()), SLOT(sendPendingQueries()));
 
+    // a burst of the same message becomes one signal with a repeat count
     m_notifyErrors.setInterval(100);
     m_notifyErrors.setSingleShot(true);
+    setDiagnosticsCapacity(256);
     connect(&m_notifyErrors, SIGNAL(timeout()), SLOT(emitErrors()));
 
-    m_notifyFinishedPlay.setInterval(500);
-    m_notifyFinishedPlay.setSingleShot(true);
-    connect(&m_notifyFinishedPlay, SIGNAL(timeout()), SLOT(emitFinishPlay()));
+    m_restartTimer.setSingleShot(true);
+    connect(&m_restartTimer, SIGNAL(timeout()), SLOT(restartProcess()));
+
+    m_commands.setLogSource(this);
+
+    m_stallCheck.setInterval(500);
+    connect(&m_stallCheck, SIGNAL(timeout()), SLOT(checkStall()));
+
+    for (qint32 i = 0; i < lmCount; ++i) {
+        m_latencyStart[i] = -1;
+    }
+    connect(&m_latencyReport, SIGNAL(timeout()), SLOT(emitLatencyReport()));
 
-    connect(&m_process, SIGNAL(finished(int,QProcess::ExitStatus)), SLOT(processFinished(int, QProcess::ExitStatus)));
-    connect(&m_process, SIGNAL(readyReadStandardError()), SLOT(processReadyReadStandardError()));
-    connect(&m_process, SIGNAL(readyReadStandardOutput()), SLOT(processReadyReadStandardOutput()));
+    attachProcess();
+    connect(&m_commands, SIGNAL(overflow(qint64)), SIGNAL(commandOverflow(qint64)));
+
+    m_mediaInfoParser = new QMPMediaInfoParser(&m_mediaInfo);
+
+    m_probe = new QMPMediaProbe(this);
+    m_probe->setMaxWorkers(1);
+    connect(m_probe, SIGNAL(probed(QString,QMPlayer::MediaInfo)), SLOT(nextProbed(QString,QMPlayer::MediaInfo)));
 
     m_parameterValues[paMediaProgress] = 0;
     m_parameterValues[paAudioDelay] = 0;
@@ -36,10 +88,21 @@ QMPlayer::QMPlayer(QObject *parent) :
     m_parameterValues[paVideoGamma] = 0;
     m_parameterValues[paVideoHue] = 0;
     m_parameterValues[paVideoSaturation] = 0;
+
+    // toggles have nothing to coalesce
+    m_parameterDelays[paAudioMute] = 0;
 }
 
 QMPlayer::~QMPlayer() {
     stopProcess();
+    stopTrace();
+    delete m_mediaInfoParser;
+
+    // nobody is left to deliver the frames
+    foreach (const PendingSnapshot& l_snapshot, m_pendingSnapshots) {
+        m_snapshotEncoder->release();
+        QMPSnapshotEncoder::fail(l_snapshot.result, "Player destroyed");
+    }
 }
 
 bool QMPlayer::startProcess(qint32 a_winId, const QStringList& a_args) {
@@ -68,7 +131,11 @@ bool QMPlayer::startProcess(qint32 a_winId, const QStringList& a_args) {
     l_args += "-colorkey";
     l_args += "0x020202";
     l_args += "-ao";
+#ifdef QMP_USE_AUDIOTAP
+    l_args += m_audioTap ? m_audioTap->audioOutput() : QString("alsa,");
+#else
     l_args += "alsa,";
+#endif
     l_args += "-osdlevel";
     l_args += "0";
     l_args += "-contrast";
@@ -90,10 +157,11 @@ bool QMPlayer::startProcess(qint32 a_winId, const QStringList& a_args) {
     l_args += "-double";
     l_args += "-noquiet";
     l_args += "-msglevel";
-    l_args += "identify=4";
+    l_args += "identify=4:global=6";
     l_args += "-idle";
     l_args += "-af";
-    l_args += "volnorm";
+    // the tap only reads signed 16 bit
+    l_args += m_audioTap ? "volnorm,format=s16le" : "volnorm";
     l_args += "-input";
     l_args += "nodefault-bindings";
     l_args += "-noconfig";
@@ -107,38 +175,366 @@ bool QMPlayer::startProcess(qint32 a_winId, const QStringList& a_args) {
     }
     l_args += a_args;
 
-    m_process.start(sm_mplayerPath, l_args);
-    if (!m_process.waitForStarted()) {
-        setError(etFatal, "Process not started: " + m_process.errorString());
-        return false;
-    }
-
-    setState(stIdle);
-    setAudioVolume(100);
+#ifdef QMP_USE_AUDIOTAP
+    if (m_audioTap && !m_audioTap->isRunning())
+        m_audioTap->start();
+#endif
 
-    return true;
+    m_processArgs = l_args;
+    m_restarts.clear();
+    return launchProcess();
 }
 
 bool QMPlayer::stopProcess() {
+    m_restartTimer.stop();
+    discardSpare();
+
     if (m_state != stNotStarted) {
+        m_stopRequested = true;
         setState(stStopped);
         writeCommand("quit\n");
-        return m_process.waitForFinished();
+        m_commands.flush();
+        return m_process->waitForFinished();
     }
 
     return true;
 }
 
-void QMPlayer::writeCommand(QByteArray a_cmd) {
-    if (!a_cmd.endsWith("\n")) a_cmd += "\n";
-    m_process.write(a_cmd);
+bool QMPlayer::launchProcess() {
+    m_commands.clear();
+    beginLatency(lmStartup);
+    m_process->start(sm_mplayerPath, m_processArgs);
+    if (!m_process->waitForStarted()) {
+        m_latencyStart[lmStartup] = -1;
+        setError(etFatal, "Process not started: " + m_process->errorString(), dcProcess);
+        return false;
+    }
+
+    QMP_LOG(QMPLog::lcProcess, this, QString("started pid %1").arg(m_process->pid()));
+    processStarted();
+    return true;
+}
+
+void QMPlayer::processStarted() {
+    QStringList l_unapplied = m_process->unappliedLaunchOptions();
+    if (!l_unapplied.isEmpty())
+        setError(etWarning, "Launch options not applied: " + l_unapplied.join(", "), dcProcess);
+
+    if (m_trace) {
+        trace(QMPTrace::tsEvent, QString("started %1 %2 %3").arg(m_process->pid()).arg(sm_mplayerPath)
+              .arg(m_processArgs.join(" ")).toUtf8());
+    }
+
+    m_stopRequested = false;
+    setState(stIdle);
+    writeCommand(QString("volume %1 1\n").arg(m_parameterValues[paAudioVolume]).toUtf8());
+    // the banner comes before mplayer reads its input, an answer after
+    if (m_latencyStart[lmStartup] >= 0)
+        queryProperty("volume", this, SLOT(startupAnswered(qint32,QString,QString,bool)));
+
+    prewarm();
+}
+
+void QMPlayer::attachProcess() {
+    connect(m_process, SIGNAL(finished(int,QProcess::ExitStatus)), SLOT(processFinished(int, QProcess::ExitStatus)));
+    connect(m_process, SIGNAL(readyReadStandardError()), SLOT(processReadyReadStandardError()));
+    connect(m_process, SIGNAL(readyReadStandardOutput()), SLOT(processReadyReadStandardOutput()));
+}
+
+void QMPlayer::setWatchdogEnabled(bool a_enabled) {
+    m_watchdog = a_enabled;
+    if (m_watchdog) {
+        prewarm();
+    } else {
+        m_restartTimer.stop();
+        discardSpare();
+    }
+}
+
+bool QMPlayer::watchdogEnabled() const {
+    return m_watchdog;
+}
+
+void QMPlayer::setWatchdogPrewarm(bool a_prewarm) {
+    m_prewarm = a_prewarm;
+    if (m_prewarm)
+        prewarm();
+    else
+        discardSpare();
+}
+
+bool QMPlayer::watchdogPrewarm() const {
+    return m_prewarm;
+}
+
+void QMPlayer::setRestartBudget(qint32 a_restarts, qint32 a_windowMs) {
+    m_restartBudget = qMax(0, a_restarts);
+    m_restartWindow = qMax(0, a_windowMs);
+}
+
+void QMPlayer::setRestartBackoff(qint32 a_initialMs, qint32 a_maxMs) {
+    m_backoffInitial = qMax(0, a_initialMs);
+    m_backoffMax = qMax(m_backoffInitial, a_maxMs);
+}
+
+qint32 QMPlayer::restartCount() const {
+    return m_restartCount;
+}
+
+void QMPlayer::prewarm() {
+    if (!m_watchdog || !m_prewarm || m_spare) return;
+    if ((m_state == stNotStarted) || m_processArgs.isEmpty()) return;
+
+    // same arguments and placement, it idles until the running one dies
+    m_spare = QMPProcess::create(sm_processBackend, this);
+    m_spare->setLaunchOptions(m_process->launchOptions());
+    connect(m_spare, SIGNAL(finished(int,QProcess::ExitStatus)), SLOT(spareFinished()));
+    // a full pipe would block it before it is ever needed
+    connect(m_spare, SIGNAL(readyReadStandardOutput()), SLOT(drainSpare()));
+    connect(m_spare, SIGNAL(readyReadStandardError()), SLOT(drainSpare()));
+    m_spare->start(sm_mplayerPath, m_processArgs);
+}
+
+void QMPlayer::discardSpare() {
+    if (!m_spare) return;
+
+    m_spare->disconnect(this);
+    m_spare->kill();
+    m_spare->deleteLater();
+    m_spare = 0;
+}
+
+void QMPlayer::spareFinished() {
+    if (sender() != m_spare) return;
+
+    m_spare->deleteLater();
+    m_spare = 0;
+}
+
+void QMPlayer::drainSpare() {
+    if (!m_spare || (sender() != m_spare)) return;
+
+    m_spare->readAllStandardOutput();
+    m_spare->readAllStandardError();
+}
+
+void QMPlayer::scheduleRestart() {
+    qint64 l_now = m_clock.elapsed();
+    while (!m_restarts.isEmpty() && (l_now - m_restarts.first() > m_restartWindow)) {
+        m_restarts.removeFirst();
+    }
+
+    if (m_restarts.count() >= m_restartBudget) {
+        setError(etFatal, QString("Watchdog gave up after %1 restarts").arg(m_restarts.count()), dcProcess);
+        // nothing recovers the stall any more
+        if (m_stalled) endStall();
+        emit watchdogGaveUp();
+        return;
+    }
+
+    // the first restart is immediate, a crash loop backs off
+    qint32 l_delay = 0;
+    if (!m_restarts.isEmpty())
+        l_delay = qMin<qint64>(m_backoffMax, qint64(m_backoffInitial) << qMin(m_restarts.count() - 1, 16));
+
+    m_restarts += l_now;
+    m_restartTimer.start(l_delay);
+}
+
+void QMPlayer::restartProcess() {
+    if (m_state != stNotStarted) return;
+
+    if (m_spare && (m_spare->state() == QProcess::Running)) {
+        m_process->disconnect(this);
+        m_process->deleteLater();
+        m_process = m_spare;
+        m_spare->disconnect(this);
+        m_spare = 0;
+
+        // whatever the spare printed while idling is of no interest
+        m_process->readAllStandardOutput();
+        m_process->readAllStandardError();
+        attachProcess();
+        m_commands.clear();
+        m_commands.setDevice(m_process);
+        processStarted();
+    } else if (!launchProcess()) {
+        scheduleRestart();
+        return;
+    }
+
+    ++m_restartCount;
+    restoreParameters();
+    restoreMedia();
+
+    emit restarted(m_restartCount);
+}
+
+void QMPlayer::restoreMedia() {
+    if ((m_restore.url.isEmpty())
+    ||  (m_restore.state < stLoading)
+    ||  (m_restore.state == stStopped))
+        return;
+
+    if (m_state != stIdle) {
+        writeCommand("stop\n");
+        setState(stIdle);
+        resetSeek();
+    }
+
+    play(m_restore.url);
+    if (m_restore.position > 0)
+        seek(m_restore.position, true);
+    if (m_restore.state == stPaused)
+        m_seekPauseAfterLoad = true;
+}
+
+// the process starts with defaults, every known value is sent again
+void QMPlayer::restoreParameters() {
+    QList<Parameter> l_params = m_parameterValues.keys();
+    qSort(l_params);
+
+    QByteArray l_commands;
+    foreach (Parameter l_param, l_params) {
+        qreal l_value = m_parameterValues[l_param];
+        l_commands += parameterCommand(l_param, &l_value).toUtf8();
+    }
+    writeCommand(l_commands);
+}
+
+void QMPlayer::setStallTimeout(qint32 a_ms) {
+    m_stallTimeout = qMax(0, a_ms);
+    updateStallCheck();
+}
+
+qint32 QMPlayer::stallTimeout() const {
+    return m_stallTimeout;
+}
+
+void QMPlayer::setStallRecovery(QMPlayer::StallRecovery a_recovery) {
+    m_stallRecovery = a_recovery;
+}
+
+QMPlayer::StallRecovery QMPlayer::stallRecovery() const {
+    return m_stallRecovery;
+}
+
+bool QMPlayer::isStalled() const {
+    return m_stalled;
+}
+
+qint32 QMPlayer::stallCount() const {
+    return m_stallCount;
+}
+
+qint64 QMPlayer::totalStallTime() const {
+    if (m_stalled)
+        return m_stallTime + m_clock.elapsed() - m_stallStart;
+    return m_stallTime;
+}
+
+qint32 QMPlayer::lastStallDuration() const {
+    return m_lastStallDuration;
+}
+
+// only playback is watched, paused and buffering players make no progress
+// on purpose
+void QMPlayer::updateStallCheck() {
+    m_lastProgress = m_clock.elapsed();
+
+    if ((m_state == stPlaying) && (m_stallTimeout > 0)) {
+        if (!m_stallCheck.isActive())
+            m_stallCheck.start();
+    } else {
+        m_stallCheck.stop();
+        // reload and respawn pass through these on their way back to
+        // playback, only a new position ends their stall
+        bool l_recovering = m_stallRecovering
+                         && ((m_state == stNotStarted) || (m_state == stIdle)
+                         ||  (m_state == stLoading) || (m_state == stBuffering));
+        if (m_stalled && !l_recovering) endStall();
+    }
+}
+
+void QMPlayer::checkStall() {
+    qint64 l_now = m_clock.elapsed();
+
+    // a seek has its own timeout, the clock starts again once it is done
+    if ((m_state != stPlaying) || m_seekInFlight || m_hasPendingSeek) {
+        m_lastProgress = l_now;
+        return;
+    }
+    if (l_now - m_lastProgress < m_stallTimeout) return;
+
+    if (!m_stalled) {
+        m_stalled = true;
+        m_stallStart = m_lastProgress;
+        ++m_stallCount;
+        emit stalled();
+    }
+    // the next attempt waits for another full timeout
+    m_lastProgress = l_now;
+
+    switch (m_stallRecovery) {
+        case srNone: break;
+
+        case srNudge: {
+            writeCommand("seek -1 0\n");
+        } break;
+        case srReload: {
+            m_stallRecovering = true;
+            m_restore.url = m_mediaInfo.url;
+            m_restore.position = m_parameterValues[paMediaProgress];
+            m_restore.state = m_state;
+            restoreMedia();
+        } break;
+        case srRespawn: {
+            // processFinished() restarts and restores like the watchdog does
+            m_stallRecovering = true;
+            m_respawnRequested = true;
+            m_process->kill();
+        } break;
+    }
+}
+
+void QMPlayer::endStall() {
+    m_stalled = false;
+    m_stallRecovering = false;
+    m_lastStallDuration = m_clock.elapsed() - m_stallStart;
+    m_stallTime += m_lastStallDuration;
+    emit stallEnded(m_lastStallDuration);
+}
+
+void QMPlayer::setLaunchOptions(const QMPProcess::LaunchOptions& a_options) {
+    m_process->setLaunchOptions(a_options);
+}
+
+const QMPProcess::LaunchOptions& QMPlayer::launchOptions() const {
+    return m_process->launchOptions();
+}
 
-    a_cmd.chop(1);
-    qDebug() << "Mplayer stdin: " << QString::fromUtf8(a_cmd);
+QMPProcess::LaunchOptions QMPlayer::placement() const {
+    return m_process->placement();
+}
+
+bool QMPlayer::writeCommand(QByteArray a_cmd) {
+    return m_commands.enqueue(a_cmd);
+}
+
+void QMPlayer::setMaxPendingCommandBytes(qint64 a_bytes) {
+    m_commands.setMaxPendingBytes(a_bytes);
+}
+
+qint64 QMPlayer::pendingCommandBytes() const {
+    return m_commands.pendingBytes();
 }
 
 QProcess::ProcessState QMPlayer::processState() const {
-    return m_process.state();
+    return m_process->state();
+}
+
+Q_PID QMPlayer::processId() const {
+    return m_process->pid();
 }
 
 QMPlayer::State QMPlayer::state() const {
@@ -181,14 +577,65 @@ qint64 QMPlayer::tell() const {
     return m_parameterValues.value(paMediaProgress, -1);
 }
 
+void QMPlayer::setSeekMode(QMPlayer::SeekMode a_mode) {
+    m_seekMode = a_mode;
+}
+
+QMPlayer::SeekMode QMPlayer::seekMode() const {
+    return m_seekMode;
+}
+
+qint32 QMPlayer::lastSeekLatency() const {
+    return m_lastSeekLatency;
+}
+
 const QMPlayer::MediaInfo& QMPlayer::mediaInfo() const {
     return m_mediaInfo;
 }
 
+qint32 QMPlayer::queryProperty(const QString& a_name, QObject* a_receiver, const char* a_member) {
+    if (m_state == stNotStarted) {
+        setError(etFatal, "Call startProcess(...) first");
+        return -1;
+    }
+
+    PropertyQuery l_query;
+    l_query.id = m_nextQueryId++;
+    l_query.name = a_name;
+    l_query.receiver = a_receiver;
+    if (a_receiver && a_member) {
+        // accept SLOT(name(...)) as well as a bare method name
+        l_query.member = QByteArray(a_member);
+        if ((l_query.member.size() > 0) && (l_query.member[0] >= '0') && (l_query.member[0] <= '9'))
+            l_query.member.remove(0, 1);
+        if (l_query.member.contains('('))
+            l_query.member.truncate(l_query.member.indexOf('('));
+    }
+
+    m_pendingQueries += l_query;
+    if (m_sendPendingQueries.timerId() == -1)
+        m_sendPendingQueries.start();
+
+    return l_query.id;
+}
+
+qint32 QMPlayer::expectPropertyReply(const QString& a_name) {
+    PropertyQuery l_query;
+    l_query.id = m_nextQueryId++;
+    l_query.name = a_name;
+    m_sentQueries.enqueue(l_query);
+    return l_query.id;
+}
+
+qint32 QMPlayer::pendingQueries() const {
+    return m_pendingQueries.count() + m_sentQueries.count();
+}
+
 
 void QMPlayer::setMPlayerPath(const QString& a_path) {
     QMPlayer::sm_mplayerPath = a_path;
     QMPlayer::sm_mplayerVersion = QString();
+    QMPlayer::sm_mplayerOptions.clear();
 }
 
 QString QMPlayer::mPlayerPath() {
@@ -214,6 +661,31 @@ QString QMPlayer::mPlayerVersion() {
     return QMPlayer::sm_mplayerVersion;
 }
 
+bool QMPlayer::mPlayerHasOption(const QString& a_option) {
+    if (QMPlayer::sm_mplayerOptions.isEmpty()) {
+        QProcess p;
+
+        p.start(QMPlayer::sm_mplayerPath, QStringList("-list-options"));
+        if (!p.waitForStarted() || !p.waitForFinished()) return false;
+
+        // one option per line, its name first
+        while (p.canReadLine()) {
+            QString l_line = QString(p.readLine()).trimmed();
+            QString l_name = l_line.section(' ', 0, 0, QString::SectionSkipEmpty);
+            if (!l_name.isEmpty()) QMPlayer::sm_mplayerOptions.insert(l_name);
+        }
+    }
+    return QMPlayer::sm_mplayerOptions.contains(a_option);
+}
+
+void QMPlayer::setProcessBackend(QMPProcess::Backend a_backend) {
+    QMPlayer::sm_processBackend = a_backend;
+}
+
+QMPProcess::Backend QMPlayer::processBackend() {
+    return QMPlayer::sm_processBackend;
+}
+
 void QMPlayer::setAudioDelay(qreal a_ms, bool a_absolute) {
     setParameter(paAudioDelay, a_ms, a_absolute);
 }
@@ -256,6 +728,7 @@ void QMPlayer::play(const QString& a_url) {
     &&  (a_url != m_mediaInfo.url)) {
         writeCommand("stop\n");
         setState(stIdle);
+        resetSeek();
 
         m_mediaInfo.url = a_url;
     } else {
@@ -270,12 +743,16 @@ void QMPlayer::play(const QString& a_url) {
     }
 
     m_mediaInfo = MediaInfo(m_mediaInfo.url);
+    m_mediaInfoParser->reset();
     emit mediaInfoChange();
     m_parameterValues[paMediaProgress] = 0;
     emit tick(m_parameterValues[paMediaProgress]);
 
     setState(stLoading);
-    writeCommand(QByteArray("loadfile '[FILE_NAME]'\n").replace("[FILE_NAME]", m_mediaInfo.url.toUtf8()));
+    // replacing mplayer's playlist also drops whatever was staged
+    m_nextStaged = false;
+    writeCommand(loadCommand(m_mediaInfo.url, false));
+    beginLatency(lmLoad);
 }
 
 void QMPlayer::pause() {
@@ -289,15 +766,11 @@ void QMPlayer::pause() {
         return;
     }
 
-    if (m_notifyFinishedPlay.timerId() != -1) {
-        setError(etWarning, "Near the end, pause not permited now");
-        return;
-    }
-
     if ((m_state == stPlaying)
     ||  (m_state == stPaused)
     ||  (m_state == stStopped)) {
         writeCommand("pause\n");
+        beginLatency((m_state == QMPlayer::stPlaying) ? lmPause : lmResume);
         setState((m_state == QMPlayer::stPlaying) ? QMPlayer::stPaused : QMPlayer::stPlaying);
     }
 }
@@ -308,27 +781,71 @@ void QMPlayer::stop() {
         return;
     }
 
-    if (m_notifyFinishedPlay.timerId() != -1) {
-        setError(etWarning, "Near the end, stop not permited now");
-        return;
-    }
-
     if ((m_state == stPlaying)
     ||  (m_state == stPaused)) {
+        resetSeek();
         seek(0);
-        sendPendingParameter();
-        writeCommand("pause\n");
+        if (m_state == stPlaying)
+            writeCommand("pause\n");
         setState(stStopped);
     }
 }
 
 void QMPlayer::seek(qreal a_value, bool a_absolute) {
-    if (m_notifyFinishedPlay.timerId() != -1) {
-        setError(etWarning, "Near the end, pause not permited now");
+    seek(a_value, a_absolute, m_seekMode);
+}
+
+void QMPlayer::seek(qreal a_value, bool a_absolute, QMPlayer::SeekMode a_mode) {
+    if (m_state == stNotStarted) {
+        setError(etFatal, "Call startProcess(...) first");
         return;
     }
 
-    setParameter(paMediaProgress, a_value, a_absolute);
+    if (!a_absolute) {
+        if (m_hasPendingSeek)
+            a_value += m_pendingSeek.target;
+        else if (m_seekInFlight)
+            a_value += m_activeSeek.target;
+        else
+            a_value += m_parameterValues[paMediaProgress];
+    }
+
+    m_pendingSeek.target = a_value;
+    m_pendingSeek.mode = a_mode;
+    m_pendingSeek.requestedAt = m_clock.elapsed();
+    m_hasPendingSeek = true;
+
+    sendPendingSeek();
+}
+
+void QMPlayer::enqueue(const QString& a_url) {
+    m_playlist += a_url;
+    emit playlistChange();
+
+    if ((m_state == stPlaying)
+    ||  (m_state == stPaused)
+    ||  (m_state == stStopped)) {
+        stageNext();
+    }
+}
+
+void QMPlayer::clearPlaylist() {
+    // an item already handed to mplayer can not be taken back, it is
+    // replaced by the next play(...)
+    if (m_nextStaged) {
+        m_playlist = m_playlist.mid(0, 1);
+    } else {
+        m_playlist.clear();
+    }
+    emit playlistChange();
+}
+
+QStringList QMPlayer::playlist() const {
+    return m_playlist;
+}
+
+const QMPlayer::MediaInfo& QMPlayer::nextMediaInfo() const {
+    return m_nextMediaInfo;
 }
 
 QPair<QMPlayer::ErrType, QString> QMPlayer::lastError() {
@@ -336,20 +853,355 @@ QPair<QMPlayer::ErrType, QString> QMPlayer::lastError() {
 }
 
 
-void QMPlayer::setError(QMPlayer::ErrType a_type, const QString& a_error) {
-    if ((m_error.first != a_type)
-    &&  (m_notifyErrors.timerId() != -1)) {
-        emitErrors();
+void QMPlayer::setError(QMPlayer::ErrType a_type, const QString& a_error, QMPlayer::DiagnosticCategory a_category) {
+    m_error = QPair<QMPlayer::ErrType, QString>(a_type, a_error);
+    qint64 l_now = m_clock.elapsed();
+
+    // messages differing in numbers only (pts, pointers, ...) are one entry
+    QString l_key = QString(a_error).replace(m_diagnosticNumbers, "#");
+    l_key = QString("%1:%2:%3").arg(a_type).arg(a_category).arg(l_key);
+
+    quint64 l_id = m_diagnosticIds.value(l_key, m_nextDiagnostic);
+    Diagnostic* l_entry = diagnostic(l_id) ? &m_diagnostics[l_id % m_diagnostics.size()] : 0;
+    if (l_entry) {
+        l_entry->message = a_error;
+        ++l_entry->count;
+        l_entry->last = l_now;
+
+        // a repeat is only announced again once a second
+        qint64 l_emitted = m_diagnosticEmitted[l_id % m_diagnostics.size()];
+        if ((m_pendingErrorIds.contains(l_id))
+        ||  ((l_emitted >= 0) && (l_now - l_emitted < 1000)))
+            return;
+    } else {
+        l_id = m_nextDiagnostic++;
+        qint32 l_slot = l_id % m_diagnostics.size();
+
+        m_diagnosticIds.remove(m_diagnosticKeys[l_slot]);
+        m_diagnosticKeys[l_slot] = l_key;
+        m_diagnosticIds.insert(l_key, l_id);
+        m_diagnosticEmitted[l_slot] = -1;
+
+        l_entry = &m_diagnostics[l_slot];
+        l_entry->id = l_id;
+        l_entry->type = a_type;
+        l_entry->category = a_category;
+        l_entry->message = a_error;
+        l_entry->count = 1;
+        l_entry->first = l_now;
+        l_entry->last = l_now;
+    }
+
+    m_pendingErrors += l_id;
+    m_pendingErrorIds.insert(l_id);
+    if (m_notifyErrors.timerId() == -1)
+        m_notifyErrors.start(a_type == etFatal ? 0 : 100);
+}
+
+const QMPlayer::Diagnostic* QMPlayer::diagnostic(quint64 a_id) const {
+    if ((a_id >= m_nextDiagnostic)
+    ||  (a_id + m_diagnostics.size() < m_nextDiagnostic))
+        return 0;
+
+    return &m_diagnostics[a_id % m_diagnostics.size()];
+}
+
+QList<QMPlayer::Diagnostic> QMPlayer::diagnostics(qint32 a_count) const {
+    QList<Diagnostic> l_diagnostics;
+
+    quint64 l_available = qMin<quint64>(m_nextDiagnostic, m_diagnostics.size());
+    if ((a_count >= 0) && (quint64(a_count) < l_available))
+        l_available = a_count;
+
+    for (quint64 l_id = m_nextDiagnostic - l_available; l_id < m_nextDiagnostic; ++l_id) {
+        l_diagnostics += m_diagnostics[l_id % m_diagnostics.size()];
+    }
+    return l_diagnostics;
+}
+
+void QMPlayer::clearDiagnostics() {
+    setDiagnosticsCapacity(m_diagnostics.size());
+}
+
+void QMPlayer::setDiagnosticsCapacity(qint32 a_entries) {
+    // ids keep counting, the ring starts empty
+    a_entries = qMax(1, a_entries);
+    m_diagnostics = QVector<Diagnostic>(a_entries);
+    m_diagnosticKeys = QVector<QString>(a_entries);
+    m_diagnosticEmitted = QVector<qint64>(a_entries, -1);
+    m_diagnosticIds.clear();
+    m_pendingErrors.clear();
+    m_pendingErrorIds.clear();
+
+    // nothing below the first new id is valid any more
+    if (m_nextDiagnostic > 0)
+        m_nextDiagnostic += a_entries;
+}
+
+qint32 QMPlayer::diagnosticsCapacity() const {
+    return m_diagnostics.size();
+}
+
+void QMPlayer::setErrorRate(qint32 a_perSecond) {
+    m_errorRate = qMax(1, a_perSecond);
+    m_errorTokens = qMin<qreal>(m_errorTokens, m_errorRate);
+}
+
+qint32 QMPlayer::errorRate() const {
+    return m_errorRate;
+}
+
+QVector<QMPlayer::LatencyStats> QMPlayer::latencyStats() const {
+    QVector<LatencyStats> l_stats(lmCount);
+    for (qint32 i = 0; i < lmCount; ++i) {
+        l_stats[i] = latencyStats(LatencyMetric(i));
+    }
+    return l_stats;
+}
+
+QMPlayer::LatencyStats QMPlayer::latencyStats(QMPlayer::LatencyMetric a_metric) const {
+    const QMPLatencyHistogram& l_histogram = m_latency[a_metric];
+
+    LatencyStats l_stats;
+    l_stats.count = l_histogram.count();
+    l_stats.min = l_histogram.min();
+    l_stats.max = l_histogram.max();
+    l_stats.mean = l_histogram.mean();
+    l_stats.p50 = l_histogram.percentile(50);
+    l_stats.p90 = l_histogram.percentile(90);
+    l_stats.p99 = l_histogram.percentile(99);
+    return l_stats;
+}
+
+const QMPLatencyHistogram& QMPlayer::latencyHistogram(QMPlayer::LatencyMetric a_metric) const {
+    return m_latency[a_metric];
+}
+
+void QMPlayer::resetLatencyStats() {
+    for (qint32 i = 0; i < lmCount; ++i) {
+        m_latency[i].clear();
+    }
+    m_latencyChanged = false;
+    m_seekTimeouts = 0;
+}
+
+qint32 QMPlayer::seekTimeouts() const {
+    return m_seekTimeouts;
+}
+
+void QMPlayer::setLatencyReportInterval(qint32 a_ms) {
+    m_latencyReport.stop();
+    if (a_ms > 0) {
+        m_latencyReport.setInterval(a_ms);
+        m_latencyReport.start();
+    }
+}
+
+qint32 QMPlayer::latencyReportInterval() const {
+    return m_latencyReport.isActive() ? m_latencyReport.interval() : 0;
+}
+
+void QMPlayer::beginLatency(QMPlayer::LatencyMetric a_metric) {
+    m_latencyStart[a_metric] = m_clock.elapsed();
+}
+
+void QMPlayer::endLatency(QMPlayer::LatencyMetric a_metric) {
+    if (m_latencyStart[a_metric] < 0) return;
+
+    addLatency(a_metric, m_clock.elapsed() - m_latencyStart[a_metric]);
+    m_latencyStart[a_metric] = -1;
+}
+
+void QMPlayer::addLatency(QMPlayer::LatencyMetric a_metric, qint32 a_ms) {
+    m_latency[a_metric].add(a_ms);
+    m_latencyChanged = true;
+}
+
+void QMPlayer::emitLatencyReport() {
+    if (!m_latencyChanged) return;
+
+    m_latencyChanged = false;
+    emit latencyReport();
+}
+
+void QMPlayer::volumeApplied(qint32 a_id, const QString& a_name, const QString& a_value, bool a_ok) {
+    Q_UNUSED(a_name);
+    Q_UNUSED(a_value);
+
+    if (a_id != m_volumeProbe) return;
+
+    // failed queries were dropped with the process, nothing was measured
+    m_volumeProbe = -1;
+    if (a_ok)
+        addLatency(lmVolume, m_clock.elapsed() - m_volumeProbeAt);
+}
+
+void QMPlayer::startupAnswered(qint32 a_id, const QString& a_name, const QString& a_value, bool a_ok) {
+    Q_UNUSED(a_id);
+    Q_UNUSED(a_name);
+    Q_UNUSED(a_value);
+    Q_UNUSED(a_ok);
+
+    // an error is an answer too, a dead process is not
+    if (m_state == stNotStarted) {
+        m_latencyStart[lmStartup] = -1;
+        return;
+    }
+    endLatency(lmStartup);
+}
+
+bool QMPlayer::startTrace(const QString& a_path) {
+    stopTrace();
+
+    QFile* l_file = new QFile(a_path);
+    if (!l_file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        setError(etWarning, QString("Cannot write trace %1: %2").arg(a_path).arg(l_file->errorString()));
+        delete l_file;
+        return false;
+    }
+
+    m_traceFile = l_file;
+    m_trace = new QMPTraceWriter(m_traceFile);
+    m_trace->writeHeader();
+    connect(&m_commands, SIGNAL(flushed(QByteArray)), SLOT(traceCommands(QByteArray)));
+
+    // a trace started mid-session replays from the current state
+    if (m_state != stNotStarted)
+        trace(QMPTrace::tsEvent, QString("attached %1 %2").arg(m_process->pid()).arg(m_mediaInfo.url).toUtf8());
+    return true;
+}
+
+void QMPlayer::stopTrace() {
+    if (!m_trace) return;
+
+    disconnect(&m_commands, SIGNAL(flushed(QByteArray)), this, SLOT(traceCommands(QByteArray)));
+    delete m_trace;
+    m_trace = 0;
+    delete m_traceFile;
+    m_traceFile = 0;
+}
+
+bool QMPlayer::isTracing() const {
+    return m_trace != 0;
+}
+
+void QMPlayer::setAudioTapEnabled(bool a_enabled) {
+#ifdef QMP_USE_AUDIOTAP
+    if (a_enabled == (m_audioTap != 0)) return;
+
+    if (a_enabled) {
+        m_audioTap = new QMPAudioTap(this);
+    } else {
+        delete m_audioTap;
+        m_audioTap = 0;
+    }
+#else
+    if (a_enabled) setError(etWarning, "Audio tap not supported on this platform");
+#endif
+}
+
+QMPAudioTap* QMPlayer::audioTap() const {
+    return m_audioTap;
+}
+
+QFuture<QMPSnapshotEncoder::Result> QMPlayer::snapshot(const QImage& a_frame, const QMPSnapshotEncoder::Options& a_options) {
+    return snapshotEncoder()->encode(a_frame, a_options);
+}
+
+QFuture<QMPSnapshotEncoder::Result> QMPlayer::snapshot(const QMPSnapshotEncoder::Options& a_options) {
+    QFutureInterface<QMPSnapshotEncoder::Result> l_result;
+    l_result.reportStarted();
+
+#ifdef QMP_USE_THUMBNAILER
+    if (!m_mediaInfo.valid || !m_mediaInfo.hasVideo()) {
+        QMPSnapshotEncoder::fail(l_result, "No video loaded");
+        return l_result.future();
+    }
+    // a second network session, and not the position of the first one
+    if (!QFileInfo(m_mediaInfo.url).isFile()) {
+        QMPSnapshotEncoder::fail(l_result, "No snapshots of streams, pass the decoded frame instead");
+        return l_result.future();
+    }
+    if (!snapshotEncoder()->acquire()) {
+        QMPSnapshotEncoder::fail(l_result, "Snapshot queue full");
+        return l_result.future();
     }
 
-    if (m_notifyErrors.timerId() == -1) {
-        m_error = QPair<QMPlayer::ErrType, QString>(a_type, "");
+    if (!m_snapshotFrames) {
+        m_snapshotFrames = new QMPThumbnailer(this);
+        m_snapshotFrames->setSize(QSize());
+        m_snapshotFrames->setPreciseSeek(true);
+        connect(m_snapshotFrames, SIGNAL(thumbnailed(QString,qreal,QImage)), SLOT(snapshotFrame(QString,qreal,QImage)));
+    }
+
+    PendingSnapshot l_snapshot;
+    l_snapshot.url = m_mediaInfo.url;
+    l_snapshot.time = m_parameterValues.value(paMediaProgress, 0);
+    l_snapshot.options = a_options;
+    l_snapshot.result = l_result;
+    m_pendingSnapshots += l_snapshot;
+    m_snapshotFrames->thumbnail(l_snapshot.url, l_snapshot.time);
+#else
+    Q_UNUSED(a_options)
+    QMPSnapshotEncoder::fail(l_result, "Snapshots not supported on this platform");
+#endif
+    return l_result.future();
+}
+
+QMPSnapshotEncoder* QMPlayer::snapshotEncoder() {
+    if (!m_snapshotEncoder)
+        m_snapshotEncoder = new QMPSnapshotEncoder(this);
+    return m_snapshotEncoder;
+}
+
+void QMPlayer::snapshotFrame(const QString& a_url, qreal a_time, const QImage& a_image) {
+    for (qint32 i = 0; i < m_pendingSnapshots.count(); ++i) {
+        if ((m_pendingSnapshots.at(i).url != a_url) || (m_pendingSnapshots.at(i).time != a_time)) continue;
+
+        PendingSnapshot l_snapshot = m_pendingSnapshots.takeAt(i);
+        if (a_image.isNull()) {
+            m_snapshotEncoder->release();
+            QMPSnapshotEncoder::fail(l_snapshot.result, QString("No frame at %1 s").arg(a_time));
+        } else {
+            m_snapshotEncoder->submit(a_image, l_snapshot.options, l_snapshot.result);
+        }
+        return;
+    }
+}
+
+void QMPlayer::trace(QMPTrace::Stream a_stream, const QByteArray& a_data) {
+    if (!m_trace) return;
+
+    // a full disk ends the trace, not the playback
+    if (!m_trace->write(a_stream, a_data)) {
+        QString l_error = m_traceFile->errorString();
+        stopTrace();
+        setError(etWarning, "Trace stopped: " + l_error);
     }
-    if (!m_error.second.isEmpty())
-        m_error.second += "\n";
+}
 
-    m_error.second += a_error;
-    m_notifyErrors.start();
+QMPlayer::DiagnosticCategory QMPlayer::classifyDiagnostic(const QString& a_message) {
+    QString l_message = a_message.toLower();
+
+    // libav* prefixes its messages with "[codec @ 0x...]"
+    if (l_message.startsWith("[") && l_message.contains(" @ 0x"))
+        return dcDecoder;
+    if (l_message.contains("decod") || l_message.contains("codec") || l_message.contains("ffmpeg"))
+        return dcDecoder;
+    if (l_message.contains("demux") || l_message.contains("index") || l_message.contains("packet"))
+        return dcDemuxer;
+    if (l_message.contains("sub"))
+        return dcSubtitle;
+    if (l_message.startsWith("ao") || l_message.contains("audio") || l_message.contains("alsa"))
+        return dcAudio;
+    if (l_message.startsWith("vo") || l_message.contains("video") || l_message.contains("x11")
+    ||  l_message.contains("xv"))
+        return dcVideo;
+    if (l_message.contains("cache") || l_message.contains("stream") || l_message.contains("connect")
+    ||  l_message.contains("http") || l_message.contains("network"))
+        return dcNetwork;
+
+    return dcOther;
 }
 
 void QMPlayer::setState(QMPlayer::State a_new) {
@@ -357,6 +1209,8 @@ void QMPlayer::setState(QMPlayer::State a_new) {
         QMPlayer::State l_old = m_state;
         m_state = a_new;
 
+        updateStallCheck();
+        QMP_LOG(QMPLog::lcState, this, QString("%1 -> %2").arg(l_old).arg(a_new));
         emit stateChange(a_new, l_old);
     }
 }
@@ -367,122 +1221,431 @@ void QMPlayer::setParameter(Parameter a_param, qreal a_v, bool a_absolute) {
         return;
     }
 
-    if (m_pendingParameter.first != a_param) {
-        sendPendingParameter();
-        if (!a_absolute) a_v += m_parameterValues[a_param];
-    } else {
-        if (!a_absolute) a_v += m_pendingParameter.second;
+    // relative steps accumulate on top of a value still waiting to be sent
+    if (!a_absolute) {
+        if (m_pendingParameters.contains(a_param))
+            a_v += m_pendingParameters[a_param].value;
+        else
+            a_v += m_parameterValues[a_param];
     }
 
-    m_pendingParameter = QPair<Parameter, qreal>(a_param, a_v);
-    m_sendPendingParameter.start();
+    PendingParameter& l_pending = m_pendingParameters[a_param];
+    l_pending.value = a_v;
+    l_pending.deadline = m_clock.elapsed() + parameterDelay(a_param);
+
+    schedulePendingParameters();
+}
+
+void QMPlayer::setParameterDelay(Parameter a_param, qint32 a_ms) {
+    m_parameterDelays[a_param] = qMax(0, a_ms);
+}
+
+qint32 QMPlayer::parameterDelay(Parameter a_param) const {
+    return m_parameterDelays.value(a_param, 50);
+}
+
+void QMPlayer::schedulePendingParameters() {
+    if (m_pendingParameters.isEmpty()) {
+        m_sendPendingParameter.stop();
+        return;
+    }
+
+    qint64 l_next = -1;
+    QHash<Parameter, PendingParameter>::const_iterator l_it;
+    for (l_it = m_pendingParameters.constBegin(); l_it != m_pendingParameters.constEnd(); ++l_it) {
+        if ((l_next < 0) || (l_it.value().deadline < l_next))
+            l_next = l_it.value().deadline;
+    }
+
+    m_sendPendingParameter.start(qMax<qint64>(0, l_next - m_clock.elapsed()));
 }
 
 void QMPlayer::sendPendingParameter() {
-    QString l_toSend;
-    bool l_setOrig = true;
+    sendPendingParameters(false);
+}
 
-    switch (m_pendingParameter.first) {
-        case paNone: return;
+void QMPlayer::sendPendingParameters(bool a_all) {
+    qint64 l_now = m_clock.elapsed();
+    bool l_sent = false;
 
-        case paMediaProgress: {
-            if (m_state == stIdle) {
-                play();
+    // everything due goes out in this event loop turn, the command queue
+    // turns it into a single write
+    QList<Parameter> l_params = m_pendingParameters.keys();
+    qSort(l_params);
+    foreach (Parameter l_param, l_params) {
+        if (!m_pendingParameters.contains(l_param)) continue;
+        if (!a_all && (m_pendingParameters[l_param].deadline > l_now)) continue;
 
-                while (m_state == stLoading) {
-                    QCoreApplication::processEvents(QEventLoop::ExcludeUserInputEvents);
-                }
+        qreal l_value = m_pendingParameters.take(l_param).value;
+        l_sent |= sendParameter(l_param, l_value);
+    }
 
-                if (m_state == stPlaying) pause();
-            }
+    if (l_sent
+    &&  ((m_state == stPaused)
+    ||   (m_state == stStopped))) {
+        // a command makes the media go to play state
+        setState(stPlaying);
+        pause();
+    }
 
-            if ((m_state != stPlaying)
-            &&  (m_state != stPaused)
-            &&  (m_state != stStopped)) {
-                setError(etWarning, "Invalid state for seek");
-                return;
-            }
+    schedulePendingParameters();
+}
 
-            if (!m_mediaInfo.seekable) {
-                setError(etWarning, "That media file is not seekable");
-                return;
-            }
+bool QMPlayer::sendParameter(Parameter a_param, qreal a_value) {
+    // seeks are handled by sendPendingSeek()
+    if ((a_param == paNone) || (a_param == paMediaProgress)) return false;
+
+    QString l_toSend = parameterCommand(a_param, &a_value);
+    if (l_toSend.isEmpty()) {
+        setError(etWarning, "Not implemented");
+        return false;
+    }
+
+    if (qFuzzyCompare(m_parameterValues[a_param], a_value)) return false;
+
+    // a refused command leaves the value mplayer has
+    if (!writeCommand(l_toSend.toUtf8())) {
+        setError(etWarning, "Command queue full, dropped: " + l_toSend.trimmed());
+        return false;
+    }
+    m_parameterValues[a_param] = a_value;
+
+    // mplayer does not confirm a volume change, but answers in order. One
+    // probe at a time is a sample, not a round-trip per slider step.
+    if ((a_param == paAudioVolume) && (m_state != stNotStarted)) {
+        // its command was still queued and the new one replaced it, the
+        // answer would time a command that never went out
+        if ((m_volumeProbe >= 0)
+        &&  (qint32(m_commands.flushCount() - m_volumeProbeFlush) < 0)) {
+            m_volumeProbe = -1;
+        }
+        if (m_volumeProbe < 0) {
+            m_volumeProbe = queryProperty("volume", this, "volumeApplied");
+            m_volumeProbeAt = m_clock.elapsed();
+            m_volumeProbeFlush = m_commands.flushCount() + 1;
+        }
+    }
+    return true;
+}
+
+// a_value is clamped to the range mplayer accepts
+QString QMPlayer::parameterCommand(Parameter a_param, qreal* a_value) {
+    QString l_toSend;
+
+    switch (a_param) {
+        case paNone:
+        case paMediaProgress: break;
 
-            m_pendingParameter.second = qBound(0.0, m_pendingParameter.second, m_mediaInfo.length);
-            l_toSend = QString("seek %1 2\n").arg(m_pendingParameter.second, 0, 'f', 1);
-            l_setOrig = false;
-        } break;
         case paAudioDelay: {
-            m_pendingParameter.second = qBound(-100.0, m_pendingParameter.second, 100.0);
-            l_toSend = QString("audio_delay %1 2\n").arg(qRound(m_pendingParameter.second));
+            *a_value = qBound(-100.0, *a_value, 100.0);
+            l_toSend = QString("audio_delay %1 2\n").arg(qRound(*a_value));
         } break;
         case paAudioVolume: {
-            m_pendingParameter.second = qBound(0.0, m_pendingParameter.second, 100.0);
-            l_toSend = QString("volume %1 1\n").arg(m_pendingParameter.second);
+            *a_value = qBound(0.0, *a_value, 100.0);
+            l_toSend = QString("volume %1 1\n").arg(*a_value);
         } break;
         case paAudioMute: {
-            l_toSend = QString("mute %1\n").arg(!qFuzzyIsNull(m_pendingParameter.second));
+            l_toSend = QString("mute %1\n").arg(!qFuzzyIsNull(*a_value));
         } break;
         case paVideoBrightness: {
-            m_pendingParameter.second = qBound(-100.0, m_pendingParameter.second, 100.0);
-            l_toSend = QString("brightness %1 1\n").arg(qRound(m_pendingParameter.second));
+            *a_value = qBound(-100.0, *a_value, 100.0);
+            l_toSend = QString("brightness %1 1\n").arg(qRound(*a_value));
         } break;
         case paVideoContrast: {
-            m_pendingParameter.second = qBound(-100.0, m_pendingParameter.second, 100.0);
-            l_toSend = QString("contrast %1 1\n").arg(qRound(m_pendingParameter.second));
+            *a_value = qBound(-100.0, *a_value, 100.0);
+            l_toSend = QString("contrast %1 1\n").arg(qRound(*a_value));
         } break;
         case paVideoGamma: {
-            m_pendingParameter.second = qBound(-100.0, m_pendingParameter.second, 100.0);
-            l_toSend = QString("gamma %1 1\n").arg(qRound(m_pendingParameter.second));
+            *a_value = qBound(-100.0, *a_value, 100.0);
+            l_toSend = QString("gamma %1 1\n").arg(qRound(*a_value));
         } break;
         case paVideoHue: {
-            m_pendingParameter.second = qBound(-100.0, m_pendingParameter.second, 100.0);
-            l_toSend = QString("hue %1 1\n").arg(qRound(m_pendingParameter.second));
+            *a_value = qBound(-100.0, *a_value, 100.0);
+            l_toSend = QString("hue %1 1\n").arg(qRound(*a_value));
         } break;
         case paVideoSaturation: {
-            m_pendingParameter.second = qBound(-100.0, m_pendingParameter.second, 100.0);
-            l_toSend = QString("saturation %1 1\n").arg(qRound(m_pendingParameter.second));
+            *a_value = qBound(-100.0, *a_value, 100.0);
+            l_toSend = QString("saturation %1 1\n").arg(qRound(*a_value));
         } break;
     }
-    m_pendingParameter.first = paNone;
 
-    if (l_toSend.isEmpty()) {
-        setError(etWarning, "Not implemented");
+    return l_toSend;
+}
+
+void QMPlayer::sendPendingSeek() {
+    if (!m_hasPendingSeek) return;
+
+    if (m_state == stIdle) {
+        // load the media first, the seek goes out once playback starts
+        m_seekPauseAfterLoad = true;
+        play();
         return;
     }
 
-    if (!qFuzzyCompare(m_parameterValues[m_pendingParameter.first], m_pendingParameter.second)) {
-        if (l_setOrig)
-            m_parameterValues[m_pendingParameter.first] = m_pendingParameter.second;
+    if ((m_state == stLoading)
+    ||  (m_state == stBuffering)) {
+        return;
+    }
 
-        writeCommand(l_toSend.toUtf8());
+    if ((m_state != stPlaying)
+    &&  (m_state != stPaused)
+    &&  (m_state != stStopped)) {
+        m_hasPendingSeek = false;
+        setError(etWarning, "Invalid state for seek");
+        return;
+    }
 
-        if ((m_pendingParameter.first == paMediaProgress)
-        ||  (m_state == stPaused)
-        ||  (m_state == stStopped)) {
-            // send the seek make the media go to play state
-            setState(stPlaying);
-            pause();
+    if (!m_mediaInfo.seekable) {
+        m_hasPendingSeek = false;
+        setError(etWarning, "That media file is not seekable");
+        return;
+    }
+
+    // while scrubbing only the latest target is sent, once the previous
+    // seek has landed
+    if (m_seekInFlight && !m_seekSettling) return;
+
+    m_activeSeek = m_pendingSeek;
+    m_activeSeek.target = qBound(0.0, m_activeSeek.target, m_mediaInfo.length);
+    m_activeSeek.flush = m_commands.flushCount() + 1;
+    m_activeSeek.from = m_parameterValues[paMediaProgress];
+    m_hasPendingSeek = false;
+    m_seekInFlight = true;
+    m_seekSettling = false;
+    m_seekTimeout.start();
+
+    // pausing_keep leaves a paused player paused on the new frame
+    qint32 l_precision = (m_activeSeek.mode == smExact) ? 3 : 1;
+    writeCommand(QString("pausing_keep seek %1 2\n").arg(m_activeSeek.target, 0, 'f', l_precision).toUtf8());
+}
+
+bool QMPlayer::updateSeek(qreal a_position) {
+    if (!m_seekInFlight) return true;
+
+    // status lines read before the seek went out carry the old position,
+    // and so do those still in the pipe behind it: they go on from where
+    // playback was. Anything else is where the seek landed, however far
+    // from the target the keyframe was.
+    if (!m_seekSettling) {
+        if (qint32(m_commands.flushCount() - m_activeSeek.flush) < 0) return false;
+        if ((a_position >= m_activeSeek.from - 0.1)
+        &&  (a_position <= m_activeSeek.from + 1.0)
+        &&  (qAbs(a_position - m_activeSeek.target) > 1.0)) {
+            return false;
+        }
+    }
+
+    qreal l_frame = (m_mediaInfo.video.fps > 0) ? 1.0 / m_mediaInfo.video.fps : 0.04;
+    if ((m_activeSeek.mode == smExact)
+    &&  (a_position < m_activeSeek.target - l_frame / 2)) {
+        // landed on an earlier keyframe, decode forward to the exact frame
+        m_seekSettling = true;
+        m_seekTimeout.start();
+        if ((m_state != stPlaying) && (m_state != stBuffering))
+            writeCommand("frame_step\n");
+        return false;
+    }
+
+    finishSeek(a_position, true);
+    return true;
+}
+
+void QMPlayer::finishSeek(qreal a_position, bool a_confirmed) {
+    m_seekInFlight = false;
+    m_seekSettling = false;
+    m_seekTimeout.stop();
+
+    // a timeout would only measure the timeout
+    m_lastSeekLatency = m_clock.elapsed() - m_activeSeek.requestedAt;
+    if (a_confirmed) {
+        addLatency(lmSeek, m_lastSeekLatency);
+    } else {
+        ++m_seekTimeouts;
+        m_latencyChanged = true;
+    }
+    emit seekFinished(a_position, m_lastSeekLatency);
+
+    sendPendingSeek();
+}
+
+void QMPlayer::resetSeek() {
+    m_hasPendingSeek = false;
+    m_seekInFlight = false;
+    m_seekSettling = false;
+    m_seekPauseAfterLoad = false;
+    m_seekTimeout.stop();
+}
+
+void QMPlayer::seekTimedOut() {
+    if (m_seekInFlight)
+        finishSeek(m_parameterValues[paMediaProgress], false);
+}
+
+void QMPlayer::sendPendingQueries() {
+    if (m_pendingQueries.isEmpty()) return;
+
+    // a receiver of a failed query may queue the next one
+    QList<PropertyQuery> l_queries = m_pendingQueries;
+    m_pendingQueries.clear();
+
+    // still one write, the command queue batches them; a refused query
+    // gets no answer, it fails right away instead of waiting for one
+    foreach (const PropertyQuery& l_query, l_queries) {
+        if (writeCommand("pausing_keep_force get_property " + l_query.name.toUtf8() + "\n"))
+            m_sentQueries.enqueue(l_query);
+        else
+            replyQuery(l_query, QString(), false);
+    }
+}
+
+void QMPlayer::parsePropertyReply(const QString& a_name, const QString& a_value, bool a_ok) {
+    if (m_sentQueries.isEmpty()) return;
+
+    // mplayer answers in order, an error always belongs to the oldest query
+    qint32 l_index = 0;
+    if (!a_name.isEmpty()) {
+        while ((l_index < m_sentQueries.count())
+        &&     (m_sentQueries.at(l_index).name != a_name)) {
+            ++l_index;
         }
+        // unsolicited answer (e.g. a raw get_* command)
+        if (l_index == m_sentQueries.count()) return;
+    }
+
+    // queries skipped over were silently dropped by mplayer
+    for (qint32 i = 0; i <= l_index; ++i) {
+        PropertyQuery l_query = m_sentQueries.dequeue();
+        bool l_ok = a_ok && (i == l_index);
+        replyQuery(l_query, l_ok ? a_value : QString(), l_ok);
+    }
+}
+
+void QMPlayer::replyQuery(const PropertyQuery& a_query, const QString& a_value, bool a_ok) {
+    emit propertyReply(a_query.id, a_query.name, a_value, a_ok);
+    if (a_query.receiver && !a_query.member.isEmpty()) {
+        QMetaObject::invokeMethod(a_query.receiver, a_query.member.constData(),
+            Q_ARG(qint32, a_query.id), Q_ARG(QString, a_query.name),
+            Q_ARG(QString, a_value), Q_ARG(bool, a_ok));
+    }
+}
+
+void QMPlayer::failPendingQueries() {
+    m_sentQueries += m_pendingQueries;
+    m_pendingQueries.clear();
+
+    while (!m_sentQueries.isEmpty()) {
+        parsePropertyReply(QString(), QString(), false);
     }
 }
 
 void QMPlayer::emitErrors() {
-    if (m_error.first != etNoErr) {
-        emit error(m_error.first, m_error.second);
+    qint64 l_now = m_clock.elapsed();
+    m_errorTokens = qMin<qreal>(m_errorRate, m_errorTokens + (l_now - m_errorTokensAt) * m_errorRate / 1000.0);
+    m_errorTokensAt = l_now;
+
+    qint32 l_dropped = 0;
+    while (!m_pendingErrors.isEmpty()) {
+        const Diagnostic* l_entry = diagnostic(m_pendingErrors.first());
+        if (!l_entry) {
+            // overwritten in the ring before its turn came
+            m_pendingErrorIds.remove(m_pendingErrors.takeFirst());
+            ++l_dropped;
+            continue;
+        }
+        if ((l_entry->type != etFatal) && (m_errorTokens < 1)) break;
+
+        m_pendingErrorIds.remove(m_pendingErrors.takeFirst());
+        if (l_entry->type != etFatal)
+            m_errorTokens -= 1;
+        m_diagnosticEmitted[l_entry->id % m_diagnostics.size()] = l_now;
+
+        QString l_message = l_entry->message;
+        if (l_entry->count > 1)
+            l_message += QString(" (repeated %1 times)").arg(l_entry->count);
+        emit error(l_entry->type, l_message);
     }
+
+    if (l_dropped > 0)
+        emit error(etWarning, QString("%1 more messages, see diagnostics()").arg(l_dropped));
+
+    // the rest waits for the next token
+    if (!m_pendingErrors.isEmpty() && (m_notifyErrors.timerId() == -1))
+        m_notifyErrors.start(qMax(1, 1000 / m_errorRate));
 }
 
-void QMPlayer::emitFinishPlay() {
-    setState(stIdle);
+void QMPlayer::endOfFile() {
+    resetSeek();
     emit finish();
+
+    // a staged item follows right away, see nextItemStarted()
+    if (m_nextStaged)
+        setState(stLoading);
+    else
+        setState(stIdle);
+}
+
+void QMPlayer::nextItemStarted() {
+    QString l_url = m_playlist.takeFirst();
+    m_nextStaged = false;
+
+    m_mediaInfo = (m_nextMediaInfo.url == l_url) ? m_nextMediaInfo : MediaInfo(l_url);
+    m_mediaInfoParser->reset();
+    m_nextMediaInfo = MediaInfo();
+    emit mediaInfoChange();
+    m_parameterValues[paMediaProgress] = 0;
+    emit tick(m_parameterValues[paMediaProgress]);
+
+    resetSeek();
+    setState(stLoading);
+    emit playlistChange();
+}
+
+void QMPlayer::stageNext() {
+    if (m_nextStaged || m_playlist.isEmpty()) return;
+
+    // mplayer appends the item to its own playlist and switches to it
+    // as soon as the current one ends
+    m_nextStaged = true;
+    writeCommand(loadCommand(m_playlist.first(), true));
+
+    if (m_nextMediaInfo.url == m_playlist.first()) return;
+
+    m_nextMediaInfo = MediaInfo(m_playlist.first());
+    m_probe->cancel();
+    m_probe->probe(m_nextMediaInfo.url);
+}
+
+QByteArray QMPlayer::loadCommand(const QString& a_url, bool a_append) {
+    return QByteArray("loadfile '[FILE_NAME]' [APPEND]\n")
+        .replace("[FILE_NAME]", a_url.toUtf8())
+        .replace("[APPEND]", a_append ? "1" : "0");
+}
+
+void QMPlayer::nextProbed(const QString& a_url, const QMPlayer::MediaInfo& a_info) {
+    if (a_url != m_nextMediaInfo.url) return;
+
+    m_nextMediaInfo = a_info;
+    emit playlistChange();
 }
 
 void QMPlayer::processFinished(int a_code, QProcess::ExitStatus a_status) {
-    Q_UNUSED(a_code);
+    if (m_trace) {
+        trace(QMPTrace::tsEvent, QString("finished %1 %2").arg(a_code)
+              .arg((a_status == QProcess::CrashExit) ? "crash" : "normal").toUtf8());
+    }
 
     if (a_status == QProcess::CrashExit) {
-        setError(etFatal, "Process mplayer crashed");
+        setError(etFatal, "Process mplayer crashed", dcProcess);
+    }
+
+    // anything but stopProcess() is a crash as far as the watchdog cares
+    bool l_restart = (m_watchdog || m_respawnRequested) && !m_stopRequested;
+    m_stopRequested = false;
+    m_respawnRequested = false;
+    if (l_restart) {
+        m_restore.url = m_mediaInfo.url;
+        m_restore.position = m_parameterValues[paMediaProgress];
+        m_restore.state = m_state;
     }
 
     if ((m_state == stPlaying)
@@ -491,39 +1654,89 @@ void QMPlayer::processFinished(int a_code, QProcess::ExitStatus a_status) {
         setState(stStopped);
     }
     setState(stNotStarted);
+    resetSeek();
+    m_commands.clear();
+    // the staged item went with mplayer's playlist, it stays first in
+    // ours and is staged again once the next file plays
+    m_nextStaged = false;
+    failPendingQueries();
+    for (qint32 i = 0; i < lmCount; ++i) {
+        m_latencyStart[i] = -1;
+    }
+
+    if (l_restart)
+        scheduleRestart();
 }
 
 void QMPlayer::processReadyReadStandardError() {
-    QStringList l_lines = QString::fromUtf8(m_process.readAllStandardError()).split("\n");
+    QByteArray l_data = m_process->readAllStandardError();
+    if (m_trace) trace(QMPTrace::tsStderr, l_data);
+    parseStandardError(l_data);
+}
+
+void QMPlayer::parseStandardError(const QByteArray& a_data) {
+    QStringList l_lines = QString::fromUtf8(a_data).split("\n");
     foreach (QString l_line, l_lines) {
-        qDebug() << "MPlayer stderr: " << l_line;
+        QMP_LOG(QMPLog::lcStderr, this, l_line);
 
         if (l_line.contains("Seek failed")) {
             setError(etFatal, "Seek failed");
+            resetSeek();
             setState(stIdle);
             continue;
         }
+        // the ANS_ERROR= on stdout that follows resolves the query, in
+        // order, taking this one too would fail the next query as well
+        if (l_line.startsWith("Failed to get value of property")) continue;
 
-        setError(etUnknown, l_line);
+        if (l_line.trimmed().isEmpty()) continue;
+        setError(etUnknown, l_line, classifyDiagnostic(l_line));
     }
 }
 
 void QMPlayer::processReadyReadStandardOutput() {
-    QStringList l_lines = QString::fromUtf8(m_process.readAllStandardOutput()).split("\n", QString::SkipEmptyParts);
+    QByteArray l_data = m_process->readAllStandardOutput();
+    if (m_trace) trace(QMPTrace::tsStdout, l_data);
+    parseStandardOutput(l_data);
+}
+
+void QMPlayer::traceCommands(const QByteArray& a_data) {
+    trace(QMPTrace::tsStdin, a_data);
+}
+
+void QMPlayer::parseStandardOutput(const QByteArray& a_data) {
+    QStringList l_lines = QString::fromUtf8(a_data).split("\n", QString::SkipEmptyParts);
     foreach (QString l_line, l_lines) {
-        qDebug() << "MPlayer stdout: " << l_line;
+        QMP_LOG(QMPLog::lcStdout, this, l_line);
 
-        if (l_line.startsWith("Playing ")) continue;
+        if (l_line.startsWith("Playing ")) {
+            if (m_nextStaged && (l_line == "Playing " + m_playlist.first() + "."))
+                nextItemStarted();
+            continue;
+        }
+        if (l_line.startsWith("EOF code:")) {
+            // 1 is the natural end of the file, anything else was requested
+            if (l_line.section(':', 1).trimmed().toInt() == 1)
+                endOfFile();
+            continue;
+        }
         if (l_line.startsWith("Cache fill:")) {
             setState(QMPlayer::stBuffering);
             continue;
         }
         if (l_line.startsWith("Starting playback...")) {
+            endLatency(lmLoad);
             m_mediaInfo.valid = true; // No more info here
             emit mediaInfoChange();
             m_parameterValues[paMediaProgress] = 0;
             emit tick(m_parameterValues[paMediaProgress]);
             setState(QMPlayer::stPlaying);
+            if (m_seekPauseAfterLoad) {
+                m_seekPauseAfterLoad = false;
+                pause();
+            }
+            sendPendingSeek();
+            stageNext();
             continue;
         }
         if (l_line.startsWith("File not found: ")) {
@@ -531,12 +1744,32 @@ void QMPlayer::processReadyReadStandardOutput() {
             setState(QMPlayer::stStopped);
             continue;
         }
-        if (l_line.contains("ID_PAUSED")) continue;
+        if (l_line.contains("ID_PAUSED")) {
+            endLatency(lmPause);
+            continue;
+        }
         if (l_line.startsWith("ID_SIGNAL")) continue;
-        if (l_line.startsWith("ID_EXIT")) continue;
+        if (l_line.startsWith("ID_EXIT")) {
+            // "EOF code: 1" came first and already ended the file
+            if ((l_line == "ID_EXIT=EOF")
+            &&  (m_state > stIdle))
+                endOfFile();
+            continue;
+        }
 
         if (l_line.startsWith("ID_")) {
-            parseMediaInfo(l_line);
+            m_mediaInfoParser->parse(l_line);
+            continue;
+        }
+        if (l_line.startsWith("ANS_ERROR=")) {
+            parsePropertyReply(QString(), QString(), false);
+            continue;
+        }
+        if (l_line.startsWith("ANS_")) {
+            qint32 l_sep = l_line.indexOf('=');
+            if (l_sep > 4) {
+                parsePropertyReply(l_line.mid(4, l_sep - 4), l_line.mid(l_sep + 1), true);
+            }
             continue;
         }
         if (l_line.startsWith("No stream found")) {
@@ -555,91 +1788,116 @@ void QMPlayer::processReadyReadStandardOutput() {
     }
 }
 
-void QMPlayer::parseMediaInfo(QString a_line) {
-    static QString sl_currentTag;
-    QStringList l_info = a_line.split("=");
-    if (l_info.count() < 2) {
-        return;
-    }
-
-    if (l_info[0].startsWith("ID_VIDEO")) {
-        if (l_info[0] == "ID_VIDEO_CODEC") {
-            m_mediaInfo.video.codec = l_info[1];
-        } else
-        if (l_info[0] == "ID_VIDEO_FORMAT") {
-            m_mediaInfo.video.format = l_info[1];
-        } else
-        if (l_info[0] == "ID_VIDEO_BITRATE") {
-            m_mediaInfo.video.bitrate = l_info[1].toInt();
-        } else
-        if (l_info[0] == "ID_VIDEO_WIDTH") {
-            m_mediaInfo.video.size.setWidth(l_info[1].toInt());
-        } else
-        if (l_info[0] == "ID_VIDEO_HEIGHT") {
-            m_mediaInfo.video.size.setHeight(l_info[1].toInt());
-        } else
-        if (l_info[0] == "ID_VIDEO_FPS") {
-            m_mediaInfo.video.fps = l_info[1].toDouble();
-        }
-    } else
-    if (l_info[0].startsWith("ID_AUDIO")) {
-        if (l_info[0] == "ID_AUDIO_CODEC") {
-            m_mediaInfo.audio.codec = l_info[1];
-        } else
-        if (l_info[0] == "ID_AUDIO_FORMAT") {
-            m_mediaInfo.audio.format = l_info[1];
-        } else
-        if (l_info[0] == "ID_AUDIO_BITRATE") {
-            m_mediaInfo.audio.bitrate = l_info[1].toInt();
-        } else
-        if (l_info[0] == "ID_AUDIO_RATE") {
-            m_mediaInfo.audio.sampleRate = l_info[1].toInt();
-        } else
-        if (l_info[0] == "ID_AUDIO_NCH") {
-            m_mediaInfo.audio.numChannels = l_info[1].toInt();
-        }
-    } else
-    if (l_info[0].startsWith("ID_CLIP")) {
-        if (l_info[0].startsWith("ID_CLIP_INFO_NAME")) {
-            sl_currentTag = l_info[1];
-        } else
-        if (l_info[0].startsWith("ID_CLIP_INFO_VALUE") && !sl_currentTag.isEmpty()) {
-            m_mediaInfo.tags.insert(sl_currentTag, l_info[1]);
-        }
-    } else
-    if (l_info[0] == "ID_LENGTH") {
-        m_mediaInfo.length = l_info[1].toDouble();
-    } else
-    if (l_info[0] == "ID_SEEKABLE") {
-        m_mediaInfo.seekable = l_info[1].toInt() != 0;
-    }
-}
-
-void QMPlayer::parsePosition(QString a_line) {
-    static qint32 sl_eqTimes = 0;
+void QMPlayer::parsePosition(const QString& a_line) {
     static QRegExp l_rg("(A|V):[ ]*([0-9]+[.]{0,1}[0-9]*)");
 
-    if (m_state < stPlaying) return;
+    // buffering is left by the first position that moves again
+    if ((m_state < stPlaying) && (m_state != stBuffering)) return;
 
     if (l_rg.indexIn(a_line) >= 0) {
         qreal l_curSeek = l_rg.cap(2).toDouble();
+        if (!updateSeek(l_curSeek)) return;
 
-        if ((m_mediaInfo.length - m_parameterValues[paMediaProgress]) <= 0.5)
-            m_notifyFinishedPlay.start();
-        if (m_state == stPaused) sl_eqTimes = 0;
-        if (qFuzzyCompare(l_curSeek, m_parameterValues[paMediaProgress])) {
-            ++sl_eqTimes;
-            if (sl_eqTimes > 4) {
-                sl_eqTimes = 0;
-                // to recory from possible mplayer bug
-                writeCommand(QString("seek -1 0\n").toUtf8());
-            }
-            return;
-        }
+        // a repeated position is no progress, checkStall() takes care of it
+        if (qFuzzyCompare(l_curSeek, m_parameterValues[paMediaProgress])) return;
+
+        if (m_state == stBuffering)
+            setState(stPlaying);
+        m_lastProgress = m_clock.elapsed();
+        if (m_stalled) endStall();
+        endLatency(lmResume);
 
-        sl_eqTimes = 0;
         m_parameterValues[paMediaProgress] = l_curSeek;
         emit tick(m_parameterValues[paMediaProgress]);
     }
 }
 
+
+// Strings are stored as UTF-8, qreal as double so the stream does not
+// depend on the platform qreal
+QDataStream& operator<<(QDataStream& a_stream, const QMPlayer::MediaInfo& a_info) {
+    a_stream << a_info.url.toUtf8() << a_info.demuxer.toUtf8();
+
+    a_stream << a_info.video.codec.toUtf8() << a_info.video.format.toUtf8()
+             << a_info.video.bitrate << a_info.video.size << double(a_info.video.fps) << double(a_info.video.aspect);
+
+    a_stream << a_info.audio.codec.toUtf8() << a_info.audio.format.toUtf8()
+             << a_info.audio.bitrate << a_info.audio.sampleRate << a_info.audio.numChannels;
+
+    const QList<QMPlayer::MediaInfo::TrackInfo>* l_lists[] = { &a_info.videoTracks, &a_info.audioTracks, &a_info.subtitleTracks };
+    for (qint32 i = 0; i < 3; ++i) {
+        a_stream << quint32(l_lists[i]->count());
+        foreach (const QMPlayer::MediaInfo::TrackInfo& l_track, *l_lists[i]) {
+            a_stream << l_track.id << qint32(l_track.source) << l_track.language.toUtf8() << l_track.name.toUtf8();
+        }
+    }
+
+    a_stream << quint32(a_info.chapters.count());
+    foreach (const QMPlayer::MediaInfo::ChapterInfo& l_chapter, a_info.chapters) {
+        a_stream << l_chapter.id << l_chapter.start << l_chapter.end << l_chapter.name.toUtf8();
+    }
+
+    a_stream << quint32(a_info.tags.count());
+    QHash<QString, QString>::const_iterator l_it;
+    for (l_it = a_info.tags.constBegin(); l_it != a_info.tags.constEnd(); ++l_it) {
+        a_stream << l_it.key().toUtf8() << l_it.value().toUtf8();
+    }
+
+    a_stream << a_info.valid << double(a_info.length) << a_info.seekable;
+    return a_stream;
+}
+
+QDataStream& operator>>(QDataStream& a_stream, QMPlayer::MediaInfo& a_info) {
+    QByteArray l_url, l_codec, l_format, l_key, l_value;
+    double l_double;
+    qint32 l_source;
+    quint32 l_count;
+
+    a_info = QMPlayer::MediaInfo();
+
+    a_stream >> l_url >> l_format;
+    a_info.url = QString::fromUtf8(l_url);
+    a_info.demuxer = QString::fromUtf8(l_format);
+
+    a_stream >> l_codec >> l_format >> a_info.video.bitrate >> a_info.video.size >> l_double;
+    a_info.video.codec = QString::fromUtf8(l_codec);
+    a_info.video.format = QString::fromUtf8(l_format);
+    a_info.video.fps = l_double;
+    a_stream >> l_double;
+    a_info.video.aspect = l_double;
+
+    a_stream >> l_codec >> l_format >> a_info.audio.bitrate >> a_info.audio.sampleRate >> a_info.audio.numChannels;
+    a_info.audio.codec = QString::fromUtf8(l_codec);
+    a_info.audio.format = QString::fromUtf8(l_format);
+
+    QList<QMPlayer::MediaInfo::TrackInfo>* l_lists[] = { &a_info.videoTracks, &a_info.audioTracks, &a_info.subtitleTracks };
+    for (qint32 i = 0; i < 3; ++i) {
+        a_stream >> l_count;
+        for (quint32 j = 0; (j < l_count) && (a_stream.status() == QDataStream::Ok); ++j) {
+            QMPlayer::MediaInfo::TrackInfo l_track;
+            a_stream >> l_track.id >> l_source >> l_key >> l_value;
+            l_track.source = QMPlayer::MediaInfo::SubtitleSource(l_source);
+            l_track.language = QString::fromUtf8(l_key);
+            l_track.name = QString::fromUtf8(l_value);
+            *l_lists[i] += l_track;
+        }
+    }
+
+    a_stream >> l_count;
+    for (quint32 i = 0; (i < l_count) && (a_stream.status() == QDataStream::Ok); ++i) {
+        QMPlayer::MediaInfo::ChapterInfo l_chapter;
+        a_stream >> l_chapter.id >> l_chapter.start >> l_chapter.end >> l_value;
+        l_chapter.name = QString::fromUtf8(l_value);
+        a_info.chapters += l_chapter;
+    }
+
+    a_stream >> l_count;
+    for (quint32 i = 0; (i < l_count) && (a_stream.status() == QDataStream::Ok); ++i) {
+        a_stream >> l_key >> l_value;
+        a_info.tags.insert(QString::fromUtf8(l_key), QString::fromUtf8(l_value));
+    }
+
+    a_stream >> a_info.valid >> l_double >> a_info.seekable;
+    a_info.length = l_double;
+    return a_stream;
+}
@@ -6,7 +6,26 @@
 #include <QSize>
 #include <QTimer>
 #include <QHash>
+#include <QSet>
+#include <QRegExp>
 #include <QPair>
+#include <QQueue>
+#include <QPointer>
+#include <QVector>
+#include <QElapsedTimer>
+#include <QMetaType>
+#include <QDataStream>
+#include "qmpcommandqueue.h"
+#include "qmpprocess.h"
+#include "qmptrace.h"
+#include "qmplatency.h"
+#include "qmpsnapshot.h"
+
+class QMPMediaProbe;
+class QMPMediaInfoParser;
+class QMPAudioTap;
+class QMPThumbnailer;
+class QFile;
 
 class QMPlayer : public QObject
 {
@@ -48,6 +67,24 @@ public:
         paVideoSaturation
     };
 
+    enum SeekMode {
+        // jump to the nearest keyframe
+        smFast,
+        // decode forward to the requested frame
+        smExact
+    };
+
+    enum StallRecovery {
+        // only report it
+        srNone,
+        // seek a second back, enough to wake a stuck demuxer
+        srNudge,
+        // load the media again at the last position
+        srReload,
+        // restart mplayer, then reload
+        srRespawn
+    };
+
     enum ErrType {
         etNoErr,
         etWarning,
@@ -55,8 +92,68 @@ public:
         etUnknown
     };
 
+    enum DiagnosticCategory {
+        // API misuse and player state
+        dcPlayer,
+        dcProcess,
+        dcDecoder,
+        dcDemuxer,
+        dcAudio,
+        dcVideo,
+        dcSubtitle,
+        dcNetwork,
+        dcOther
+    };
+
+    enum LatencyMetric {
+        // process start to the answer to its first query, i.e. until
+        // mplayer takes commands
+        lmStartup,
+        // loadfile to "Starting playback..."
+        lmLoad,
+        // pause command to mplayer reporting the pause
+        lmPause,
+        // resume to the first new position
+        lmResume,
+        // seek request to the first position after it, timed out seeks
+        // are counted by seekTimeouts() instead
+        lmSeek,
+        // volume command to the answer of a query sent after it
+        lmVolume,
+
+        lmCount
+    };
+
+    struct Diagnostic {
+        quint64 id;
+        ErrType type;
+        DiagnosticCategory category;
+        // the latest text, repeats may differ in numbers only
+        QString message;
+        qint32 count;
+        // ms since the player was created
+        qint64 first;
+        qint64 last;
+
+        Diagnostic() : id(0), type(etNoErr), category(dcOther), message(), count(0), first(0), last(0) {}
+    };
+
+    // ms
+    struct LatencyStats {
+        qint64 count;
+        qint32 min;
+        qint32 max;
+        qreal mean;
+        qint32 p50;
+        qint32 p90;
+        qint32 p99;
+
+        LatencyStats() : count(0), min(0), max(0), mean(0), p50(0), p90(0), p99(0) {}
+    };
+
     struct MediaInfo {
         QString url;
+        QString demuxer;
 
         struct VideoInfo {
             QString codec;
@@ -64,8 +161,9 @@ public:
             qint32 bitrate;
             QSize size;
             qreal fps;
+            qreal aspect;
 
-            VideoInfo() : format(), bitrate(0), size(), fps(0) {}
+            VideoInfo() : format(), bitrate(0), size(), fps(0), aspect(0) {}
         } video;
 
         struct AudioInfo {
@@ -78,13 +176,45 @@ public:
             AudioInfo() : format(), bitrate(0), sampleRate(0), numChannels(0) {}
         } audio;
 
+        // Subtitle sources, same values as the sub_source slave command
+        enum SubtitleSource {
+            ssNone = -1,
+            ssFile,
+            ssVobsub,
+            ssDemux
+        };
+
+        struct TrackInfo {
+            qint32 id;
+            SubtitleSource source;
+            QString language;
+            QString name;
+
+            TrackInfo(qint32 a_id = -1, SubtitleSource a_source = ssNone) : id(a_id), source(a_source), language(), name() {}
+        };
+        QList<TrackInfo> videoTracks;
+        QList<TrackInfo> audioTracks;
+        QList<TrackInfo> subtitleTracks;
+
+        struct ChapterInfo {
+            qint32 id;
+            // seconds
+            double start;
+            double end;
+            QString name;
+
+            ChapterInfo(qint32 a_id = -1) : id(a_id), start(0), end(0), name() {}
+        };
+        QList<ChapterInfo> chapters;
+
         QHash<QString, QString> tags;
 
         bool valid;
         double length;
         bool seekable;
 
-        MediaInfo(const QString& a_url = QString()) : url(a_url), video(), audio(), tags(), valid(false), length(0), seekable(false) {}
+        MediaInfo(const QString& a_url = QString()) : url(a_url), demuxer(), video(), audio(), videoTracks(), audioTracks(),
+            subtitleTracks(), chapters(), tags(), valid(false), length(0), seekable(false) {}
 
         bool hasVideo() { return !video.format.isEmpty(); }
         bool hasAudio() { return !audio.format.isEmpty(); }
@@ -98,10 +228,97 @@ public:
     bool startProcess(qint32 a_winId = 0, const QStringList& a_args = QStringList());
     bool stopProcess();
 
-    void writeCommand(QByteArray a_cmd);
+    // Watchdog, restarts a process that exits without stopProcess() and
+    // restores the media, position and parameters it had
+    void setWatchdogEnabled(bool a_enabled);
+    bool watchdogEnabled() const;
+    // keeps an idle mplayer running to take over without a start delay
+    void setWatchdogPrewarm(bool a_prewarm);
+    bool watchdogPrewarm() const;
+    // at most a_restarts within a_windowMs, after that the watchdog gives up
+    void setRestartBudget(qint32 a_restarts, qint32 a_windowMs);
+    // the delay doubles with every restart inside the window
+    void setRestartBackoff(qint32 a_initialMs, qint32 a_maxMs);
+    qint32 restartCount() const;
+
+    // Stall detection, playback without a new position for a_ms is a
+    // stall, pausing, buffering and seeking are not. 0 disables it. A
+    // stall being recovered by reload or respawn ends with the next new
+    // position, not when the player goes through idle and loading.
+    void setStallTimeout(qint32 a_ms);
+    qint32 stallTimeout() const;
+    void setStallRecovery(QMPlayer::StallRecovery a_recovery);
+    QMPlayer::StallRecovery stallRecovery() const;
+    bool isStalled() const;
+    qint32 stallCount() const;
+    // ms, the current stall included
+    qint64 totalStallTime() const;
+    qint32 lastStallDuration() const;
+
+    // Diagnostics, the last messages of the player and mplayer's stderr.
+    // Repeats are counted instead of stored and error() is emitted at
+    // most a_perSecond times a second, fatal errors excepted.
+    QList<QMPlayer::Diagnostic> diagnostics(qint32 a_count = -1) const;
+    void clearDiagnostics();
+    void setDiagnosticsCapacity(qint32 a_entries);
+    qint32 diagnosticsCapacity() const;
+    void setErrorRate(qint32 a_perSecond);
+    qint32 errorRate() const;
+    static QMPlayer::DiagnosticCategory classifyDiagnostic(const QString& a_message);
+
+    // Latency of the player's operations since the last reset, indexed by
+    // LatencyMetric. latencyReport() is emitted every a_ms while there are
+    // new samples, 0 turns it off.
+    QVector<QMPlayer::LatencyStats> latencyStats() const;
+    QMPlayer::LatencyStats latencyStats(QMPlayer::LatencyMetric a_metric) const;
+    const QMPLatencyHistogram& latencyHistogram(QMPlayer::LatencyMetric a_metric) const;
+    void resetLatencyStats();
+    // seeks given up on without a position, since the last reset
+    qint32 seekTimeouts() const;
+    void setLatencyReportInterval(qint32 a_ms);
+    qint32 latencyReportInterval() const;
+
+    // CPU, scheduling, I/O priority and cgroup of the next started process
+    void setLaunchOptions(const QMPProcess::LaunchOptions& a_options);
+    const QMPProcess::LaunchOptions& launchOptions() const;
+    // what the running process actually got
+    QMPProcess::LaunchOptions placement() const;
+
+    // Records stdin, stdout and stderr of the process to a_path for
+    // replaying them later (see QMPTrace). Replaces a running trace.
+    bool startTrace(const QString& a_path);
+    void stopTrace();
+    bool isTracing() const;
+
+    // Routes the audio of the next started process through "-ao pcm" into
+    // a QMPAudioTap instead of ALSA, for metering or hosts without a sound
+    // card. An "-ao" in the extra arguments of startProcess() still wins.
+    // Nothing but the tap's reading paces "-ao pcm", audio-only media play
+    // in real time only as long as the tap thread runs, and positions and
+    // A-V sync follow the tap rather than a sound card clock.
+    void setAudioTapEnabled(bool a_enabled);
+    QMPAudioTap* audioTap() const;
+
+    // A frame the application already decoded, from a QMPYuvReader's
+    // imageReady() in pipe mode, QMPThumbnailer or QMPSegmentedDecoder,
+    // encoded on the encoder's pool. The future fails right away when
+    // maxPending() snapshots are underway.
+    QFuture<QMPSnapshotEncoder::Result> snapshot(const QImage& a_frame, const QMPSnapshotEncoder::Options& a_options = QMPSnapshotEncoder::Options());
+    // Without a frame at hand: the one at the current position, decoded
+    // once more by an mplayer of its own so playback goes on. That opens
+    // the media a second time, so streams are refused, and lands on the
+    // keyframe before the position unless mplayer has -hr-seek.
+    QFuture<QMPSnapshotEncoder::Result> snapshot(const QMPSnapshotEncoder::Options& a_options = QMPSnapshotEncoder::Options());
+    QMPSnapshotEncoder* snapshotEncoder();
+
+    // false if the command queue refused a command, see commandOverflow()
+    bool writeCommand(QByteArray a_cmd);
+    void setMaxPendingCommandBytes(qint64 a_bytes);
+    qint64 pendingCommandBytes() const;
 
     // info
     QProcess::ProcessState processState() const;
+    Q_PID processId() const;
     QMPlayer::State state() const;
 
     // audio
@@ -116,14 +333,38 @@ public:
     qreal videoHue() const;
     qreal videoSaturation() const;
 
+    // time a changed parameter waits for further changes before it is sent
+    void setParameterDelay(QMPlayer::Parameter a_param, qint32 a_ms);
+    qint32 parameterDelay(QMPlayer::Parameter a_param) const;
+
     // media
     qint64 tell() const;
+    void setSeekMode(QMPlayer::SeekMode a_mode);
+    QMPlayer::SeekMode seekMode() const;
+    // ms from the last seek request to the first position after it
+    qint32 lastSeekLatency() const;
 
     const QMPlayer::MediaInfo& mediaInfo() const;
 
+    QStringList playlist() const;
+    const QMPlayer::MediaInfo& nextMediaInfo() const;
+
+    // properties, see "Available properties" in doc/mplayer_slave.txt
+    // The reply is emitted through propertyReply() and, when a receiver is
+    // given, delivered to a_member with the same signature as that signal.
+    qint32 queryProperty(const QString& a_name, QObject* a_receiver = 0, const char* a_member = 0);
+    qint32 pendingQueries() const;
+
     static void setMPlayerPath(const QString& a_path);
     static QString mPlayerPath();
     static QString mPlayerVersion();
+    // whether the mplayer at mPlayerPath() takes a_option, e.g. "hr-seek"
+    // which only mplayer2 and mpv know, asked once through -list-options
+    static bool mPlayerHasOption(const QString& a_option);
+
+    // used by players created afterwards
+    static void setProcessBackend(QMPProcess::Backend a_backend);
+    static QMPProcess::Backend processBackend();
 
 public slots:
     // audio
@@ -143,24 +384,76 @@ public slots:
     void pause();
     void stop();
     void seek(qreal a_value, bool a_absolute = true);
+    void seek(qreal a_value, bool a_absolute, QMPlayer::SeekMode a_mode);
+
+    // playlist, the next item is preloaded so it follows without a gap
+    void enqueue(const QString& a_url);
+    void clearPlaylist();
 
     QPair<QMPlayer::ErrType, QString> lastError();
 
+protected:
+    // the protocol parsers, fed with whatever the process printed
+    void parseStandardOutput(const QByteArray& a_data);
+    void parseStandardError(const QByteArray& a_data);
+    void parsePosition(const QString& a_line);
+    // a get_property that went out some other way, e.g. in a replayed
+    // trace, is answered like one sent by queryProperty()
+    qint32 expectPropertyReply(const QString& a_name);
+
 private:
-    void setError(QMPlayer::ErrType a_type, const QString& a_error);
+    void setError(QMPlayer::ErrType a_type, const QString& a_error, QMPlayer::DiagnosticCategory a_category = dcPlayer);
+    const Diagnostic* diagnostic(quint64 a_id) const;
     void setState(QMPlayer::State a_new);
     void setParameter(Parameter a_param, qreal a_v, bool a_absolute);
+    void schedulePendingParameters();
+    void sendPendingParameters(bool a_all);
+    bool sendParameter(Parameter a_param, qreal a_value);
+    static QString parameterCommand(Parameter a_param, qreal* a_value);
+    void restoreParameters();
+    void attachProcess();
+    bool launchProcess();
+    void processStarted();
+    void prewarm();
+    void discardSpare();
+    void scheduleRestart();
+    void restoreMedia();
+    void updateStallCheck();
+    void endStall();
+    void sendPendingSeek();
+    bool updateSeek(qreal a_position);
+    void finishSeek(qreal a_position, bool a_confirmed);
+    void resetSeek();
+    void endOfFile();
+    void nextItemStarted();
+    void stageNext();
+    static QByteArray loadCommand(const QString& a_url, bool a_append);
+    void parsePropertyReply(const QString& a_name, const QString& a_value, bool a_ok);
+    void failPendingQueries();
+    void trace(QMPTrace::Stream a_stream, const QByteArray& a_data);
+    void beginLatency(QMPlayer::LatencyMetric a_metric);
+    void endLatency(QMPlayer::LatencyMetric a_metric);
+    void addLatency(QMPlayer::LatencyMetric a_metric, qint32 a_ms);
 
 private slots:
     void sendPendingParameter();
+    void sendPendingQueries();
+    void seekTimedOut();
+    void restartProcess();
+    void spareFinished();
+    void drainSpare();
+    void checkStall();
     void emitErrors();
-    void emitFinishPlay();
+    void emitLatencyReport();
+    void volumeApplied(qint32 a_id, const QString& a_name, const QString& a_value, bool a_ok);
+    void startupAnswered(qint32 a_id, const QString& a_name, const QString& a_value, bool a_ok);
 
     void processFinished(int, QProcess::ExitStatus);
     void processReadyReadStandardError();
     void processReadyReadStandardOutput();
-    void parseMediaInfo(QString a_line);
-    void parsePosition(QString a_line);
+    void traceCommands(const QByteArray& a_data);
+    void nextProbed(const QString& a_url, const QMPlayer::MediaInfo& a_info);
+    void snapshotFrame(const QString& a_url, qreal a_time, const QImage& a_image);
 
 signals:
     void tick(qreal a_currentTime);
@@ -168,25 +461,156 @@ signals:
     void mediaInfoChange();
     void error(QMPlayer::ErrType a_type, const QString& a_error);
     void finish();
+    void seekFinished(qreal a_position, qint32 a_latencyMs);
+    void playlistChange();
+    void propertyReply(qint32 a_id, const QString& a_name, const QString& a_value, bool a_ok);
+    void commandOverflow(qint64 a_pendingBytes);
+    void restarted(qint32 a_count);
+    void watchdogGaveUp();
+    void stalled();
+    void stallEnded(qint32 a_durationMs);
+    void latencyReport();
 
 private:
-    QProcess m_process;
+    QMPProcess* m_process;
+    QMPCommandQueue m_commands;
+    QStringList m_processArgs;
+    bool m_stopRequested;
     Mode m_mode;
 
     MediaInfo m_mediaInfo;
+    QMPMediaInfoParser* m_mediaInfoParser;
 
     State m_state;
-    QTimer m_notifyFinishedPlay;
+    QElapsedTimer m_clock;
     QTimer m_notifyErrors;
 
+    struct PendingParameter {
+        qreal value;
+        qint64 deadline;
+    };
     QHash<Parameter, qreal> m_parameterValues;
+    QHash<Parameter, qint32> m_parameterDelays;
     QTimer m_sendPendingParameter;
-    QPair<Parameter, qreal> m_pendingParameter;
+    QHash<Parameter, PendingParameter> m_pendingParameters;
+
+    struct SeekRequest {
+        qreal target;
+        SeekMode mode;
+        qint64 requestedAt;
+        // the write that carries the seek, see QMPCommandQueue::flushCount()
+        quint32 flush;
+        // the position playback was at when it was sent
+        qreal from;
+    };
+    SeekMode m_seekMode;
+    SeekRequest m_pendingSeek;
+    SeekRequest m_activeSeek;
+    bool m_hasPendingSeek;
+    bool m_seekInFlight;
+    bool m_seekSettling;
+    bool m_seekPauseAfterLoad;
+    qint32 m_lastSeekLatency;
+    QTimer m_seekTimeout;
+
+    struct PropertyQuery {
+        qint32 id;
+        QString name;
+        QPointer<QObject> receiver;
+        QByteArray member;
+    };
+    void replyQuery(const PropertyQuery& a_query, const QString& a_value, bool a_ok);
+    qint32 m_nextQueryId;
+    QList<PropertyQuery> m_pendingQueries;
+    QQueue<PropertyQuery> m_sentQueries;
+    QTimer m_sendPendingQueries;
+
+    QStringList m_playlist;
+    bool m_nextStaged;
+    MediaInfo m_nextMediaInfo;
+    QMPMediaProbe* m_probe;
+
+    struct RestoreState {
+        QString url;
+        qreal position;
+        State state;
+    };
+    bool m_watchdog;
+    bool m_prewarm;
+    qint32 m_restartBudget;
+    qint32 m_restartWindow;
+    qint32 m_backoffInitial;
+    qint32 m_backoffMax;
+    qint32 m_restartCount;
+    QList<qint64> m_restarts;
+    RestoreState m_restore;
+    QTimer m_restartTimer;
+    QMPProcess* m_spare;
+    bool m_respawnRequested;
+
+    qint32 m_stallTimeout;
+    StallRecovery m_stallRecovery;
+    QTimer m_stallCheck;
+    qint64 m_lastProgress;
+    bool m_stalled;
+    bool m_stallRecovering;
+    qint64 m_stallStart;
+    qint32 m_stallCount;
+    qint64 m_stallTime;
+    qint32 m_lastStallDuration;
 
     QPair<QMPlayer::ErrType, QString> m_error;
+    QVector<Diagnostic> m_diagnostics;
+    // dedup key of each slot and when it was last emitted
+    QVector<QString> m_diagnosticKeys;
+    QVector<qint64> m_diagnosticEmitted;
+    QHash<QString, quint64> m_diagnosticIds;
+    quint64 m_nextDiagnostic;
+    // in order of arrival, and hashed for the repeat check
+    QList<quint64> m_pendingErrors;
+    QSet<quint64> m_pendingErrorIds;
+    // numbers in messages, replaced to group repeats
+    QRegExp m_diagnosticNumbers;
+    qint32 m_errorRate;
+    qreal m_errorTokens;
+    qint64 m_errorTokensAt;
+
+    QFile* m_traceFile;
+    QMPTraceWriter* m_trace;
+
+    QMPLatencyHistogram m_latency[lmCount];
+    // when the measured operation started, -1 if none is
+    qint64 m_latencyStart[lmCount];
+    QTimer m_latencyReport;
+    bool m_latencyChanged;
+    qint32 m_seekTimeouts;
+    // the one volume query in flight, -1 if none, when its volume command
+    // was queued and the write that carries it
+    qint32 m_volumeProbe;
+    qint64 m_volumeProbeAt;
+    quint32 m_volumeProbeFlush;
+
+    QMPAudioTap* m_audioTap;
+
+    struct PendingSnapshot {
+        QString url;
+        qreal time;
+        QMPSnapshotEncoder::Options options;
+        QFutureInterface<QMPSnapshotEncoder::Result> result;
+    };
+    QMPSnapshotEncoder* m_snapshotEncoder;
+    QMPThumbnailer* m_snapshotFrames;
+    QList<PendingSnapshot> m_pendingSnapshots;
 
     static QString sm_mplayerPath;
     static QString sm_mplayerVersion;
+    static QSet<QString> sm_mplayerOptions;
+    static QMPProcess::Backend sm_processBackend;
 };
 
+QDataStream& operator<<(QDataStream& a_stream, const QMPlayer::MediaInfo& a_info);
+QDataStream& operator>>(QDataStream& a_stream, QMPlayer::MediaInfo& a_info);
+
+Q_DECLARE_METATYPE(QMPlayer::MediaInfo)
+
 #endif // QMPLAYER_H
@@ -4,10 +4,51 @@
 #
 
 HEADERS += \
-    qmplayer.h
+    qmplayer.h \
+    qmplayermanager.h \
+    qmpcommandqueue.h \
+    qmpmediaprobe.h \
+    qmpmediaindex.h \
+    qmpmediainfoparser.h \
+    qmpprocess.h \
+    qmplog.h \
+    qmptrace.h \
+    qmplatency.h \
+    qmpsnapshot.h
 
 SOURCES += \
-    qmplayer.cpp
+    qmplayer.cpp \
+    qmplayermanager.cpp \
+    qmpcommandqueue.cpp \
+    qmpmediaprobe.cpp \
+    qmpmediaindex.cpp \
+    qmpmediainfoparser.cpp \
+    qmpprocess.cpp \
+    qmplog.cpp \
+    qmptrace.cpp \
+    qmplatency.cpp \
+    qmpsnapshot.cpp
+
+# epoll/posix_spawn process backend
+linux-*: {
+DEFINES += QMP_USE_REACTOR
+HEADERS += qmpreactor.h
+SOURCES += qmpreactor.cpp
+}
+
+# -ao pcm into a fifo, read on a thread of its own
+!win32: {
+DEFINES += QMP_USE_AUDIOTAP
+HEADERS += qmpaudiotap.h
+SOURCES += qmpaudiotap.cpp
+}
+
+# pools of yuv4mpeg workers: poster frames, sprites, segmented decoding
+!win32: {
+DEFINES += QMP_USE_THUMBNAILER
+HEADERS += qmpthumbnailer.h qmpspritecache.h qmpsegmenteddecoder.h qmpyuvworker.h qmpyuvreader.h
+SOURCES += qmpthumbnailer.cpp qmpspritecache.cpp qmpsegmenteddecoder.cpp qmpyuvworker.cpp
+}
 
 !win32:pipemode: {
 DEFINES += QMP_USE_YUVPIPE
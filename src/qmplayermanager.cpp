@@ -0,0 +1,358 @@
+#include "qmplayermanager.h"
+#include "qmplog.h"
+
+QMPlayerManager::QMPlayerManager(QObject* a_parent) :
+    QObject(a_parent), m_entries(), m_nextSlot(0), m_startQueue(), m_startTimer(), m_startupInterval(250),
+    m_maxDecodes(0), m_playQueue(), m_dispatchPlays(), m_cpus(), m_audioDevices(), m_launchOptions()
+{
+    m_startTimer.setInterval(m_startupInterval);
+    connect(&m_startTimer, SIGNAL(timeout()), SLOT(startNext()));
+
+    m_dispatchPlays.setInterval(0);
+    m_dispatchPlays.setSingleShot(true);
+    connect(&m_dispatchPlays, SIGNAL(timeout()), SLOT(dispatchPlays()));
+}
+
+QMPlayerManager::~QMPlayerManager() {
+    stopAll();
+    qDeleteAll(m_entries);
+}
+
+QMPlayer* QMPlayerManager::addPlayer(qint32 a_winId, const QStringList& a_args) {
+    Entry* l_entry = new Entry;
+    l_entry->player = new QMPlayer(this);
+    l_entry->slot = m_nextSlot++;
+    l_entry->winId = a_winId;
+    l_entry->args = a_args;
+    l_entry->hasCpus = false;
+    l_entry->hasNice = false;
+    l_entry->nice = 0;
+    l_entry->errors = 0;
+
+    connect(l_entry->player, SIGNAL(stateChange(QMPlayer::State,QMPlayer::State)),
+            SLOT(playerStateChange(QMPlayer::State,QMPlayer::State)));
+    connect(l_entry->player, SIGNAL(error(QMPlayer::ErrType,QString)),
+            SLOT(playerError(QMPlayer::ErrType,QString)));
+
+    m_entries += l_entry;
+    emit statsChange();
+
+    return l_entry->player;
+}
+
+void QMPlayerManager::removePlayer(QMPlayer* a_player) {
+    Entry* l_entry = entryFor(a_player);
+    if (!l_entry) return;
+
+    m_entries.removeAll(l_entry);
+    m_startQueue.removeAll(a_player);
+    for (qint32 i = m_playQueue.count() - 1; i >= 0; --i) {
+        if (m_playQueue[i].player == a_player)
+            m_playQueue.removeAt(i);
+    }
+
+    a_player->disconnect(this);
+    a_player->stopProcess();
+    a_player->deleteLater();
+    delete l_entry;
+
+    // its decode slot is free now
+    m_dispatchPlays.start();
+    emit statsChange();
+}
+
+QList<QMPlayer*> QMPlayerManager::players() const {
+    QList<QMPlayer*> l_players;
+    foreach (Entry* l_entry, m_entries) {
+        l_players += l_entry->player;
+    }
+    return l_players;
+}
+
+qint32 QMPlayerManager::count() const {
+    return m_entries.count();
+}
+
+void QMPlayerManager::setStartupInterval(qint32 a_ms) {
+    m_startupInterval = qMax(0, a_ms);
+    m_startTimer.setInterval(m_startupInterval);
+}
+
+qint32 QMPlayerManager::startupInterval() const {
+    return m_startupInterval;
+}
+
+void QMPlayerManager::setMaxDecodes(qint32 a_count) {
+    m_maxDecodes = qMax(0, a_count);
+    m_dispatchPlays.start();
+}
+
+qint32 QMPlayerManager::maxDecodes() const {
+    return m_maxDecodes;
+}
+
+qint32 QMPlayerManager::decodes() const {
+    qint32 l_count = 0;
+    foreach (Entry* l_entry, m_entries) {
+        if (isDecoding(l_entry->player->state()))
+            ++l_count;
+    }
+    return l_count;
+}
+
+void QMPlayerManager::setLaunchOptions(const QMPProcess::LaunchOptions& a_options) {
+    m_launchOptions = a_options;
+}
+
+const QMPProcess::LaunchOptions& QMPlayerManager::launchOptions() const {
+    return m_launchOptions;
+}
+
+void QMPlayerManager::setCpus(const QList<qint32>& a_cpus) {
+    m_cpus = a_cpus;
+}
+
+QList<qint32> QMPlayerManager::cpus() const {
+    return m_cpus;
+}
+
+void QMPlayerManager::setAudioDevices(const QStringList& a_devices) {
+    m_audioDevices = a_devices;
+}
+
+QStringList QMPlayerManager::audioDevices() const {
+    return m_audioDevices;
+}
+
+void QMPlayerManager::setNiceLevel(qint32 a_nice) {
+    m_launchOptions.nice = a_nice;
+}
+
+qint32 QMPlayerManager::niceLevel() const {
+    return m_launchOptions.nice;
+}
+
+void QMPlayerManager::setPlayerCpus(QMPlayer* a_player, const QList<qint32>& a_cpus) {
+    Entry* l_entry = entryFor(a_player);
+    if (!l_entry) return;
+
+    l_entry->hasCpus = true;
+    l_entry->cpus = a_cpus;
+}
+
+QList<qint32> QMPlayerManager::playerCpus(QMPlayer* a_player) const {
+    Entry* l_entry = entryFor(a_player);
+    return l_entry ? cpusFor(l_entry) : QList<qint32>();
+}
+
+void QMPlayerManager::setPlayerNiceLevel(QMPlayer* a_player, qint32 a_nice) {
+    Entry* l_entry = entryFor(a_player);
+    if (!l_entry) return;
+
+    l_entry->hasNice = true;
+    l_entry->nice = a_nice;
+}
+
+qint32 QMPlayerManager::playerNiceLevel(QMPlayer* a_player) const {
+    Entry* l_entry = entryFor(a_player);
+    return l_entry ? niceFor(l_entry) : 0;
+}
+
+QString QMPlayerManager::playerAudioDevice(QMPlayer* a_player) const {
+    Entry* l_entry = entryFor(a_player);
+    return l_entry ? audioDeviceFor(l_entry) : QString();
+}
+
+qint32 QMPlayerManager::count(QMPlayer::State a_state) const {
+    qint32 l_count = 0;
+    foreach (Entry* l_entry, m_entries) {
+        if (l_entry->player->state() == a_state)
+            ++l_count;
+    }
+    return l_count;
+}
+
+QMPlayerManager::Stats QMPlayerManager::stats() const {
+    Stats l_stats;
+    l_stats.players = m_entries.count();
+    l_stats.startsPending = m_startQueue.count();
+    l_stats.playsPending = m_playQueue.count();
+
+    foreach (Entry* l_entry, m_entries) {
+        QMPlayer* l_player = l_entry->player;
+        QMPlayer::State l_state = l_player->state();
+
+        l_stats.states[l_state] += 1;
+        if (l_state != QMPlayer::stNotStarted)
+            ++l_stats.running;
+        if (isDecoding(l_state))
+            ++l_stats.decoding;
+        l_stats.errors += l_entry->errors;
+        l_stats.pendingCommandBytes += l_player->pendingCommandBytes();
+        l_stats.maxSeekLatency = qMax(l_stats.maxSeekLatency, l_player->lastSeekLatency());
+    }
+
+    return l_stats;
+}
+
+void QMPlayerManager::startAll() {
+    foreach (Entry* l_entry, m_entries) {
+        if ((l_entry->player->state() == QMPlayer::stNotStarted)
+        &&  (!m_startQueue.contains(l_entry->player)))
+            m_startQueue.enqueue(l_entry->player);
+    }
+
+    // the first one goes right away, the rest follow one per interval
+    if (!m_startTimer.isActive()) {
+        startNext();
+        if (!m_startQueue.isEmpty())
+            m_startTimer.start();
+    }
+}
+
+void QMPlayerManager::stopAll() {
+    m_startTimer.stop();
+    m_startQueue.clear();
+    m_playQueue.clear();
+
+    foreach (Entry* l_entry, m_entries) {
+        l_entry->player->stopProcess();
+    }
+}
+
+void QMPlayerManager::play(QMPlayer* a_player, const QString& a_url) {
+    if (!entryFor(a_player)) return;
+
+    // the player may not be started yet, it is picked up once it is idle
+    PendingPlay l_play;
+    l_play.player = a_player;
+    l_play.url = a_url;
+    m_playQueue.enqueue(l_play);
+
+    dispatchPlays();
+}
+
+void QMPlayerManager::pauseAll() {
+    foreach (Entry* l_entry, m_entries) {
+        if (l_entry->player->state() == QMPlayer::stPlaying)
+            l_entry->player->pause();
+    }
+}
+
+void QMPlayerManager::resumeAll() {
+    foreach (Entry* l_entry, m_entries) {
+        if (l_entry->player->state() == QMPlayer::stPaused)
+            play(l_entry->player);
+    }
+}
+
+void QMPlayerManager::startNext() {
+    while (!m_startQueue.isEmpty()) {
+        Entry* l_entry = entryFor(m_startQueue.dequeue());
+        if (!l_entry || (l_entry->player->state() != QMPlayer::stNotStarted)) continue;
+
+        QStringList l_args = l_entry->args;
+        QString l_device = audioDeviceFor(l_entry);
+        if (!l_device.isEmpty()) {
+            // the last -ao wins over the player's default, %length% quotes
+            // the ':' and ',' of names like hw:1,0
+            l_args += "-ao";
+            l_args += "alsa:device=%" + QString::number(l_device.toLocal8Bit().size()) + "%" + l_device;
+        }
+
+        l_entry->player->setLaunchOptions(launchOptionsFor(l_entry));
+        if (l_entry->player->startProcess(l_entry->winId, l_args))
+            emit playerStarted(l_entry->player);
+        break;
+    }
+
+    if (m_startQueue.isEmpty()) {
+        m_startTimer.stop();
+        emit allStarted();
+    }
+}
+
+void QMPlayerManager::dispatchPlays() {
+    qint32 l_decodes = decodes();
+
+    for (qint32 i = 0; i < m_playQueue.count(); ) {
+        QMPlayer* l_player = m_playQueue[i].player;
+        QMPlayer::State l_state = l_player->state();
+
+        if (l_state == QMPlayer::stNotStarted) {
+            ++i;
+            continue;
+        }
+
+        // a player already decoding keeps its slot
+        bool l_holdsSlot = isDecoding(l_state);
+        if (!l_holdsSlot && (m_maxDecodes > 0) && (l_decodes >= m_maxDecodes))
+            break;
+
+        PendingPlay l_play = m_playQueue.takeAt(i);
+        l_player->play(l_play.url);
+
+        if (!l_holdsSlot && isDecoding(l_player->state()))
+            ++l_decodes;
+    }
+
+    emit statsChange();
+}
+
+void QMPlayerManager::playerStateChange(QMPlayer::State a_new, QMPlayer::State a_old) {
+    if ((isDecoding(a_old) && !isDecoding(a_new))
+    ||  (a_old == QMPlayer::stNotStarted)) {
+        if (!m_playQueue.isEmpty())
+            m_dispatchPlays.start();
+    }
+
+    emit statsChange();
+}
+
+void QMPlayerManager::playerError(QMPlayer::ErrType a_type, const QString& a_error) {
+    Entry* l_entry = entryFor(sender());
+    if (!l_entry || (a_type != QMPlayer::etFatal)) return;
+
+    ++l_entry->errors;
+    QMP_LOG(QMPLog::lcManager, l_entry->player, QString("player %1: %2").arg(l_entry->slot).arg(a_error));
+}
+
+QMPlayerManager::Entry* QMPlayerManager::entryFor(QObject* a_player) const {
+    foreach (Entry* l_entry, m_entries) {
+        if (l_entry->player == a_player) return l_entry;
+    }
+    return 0;
+}
+
+QList<qint32> QMPlayerManager::cpusFor(const Entry* a_entry) const {
+    if (a_entry->hasCpus)
+        return a_entry->cpus;
+    if (m_cpus.isEmpty())
+        return m_launchOptions.cpus;
+
+    return QList<qint32>() << m_cpus[a_entry->slot % m_cpus.count()];
+}
+
+qint32 QMPlayerManager::niceFor(const Entry* a_entry) const {
+    return a_entry->hasNice ? a_entry->nice : m_launchOptions.nice;
+}
+
+QString QMPlayerManager::audioDeviceFor(const Entry* a_entry) const {
+    if (m_audioDevices.isEmpty())
+        return QString();
+
+    return m_audioDevices[a_entry->slot % m_audioDevices.count()];
+}
+
+QMPProcess::LaunchOptions QMPlayerManager::launchOptionsFor(const Entry* a_entry) const {
+    QMPProcess::LaunchOptions l_options = m_launchOptions;
+    l_options.cpus = cpusFor(a_entry);
+    l_options.nice = niceFor(a_entry);
+    return l_options;
+}
+
+bool QMPlayerManager::isDecoding(QMPlayer::State a_state) {
+    return (a_state == QMPlayer::stLoading)
+        || (a_state == QMPlayer::stBuffering)
+        || (a_state == QMPlayer::stPlaying);
+}
@@ -0,0 +1,138 @@
+#ifndef QMPLAYERMANAGER_H
+#define QMPLAYERMANAGER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QQueue>
+#include <QHash>
+#include <QStringList>
+#include "qmplayer.h"
+
+// Owns a group of players sharing one host (e.g. a video wall): starts
+// them one at a time, caps how many decode at once and spreads them over
+// CPUs, nice levels and ALSA devices.
+class QMPlayerManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Stats {
+        qint32 players;
+        qint32 running;
+        qint32 decoding;
+        qint32 startsPending;
+        qint32 playsPending;
+        qint32 errors;
+        qint64 pendingCommandBytes;
+        qint32 maxSeekLatency;
+        QHash<QMPlayer::State, qint32> states;
+
+        Stats() : players(0), running(0), decoding(0), startsPending(0), playsPending(0), errors(0),
+            pendingCommandBytes(0), maxSeekLatency(-1), states() {}
+    };
+
+public:
+    explicit QMPlayerManager(QObject* a_parent = 0);
+    virtual ~QMPlayerManager();
+
+    // the player is owned by the manager and started by startAll()
+    QMPlayer* addPlayer(qint32 a_winId = 0, const QStringList& a_args = QStringList());
+    void removePlayer(QMPlayer* a_player);
+    QList<QMPlayer*> players() const;
+    qint32 count() const;
+
+    // time between two process starts
+    void setStartupInterval(qint32 a_ms);
+    qint32 startupInterval() const;
+
+    // 0 means no limit
+    void setMaxDecodes(qint32 a_count);
+    qint32 maxDecodes() const;
+    qint32 decodes() const;
+
+    // applied to every player, cpus and nice level are refined below
+    void setLaunchOptions(const QMPProcess::LaunchOptions& a_options);
+    const QMPProcess::LaunchOptions& launchOptions() const;
+
+    // players are assigned round-robin in the order they were added,
+    // an empty list leaves the placement to the system
+    void setCpus(const QList<qint32>& a_cpus);
+    QList<qint32> cpus() const;
+    // plain ALSA names such as "hw:1,0", quoted for mplayer at start
+    void setAudioDevices(const QStringList& a_devices);
+    QStringList audioDevices() const;
+    void setNiceLevel(qint32 a_nice);
+    qint32 niceLevel() const;
+
+    // per player overrides, applied at the next start
+    void setPlayerCpus(QMPlayer* a_player, const QList<qint32>& a_cpus);
+    QList<qint32> playerCpus(QMPlayer* a_player) const;
+    void setPlayerNiceLevel(QMPlayer* a_player, qint32 a_nice);
+    qint32 playerNiceLevel(QMPlayer* a_player) const;
+    QString playerAudioDevice(QMPlayer* a_player) const;
+
+    qint32 count(QMPlayer::State a_state) const;
+    QMPlayerManager::Stats stats() const;
+
+public slots:
+    void startAll();
+    void stopAll();
+
+    // like QMPlayer::play() but waits for a free decode slot
+    void play(QMPlayer* a_player, const QString& a_url = QString());
+    void pauseAll();
+    void resumeAll();
+
+signals:
+    void playerStarted(QMPlayer* a_player);
+    void allStarted();
+    void statsChange();
+
+private slots:
+    void startNext();
+    void dispatchPlays();
+    void playerStateChange(QMPlayer::State a_new, QMPlayer::State a_old);
+    void playerError(QMPlayer::ErrType a_type, const QString& a_error);
+
+private:
+    struct Entry {
+        QMPlayer* player;
+        qint32 slot;
+        qint32 winId;
+        QStringList args;
+        bool hasCpus;
+        QList<qint32> cpus;
+        bool hasNice;
+        qint32 nice;
+        qint32 errors;
+    };
+
+    struct PendingPlay {
+        QMPlayer* player;
+        QString url;
+    };
+
+    Entry* entryFor(QObject* a_player) const;
+    QList<qint32> cpusFor(const Entry* a_entry) const;
+    qint32 niceFor(const Entry* a_entry) const;
+    QString audioDeviceFor(const Entry* a_entry) const;
+    QMPProcess::LaunchOptions launchOptionsFor(const Entry* a_entry) const;
+    static bool isDecoding(QMPlayer::State a_state);
+
+    QList<Entry*> m_entries;
+    qint32 m_nextSlot;
+
+    QQueue<QMPlayer*> m_startQueue;
+    QTimer m_startTimer;
+    qint32 m_startupInterval;
+
+    qint32 m_maxDecodes;
+    QQueue<PendingPlay> m_playQueue;
+    QTimer m_dispatchPlays;
+
+    QList<qint32> m_cpus;
+    QStringList m_audioDevices;
+    QMPProcess::LaunchOptions m_launchOptions;
+};
+
+#endif // QMPLAYERMANAGER_H
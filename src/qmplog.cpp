@@ -0,0 +1,153 @@
+#include "qmplog.h"
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QStringList>
+#include <QDebug>
+#include <string.h>
+
+namespace {
+
+const int sc_records = 4096;
+const int sc_dataSize = 224;
+
+// sequence is the ticket + 1 once the record is complete and 0 while it
+// is being written, readers copy and check it did not change meanwhile.
+// Tickets are unsigned and wrap, sc_records divides 2^32 so the slot of
+// a ticket stays the same across the wrap.
+struct Record {
+    QAtomicInt sequence;
+    int category;
+    qint64 timestamp;
+    const void* source;
+    int size;
+    char data[sc_dataSize];
+};
+
+Record sl_records[sc_records];
+QAtomicInt sl_head(0);
+// set once the ring went round, the head alone says nothing after a wrap
+QAtomicInt sl_full(0);
+QAtomicInt sl_echo(0);
+
+QElapsedTimer startedClock() {
+    QElapsedTimer l_clock;
+    l_clock.start();
+    return l_clock;
+}
+
+const QElapsedTimer sl_clock = startedClock();
+
+const char* const sl_names[] = { "stdin", "stdout", "stderr", "state", "process", "manager" };
+
+int initialCategories() {
+    QByteArray l_env = qgetenv("QMP_LOG").toLower();
+    if (l_env.isEmpty()) return 0;
+    if (l_env == "all") return QMPLog::lcAll;
+
+    int l_mask = 0;
+    foreach (const QByteArray& l_name, l_env.split(',')) {
+        for (int i = 0; i < int(sizeof(sl_names) / sizeof(sl_names[0])); ++i) {
+            if (l_name.trimmed() == sl_names[i])
+                l_mask |= 1 << i;
+        }
+    }
+    return l_mask;
+}
+
+}
+
+QAtomicInt QMPLog::sm_categories(initialCategories());
+
+void QMPLog::setCategories(int a_categories) {
+    sm_categories.fetchAndStoreOrdered(a_categories);
+}
+
+int QMPLog::categories() {
+    return sm_categories;
+}
+
+void QMPLog::setEcho(bool a_echo) {
+    sl_echo.fetchAndStoreOrdered(a_echo ? 1 : 0);
+}
+
+bool QMPLog::echo() {
+    return int(sl_echo) != 0;
+}
+
+void QMPLog::write(QMPLog::Category a_category, const void* a_source, const char* a_data, int a_size) {
+    unsigned l_ticket = unsigned(sl_head.fetchAndAddOrdered(1));
+    Record& l_record = sl_records[l_ticket % sc_records];
+    if (l_ticket == unsigned(sc_records - 1))
+        sl_full.fetchAndStoreRelease(1);
+
+    l_record.sequence.fetchAndStoreRelease(0);
+    l_record.category = a_category;
+    l_record.timestamp = sl_clock.nsecsElapsed();
+    l_record.source = a_source;
+    // long lines are truncated, the ring holds a fixed number of bytes
+    l_record.size = qMin(a_size, sc_dataSize);
+    memcpy(l_record.data, a_data, l_record.size);
+    l_record.sequence.fetchAndStoreRelease(int(l_ticket + 1));
+
+    if (int(sl_echo))
+        qDebug() << categoryName(a_category) << a_source << QString::fromUtf8(a_data, a_size);
+}
+
+void QMPLog::write(QMPLog::Category a_category, const void* a_source, const QByteArray& a_data) {
+    write(a_category, a_source, a_data.constData(), a_data.size());
+}
+
+void QMPLog::write(QMPLog::Category a_category, const void* a_source, const QString& a_data) {
+    write(a_category, a_source, a_data.toUtf8());
+}
+
+QList<QMPLog::Entry> QMPLog::entries(int a_count) {
+    QList<Entry> l_entries;
+
+    unsigned l_head = unsigned(int(sl_head));
+    unsigned l_available = int(sl_full) ? unsigned(sc_records) : qMin(l_head, unsigned(sc_records));
+    if ((a_count >= 0) && (unsigned(a_count) < l_available))
+        l_available = a_count;
+
+    for (unsigned l_ticket = l_head - l_available; l_ticket != l_head; ++l_ticket) {
+        Record& l_record = sl_records[l_ticket % sc_records];
+
+        // ticket 2^32 - 1 completes as 0 and is skipped like a record in
+        // progress, one in four billion
+        int l_sequence = l_record.sequence.fetchAndAddAcquire(0);
+        if ((l_sequence == 0) || (unsigned(l_sequence) != l_ticket + 1)) continue;
+
+        Entry l_entry;
+        l_entry.timestamp = l_record.timestamp;
+        l_entry.category = (Category)l_record.category;
+        l_entry.source = l_record.source;
+        l_entry.data = QByteArray(l_record.data, l_record.size);
+
+        // a writer got to the record while it was copied
+        if (l_record.sequence.fetchAndAddAcquire(0) != l_sequence) continue;
+        l_entries += l_entry;
+    }
+
+    return l_entries;
+}
+
+void QMPLog::dump(QIODevice* a_device, int a_count) {
+    foreach (const Entry& l_entry, entries(a_count)) {
+        QString l_line = QString("%1.%2 %3 %4: ")
+            .arg(l_entry.timestamp / 1000000000)
+            .arg((l_entry.timestamp / 1000) % 1000000, 6, 10, QChar('0'))
+            .arg(categoryName(l_entry.category), -7)
+            .arg(quintptr(l_entry.source), 0, 16);
+
+        a_device->write(l_line.toUtf8());
+        a_device->write(l_entry.data);
+        a_device->write("\n");
+    }
+}
+
+QString QMPLog::categoryName(QMPLog::Category a_category) {
+    for (int i = 0; i < int(sizeof(sl_names) / sizeof(sl_names[0])); ++i) {
+        if (a_category == (1 << i)) return sl_names[i];
+    }
+    return QString::number(a_category, 16);
+}
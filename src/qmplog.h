@@ -0,0 +1,69 @@
+#ifndef QMPLOG_H
+#define QMPLOG_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+class QIODevice;
+
+// Protocol log: a disabled category costs a load and a branch, enabled
+// ones are stored with a raw timestamp in a lock-free ring that is only
+// formatted when dumped. QMP_LOG is the way to log, it does not evaluate
+// its arguments for disabled categories.
+class QMPLog
+{
+public:
+    enum Category {
+        lcStdin = 0x01,
+        lcStdout = 0x02,
+        lcStderr = 0x04,
+        lcState = 0x08,
+        lcProcess = 0x10,
+        lcManager = 0x20,
+
+        lcAll = 0xff
+    };
+
+    struct Entry {
+        // ns since the log was initialized
+        qint64 timestamp;
+        Category category;
+        const void* source;
+        QByteArray data;
+    };
+
+    static bool isEnabled(QMPLog::Category a_category) {
+        return (int(sm_categories) & a_category) != 0;
+    }
+
+    // a mask of Category values, QMP_LOG in the environment sets the
+    // initial one, e.g. QMP_LOG=stdin,stdout or QMP_LOG=all
+    static void setCategories(int a_categories);
+    static int categories();
+
+    // also print every record through qDebug()
+    static void setEcho(bool a_echo);
+    static bool echo();
+
+    static void write(QMPLog::Category a_category, const void* a_source, const char* a_data, int a_size);
+    static void write(QMPLog::Category a_category, const void* a_source, const QByteArray& a_data);
+    static void write(QMPLog::Category a_category, const void* a_source, const QString& a_data);
+
+    // oldest first, at most a_count records
+    static QList<QMPLog::Entry> entries(int a_count = -1);
+    static void dump(QIODevice* a_device, int a_count = -1);
+    static QString categoryName(QMPLog::Category a_category);
+
+private:
+    static QAtomicInt sm_categories;
+};
+
+#define QMP_LOG(a_category, a_source, a_data) \
+    do { \
+        if (QMPLog::isEnabled(a_category)) \
+            QMPLog::write(a_category, a_source, a_data); \
+    } while (0)
+
+#endif // QMPLOG_H
@@ -0,0 +1,371 @@
+#include "qmpmediaindex.h"
+#include <QFileInfo>
+#include <QDateTime>
+#include <QVector>
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+    const char sc_magic[4] = { 'Q', 'M', 'P', 'I' };
+    const quint32 sc_version = 2;
+
+    const qint64 sc_headerSize = 32;
+    const quint32 sc_initialBuckets = 4096;
+    const quint64 sc_removed = 1;
+
+    // findSlot() result for a bucket or record that can not be right
+    const qint64 sc_corrupt = -2;
+
+    // length, path hash, file size, mtime, path length
+    const qint64 sc_recordHeaderSize = 4 + 8 + 8 + 8 + 2;
+}
+
+QMPMediaIndex::QMPMediaIndex(const QString& a_path) :
+    m_file(), m_map(0), m_mapSize(0), m_buckets(0), m_entries(0), m_dataEnd(0)
+{
+    if (!a_path.isEmpty())
+        open(a_path);
+}
+
+QMPMediaIndex::~QMPMediaIndex() {
+    close();
+}
+
+bool QMPMediaIndex::open(const QString& a_path) {
+    close();
+
+    m_file.setFileName(a_path);
+    if (!m_file.open(QIODevice::ReadWrite)) return false;
+
+    if (m_file.size() < sc_headerSize) return initialize(sc_initialBuckets);
+    if (!mapFile()) return false;
+
+    // the index is a cache, anything unexpected is simply rebuilt
+    if ((memcmp(m_map, sc_magic, 4) != 0)
+    ||  (qFromLittleEndian<quint32>(m_map + 4) != sc_version)) {
+        return initialize(sc_initialBuckets);
+    }
+
+    m_buckets = qFromLittleEndian<quint32>(m_map + 8);
+    m_entries = qFromLittleEndian<quint32>(m_map + 12);
+    m_dataEnd = qFromLittleEndian<quint64>(m_map + 16);
+
+    if ((m_buckets == 0)
+    ||  (m_dataEnd < quint64(sc_headerSize) + quint64(m_buckets) * 8)
+    ||  (m_dataEnd > quint64(m_mapSize))) {
+        return initialize(sc_initialBuckets);
+    }
+
+    return true;
+}
+
+void QMPMediaIndex::close() {
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = 0;
+    }
+    m_mapSize = 0;
+    m_buckets = 0;
+    m_entries = 0;
+    m_dataEnd = 0;
+    m_file.close();
+}
+
+bool QMPMediaIndex::isOpen() const {
+    return m_map != 0;
+}
+
+QString QMPMediaIndex::path() const {
+    return m_file.fileName();
+}
+
+bool QMPMediaIndex::lookup(const QString& a_file, QMPlayer::MediaInfo* a_info) {
+    if (!m_map) return false;
+
+    QFileInfo l_info(a_file);
+    if (!l_info.isFile()) return false;
+
+    QByteArray l_path = l_info.absoluteFilePath().toUtf8();
+    qint64 l_slot = findSlot(hashPath(l_path), l_path, 0);
+    if (l_slot == sc_corrupt) corrupted();
+    if (l_slot < 0) return false;
+
+    const uchar* l_record = m_map + bucket(l_slot);
+    quint32 l_length = qFromLittleEndian<quint32>(l_record);
+    if ((qFromLittleEndian<quint64>(l_record + 12) != quint64(l_info.size()))
+    ||  (qFromLittleEndian<qint64>(l_record + 20) != qint64(l_info.lastModified().toTime_t()))) {
+        return false;
+    }
+
+    // findSlot() checked that the payload lies within the record
+    if (a_info) {
+        qint64 l_payload = sc_recordHeaderSize + qFromLittleEndian<quint16>(l_record + 28);
+        QByteArray l_data = QByteArray::fromRawData(reinterpret_cast<const char*>(l_record + l_payload),
+                                                    4 + l_length - l_payload);
+        QDataStream l_stream(l_data);
+        l_stream.setVersion(QDataStream::Qt_4_6);
+        l_stream >> *a_info;
+        if (l_stream.status() != QDataStream::Ok) return false;
+    }
+
+    return true;
+}
+
+bool QMPMediaIndex::insert(const QString& a_file, const QMPlayer::MediaInfo& a_info) {
+    if (!m_map) return false;
+
+    QFileInfo l_info(a_file);
+    if (!l_info.isFile()) return false;
+
+    if ((m_entries + 1) * 10 > m_buckets * 7) {
+        if (!rebuild(m_buckets * 2)) return false;
+    }
+
+    QByteArray l_path = l_info.absoluteFilePath().toUtf8();
+    if (l_path.size() > 0xffff) return false;
+
+    quint64 l_hash = hashPath(l_path);
+    qint64 l_free;
+    qint64 l_slot = findSlot(l_hash, l_path, &l_free);
+    if (l_slot == sc_corrupt) {
+        corrupted();
+        if (!m_map) return false;
+        l_slot = findSlot(l_hash, l_path, &l_free);
+    }
+    if ((l_slot < 0) && (l_free < 0)) {
+        // only removed entries left, rebuilding clears them
+        if (!rebuild(m_buckets)) return false;
+        l_slot = findSlot(l_hash, l_path, &l_free);
+    }
+
+    QByteArray l_payload;
+    {
+        QDataStream l_stream(&l_payload, QIODevice::WriteOnly);
+        l_stream.setVersion(QDataStream::Qt_4_6);
+        l_stream << a_info;
+    }
+
+    qint64 l_size = sc_recordHeaderSize + l_path.size() + l_payload.size();
+    if (!reserve(l_size)) return false;
+
+    uchar* l_record = m_map + m_dataEnd;
+    qToLittleEndian<quint32>(l_size - 4, l_record);
+    qToLittleEndian<quint64>(l_hash, l_record + 4);
+    qToLittleEndian<quint64>(l_info.size(), l_record + 12);
+    qToLittleEndian<qint64>(l_info.lastModified().toTime_t(), l_record + 20);
+    qToLittleEndian<quint16>(l_path.size(), l_record + 28);
+    memcpy(l_record + sc_recordHeaderSize, l_path.constData(), l_path.size());
+    memcpy(l_record + sc_recordHeaderSize + l_path.size(), l_payload.constData(), l_payload.size());
+
+    // the record is complete before the table points at it
+    if (l_slot < 0) {
+        l_slot = l_free;
+        ++m_entries;
+    }
+    setBucket(l_slot, m_dataEnd);
+    m_dataEnd += l_size;
+    writeHeader();
+
+    return true;
+}
+
+bool QMPMediaIndex::remove(const QString& a_file) {
+    if (!m_map) return false;
+
+    QByteArray l_path = QFileInfo(a_file).absoluteFilePath().toUtf8();
+    qint64 l_slot = findSlot(hashPath(l_path), l_path, 0);
+    if (l_slot == sc_corrupt) corrupted();
+    if (l_slot < 0) return false;
+
+    setBucket(l_slot, sc_removed);
+    --m_entries;
+    writeHeader();
+
+    return true;
+}
+
+bool QMPMediaIndex::compact() {
+    if (!m_map) return false;
+
+    quint32 l_buckets = sc_initialBuckets;
+    while (m_entries * 10 > l_buckets * 5) {
+        l_buckets *= 2;
+    }
+    return rebuild(l_buckets);
+}
+
+qint32 QMPMediaIndex::count() const {
+    return m_entries;
+}
+
+bool QMPMediaIndex::initialize(quint32 a_buckets) {
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = 0;
+    }
+
+    m_buckets = a_buckets;
+    m_entries = 0;
+    m_dataEnd = sc_headerSize + quint64(a_buckets) * 8;
+
+    // resizing zero fills, which leaves every bucket empty
+    if (!m_file.resize(0) || !m_file.resize(m_dataEnd + 64 * 1024)) return false;
+    if (!mapFile()) return false;
+
+    memcpy(m_map, sc_magic, 4);
+    qToLittleEndian<quint32>(sc_version, m_map + 4);
+    writeHeader();
+
+    return true;
+}
+
+bool QMPMediaIndex::mapFile() {
+    m_mapSize = m_file.size();
+    m_map = m_file.map(0, m_mapSize);
+    return m_map != 0;
+}
+
+bool QMPMediaIndex::reserve(qint64 a_bytes) {
+    if (qint64(m_dataEnd) + a_bytes <= m_mapSize) return true;
+
+    m_file.unmap(m_map);
+    m_map = 0;
+
+    // grow geometrically, remapping is the expensive part
+    qint64 l_size = qMax(m_mapSize + m_mapSize / 2, qint64(m_dataEnd) + a_bytes + 64 * 1024);
+    if (!m_file.resize(l_size)) {
+        mapFile();
+        return false;
+    }
+    return mapFile();
+}
+
+bool QMPMediaIndex::rebuild(quint32 a_buckets) {
+    QString l_path = m_file.fileName();
+    QFile l_out(l_path + ".tmp");
+    if (!l_out.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+
+    QVector<quint64> l_table(a_buckets, 0);
+    quint64 l_offset = sc_headerSize + quint64(a_buckets) * 8;
+    quint32 l_entries = 0;
+
+    l_out.seek(l_offset);
+    for (quint32 i = 0; i < m_buckets; ++i) {
+        quint64 l_record = bucket(i);
+        if ((l_record == 0) || (l_record == sc_removed)) continue;
+        if (!validRecord(l_record)) continue;
+
+        quint32 l_length = qFromLittleEndian<quint32>(m_map + l_record) + 4;
+        quint32 l_slot = qFromLittleEndian<quint64>(m_map + l_record + 4) % a_buckets;
+        while (l_table[l_slot] != 0) {
+            l_slot = (l_slot + 1) % a_buckets;
+        }
+        l_table[l_slot] = l_offset;
+
+        l_out.write(reinterpret_cast<const char*>(m_map + l_record), l_length);
+        l_offset += l_length;
+        ++l_entries;
+    }
+
+    uchar l_header[sc_headerSize];
+    memset(l_header, 0, sc_headerSize);
+    memcpy(l_header, sc_magic, 4);
+    qToLittleEndian<quint32>(sc_version, l_header + 4);
+    qToLittleEndian<quint32>(a_buckets, l_header + 8);
+    qToLittleEndian<quint32>(l_entries, l_header + 12);
+    qToLittleEndian<quint64>(l_offset, l_header + 16);
+
+    for (qint32 i = 0; i < l_table.count(); ++i) {
+        l_table[i] = qToLittleEndian<quint64>(l_table[i]);
+    }
+
+    l_out.seek(0);
+    l_out.write(reinterpret_cast<const char*>(l_header), sc_headerSize);
+    l_out.write(reinterpret_cast<const char*>(l_table.constData()), l_table.count() * 8);
+    if (l_out.error() != QFile::NoError) {
+        l_out.remove();
+        return false;
+    }
+    l_out.close();
+
+    close();
+    QFile::remove(l_path);
+    if (!QFile::rename(l_path + ".tmp", l_path)) return false;
+
+    return open(l_path);
+}
+
+quint64 QMPMediaIndex::hashPath(const QByteArray& a_path) {
+    // FNV-1a, qHash is not guaranteed to be stable between Qt versions
+    quint64 l_hash = Q_UINT64_C(14695981039346656037);
+    for (qint32 i = 0; i < a_path.size(); ++i) {
+        l_hash ^= uchar(a_path.at(i));
+        l_hash *= Q_UINT64_C(1099511628211);
+    }
+    return l_hash;
+}
+
+qint64 QMPMediaIndex::findSlot(quint64 a_hash, const QByteArray& a_path, qint64* a_free) const {
+    quint32 l_slot = a_hash % m_buckets;
+    if (a_free) *a_free = -1;
+
+    for (quint32 i = 0; i < m_buckets; ++i) {
+        quint64 l_offset = bucket(l_slot);
+
+        if (l_offset == 0) {
+            if (a_free && (*a_free < 0)) *a_free = l_slot;
+            return -1;
+        }
+
+        if (l_offset == sc_removed) {
+            if (a_free && (*a_free < 0)) *a_free = l_slot;
+        } else if (!validRecord(l_offset)) {
+            return sc_corrupt;
+        } else {
+            const uchar* l_record = m_map + l_offset;
+            if ((qFromLittleEndian<quint64>(l_record + 4) == a_hash)
+            &&  (qFromLittleEndian<quint16>(l_record + 28) == a_path.size())
+            &&  (memcmp(l_record + sc_recordHeaderSize, a_path.constData(), a_path.size()) == 0)) {
+                return l_slot;
+            }
+        }
+
+        l_slot = (l_slot + 1) % m_buckets;
+    }
+
+    return -1;
+}
+
+bool QMPMediaIndex::validRecord(quint64 a_offset) const {
+    // records start behind the table and end before m_dataEnd
+    if ((a_offset < quint64(sc_headerSize) + quint64(m_buckets) * 8)
+    ||  (a_offset > m_dataEnd)
+    ||  (m_dataEnd - a_offset < quint64(sc_recordHeaderSize))) {
+        return false;
+    }
+
+    const uchar* l_record = m_map + a_offset;
+    quint64 l_length = qFromLittleEndian<quint32>(l_record);
+    quint64 l_payload = sc_recordHeaderSize + qFromLittleEndian<quint16>(l_record + 28);
+    return (4 + l_length <= m_dataEnd - a_offset)
+        && (4 + l_length >= l_payload);
+}
+
+void QMPMediaIndex::corrupted() {
+    qWarning("QMPMediaIndex: %s is corrupt, starting afresh", qPrintable(m_file.fileName()));
+    initialize(sc_initialBuckets);
+}
+
+quint64 QMPMediaIndex::bucket(quint32 a_slot) const {
+    return qFromLittleEndian<quint64>(m_map + sc_headerSize + qint64(a_slot) * 8);
+}
+
+void QMPMediaIndex::setBucket(quint32 a_slot, quint64 a_offset) {
+    qToLittleEndian<quint64>(a_offset, m_map + sc_headerSize + qint64(a_slot) * 8);
+}
+
+void QMPMediaIndex::writeHeader() {
+    qToLittleEndian<quint32>(m_buckets, m_map + 8);
+    qToLittleEndian<quint32>(m_entries, m_map + 12);
+    qToLittleEndian<quint64>(m_dataEnd, m_map + 16);
+}
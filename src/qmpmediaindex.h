@@ -0,0 +1,62 @@
+#ifndef QMPMEDIAINDEX_H
+#define QMPMEDIAINDEX_H
+
+#include <QFile>
+#include <QString>
+#include "qmplayer.h"
+
+// Persistent MediaInfo index. The file is memory-mapped and holds an
+// open addressing hash table of record offsets followed by append-only
+// records, so a lookup costs a probe and a deserialization. Entries are
+// only returned while size and mtime of the media file still match.
+// A bucket or record pointing outside the data is taken for a corrupt
+// file, which is then started afresh.
+//
+// Layout (little endian):
+//   header   "QMPI", version, bucket count, entry count, data end
+//   buckets  bucket count x quint64 record offset, 0 empty, 1 removed
+//   records  length, path hash, file size, mtime, path, MediaInfo
+class QMPMediaIndex
+{
+public:
+    explicit QMPMediaIndex(const QString& a_path = QString());
+    ~QMPMediaIndex();
+
+    bool open(const QString& a_path);
+    void close();
+    bool isOpen() const;
+    QString path() const;
+
+    bool lookup(const QString& a_file, QMPlayer::MediaInfo* a_info = 0);
+    bool insert(const QString& a_file, const QMPlayer::MediaInfo& a_info);
+    bool remove(const QString& a_file);
+
+    // drops replaced records and resizes the table
+    bool compact();
+
+    qint32 count() const;
+
+private:
+    bool initialize(quint32 a_buckets);
+    bool mapFile();
+    bool reserve(qint64 a_bytes);
+    bool rebuild(quint32 a_buckets);
+
+    static quint64 hashPath(const QByteArray& a_path);
+    qint64 findSlot(quint64 a_hash, const QByteArray& a_path, qint64* a_free) const;
+    bool validRecord(quint64 a_offset) const;
+    void corrupted();
+    quint64 bucket(quint32 a_slot) const;
+    void setBucket(quint32 a_slot, quint64 a_offset);
+    void writeHeader();
+
+    QFile m_file;
+    uchar* m_map;
+    qint64 m_mapSize;
+
+    quint32 m_buckets;
+    quint32 m_entries;
+    quint64 m_dataEnd;
+};
+
+#endif // QMPMEDIAINDEX_H
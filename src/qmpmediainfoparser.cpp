@@ -0,0 +1,254 @@
+#include "qmpmediainfoparser.h"
+
+const QHash<QString, QMPMediaInfoParser::Handler> QMPMediaInfoParser::sm_handlers = QMPMediaInfoParser::buildHandlers();
+
+QHash<QString, QMPMediaInfoParser::Handler> QMPMediaInfoParser::buildHandlers() {
+    QHash<QString, Handler> l_handlers;
+
+    l_handlers["ID_DEMUXER"] = &QMPMediaInfoParser::parseDemuxer;
+    l_handlers["ID_LENGTH"] = &QMPMediaInfoParser::parseLength;
+    l_handlers["ID_SEEKABLE"] = &QMPMediaInfoParser::parseSeekable;
+
+    l_handlers["ID_VIDEO_ID"] = &QMPMediaInfoParser::parseVideoId;
+    l_handlers["ID_VID_*_NAME"] = &QMPMediaInfoParser::parseVideoName;
+    l_handlers["ID_VIDEO_CODEC"] = &QMPMediaInfoParser::parseVideoCodec;
+    l_handlers["ID_VIDEO_FORMAT"] = &QMPMediaInfoParser::parseVideoFormat;
+    l_handlers["ID_VIDEO_BITRATE"] = &QMPMediaInfoParser::parseVideoBitrate;
+    l_handlers["ID_VIDEO_WIDTH"] = &QMPMediaInfoParser::parseVideoWidth;
+    l_handlers["ID_VIDEO_HEIGHT"] = &QMPMediaInfoParser::parseVideoHeight;
+    l_handlers["ID_VIDEO_FPS"] = &QMPMediaInfoParser::parseVideoFps;
+    l_handlers["ID_VIDEO_ASPECT"] = &QMPMediaInfoParser::parseVideoAspect;
+
+    l_handlers["ID_AUDIO_ID"] = &QMPMediaInfoParser::parseAudioId;
+    l_handlers["ID_AID_*_LANG"] = &QMPMediaInfoParser::parseAudioLanguage;
+    l_handlers["ID_AID_*_NAME"] = &QMPMediaInfoParser::parseAudioName;
+    l_handlers["ID_AUDIO_CODEC"] = &QMPMediaInfoParser::parseAudioCodec;
+    l_handlers["ID_AUDIO_FORMAT"] = &QMPMediaInfoParser::parseAudioFormat;
+    l_handlers["ID_AUDIO_BITRATE"] = &QMPMediaInfoParser::parseAudioBitrate;
+    l_handlers["ID_AUDIO_RATE"] = &QMPMediaInfoParser::parseAudioRate;
+    l_handlers["ID_AUDIO_NCH"] = &QMPMediaInfoParser::parseAudioChannels;
+
+    l_handlers["ID_SUBTITLE_ID"] = &QMPMediaInfoParser::parseSubtitleId;
+    l_handlers["ID_SID_*_LANG"] = &QMPMediaInfoParser::parseSubtitleLanguage;
+    l_handlers["ID_SID_*_NAME"] = &QMPMediaInfoParser::parseSubtitleName;
+    l_handlers["ID_FILE_SUB_ID"] = &QMPMediaInfoParser::parseFileSubId;
+    l_handlers["ID_FILE_SUB_FILENAME"] = &QMPMediaInfoParser::parseFileSubName;
+    l_handlers["ID_VOBSUB_ID"] = &QMPMediaInfoParser::parseVobsubId;
+    l_handlers["ID_VSID_*_LANG"] = &QMPMediaInfoParser::parseVobsubLanguage;
+
+    l_handlers["ID_CHAPTER_ID"] = &QMPMediaInfoParser::parseChapterId;
+    l_handlers["ID_CHAPTER_*_START"] = &QMPMediaInfoParser::parseChapterStart;
+    l_handlers["ID_CHAPTER_*_END"] = &QMPMediaInfoParser::parseChapterEnd;
+    l_handlers["ID_CHAPTER_*_NAME"] = &QMPMediaInfoParser::parseChapterName;
+
+    l_handlers["ID_CLIP_INFO_NAME*"] = &QMPMediaInfoParser::parseTagName;
+    l_handlers["ID_CLIP_INFO_VALUE*"] = &QMPMediaInfoParser::parseTagValue;
+
+    return l_handlers;
+}
+
+QMPMediaInfoParser::QMPMediaInfoParser(QMPlayer::MediaInfo* a_info) :
+    m_info(a_info), m_tagNames(), m_lastFileSub(-1)
+{
+}
+
+void QMPMediaInfoParser::setMediaInfo(QMPlayer::MediaInfo* a_info) {
+    m_info = a_info;
+    reset();
+}
+
+QMPlayer::MediaInfo* QMPMediaInfoParser::mediaInfo() const {
+    return m_info;
+}
+
+void QMPMediaInfoParser::reset() {
+    m_tagNames.clear();
+    m_lastFileSub = -1;
+}
+
+bool QMPMediaInfoParser::parse(const QString& a_line) {
+    qint32 l_sep = a_line.indexOf('=');
+    if ((l_sep < 0) || !m_info) return false;
+
+    // replace the number in the key by '*', ID_AID_1_LANG -> ID_AID_*_LANG
+    QString l_key;
+    l_key.reserve(l_sep);
+    qint32 l_index = -1;
+    const QChar* l_data = a_line.constData();
+    for (qint32 i = 0; i < l_sep; ++i) {
+        if (l_data[i].isDigit()) {
+            l_index = 0;
+            while ((i < l_sep) && l_data[i].isDigit()) {
+                l_index = l_index * 10 + l_data[i].digitValue();
+                ++i;
+            }
+            l_key += QLatin1Char('*');
+            --i;
+        } else {
+            l_key += l_data[i];
+        }
+    }
+
+    Handler l_handler = sm_handlers.value(l_key, 0);
+    if (!l_handler) return false;
+
+    (this->*l_handler)(l_index, a_line.mid(l_sep + 1));
+    return true;
+}
+
+QMPlayer::MediaInfo::TrackInfo& QMPMediaInfoParser::track(QList<QMPlayer::MediaInfo::TrackInfo>& a_tracks, qint32 a_id,
+                                                          QMPlayer::MediaInfo::SubtitleSource a_source) {
+    for (qint32 i = 0; i < a_tracks.count(); ++i) {
+        if ((a_tracks.at(i).id == a_id) && (a_tracks.at(i).source == a_source)) return a_tracks[i];
+    }
+
+    a_tracks += QMPlayer::MediaInfo::TrackInfo(a_id, a_source);
+    return a_tracks.last();
+}
+
+QMPlayer::MediaInfo::ChapterInfo& QMPMediaInfoParser::chapter(qint32 a_id) {
+    for (qint32 i = 0; i < m_info->chapters.count(); ++i) {
+        if (m_info->chapters.at(i).id == a_id) return m_info->chapters[i];
+    }
+
+    m_info->chapters += QMPlayer::MediaInfo::ChapterInfo(a_id);
+    return m_info->chapters.last();
+}
+
+void QMPMediaInfoParser::parseDemuxer(qint32, const QString& a_value) {
+    m_info->demuxer = a_value;
+}
+
+void QMPMediaInfoParser::parseLength(qint32, const QString& a_value) {
+    m_info->length = a_value.toDouble();
+}
+
+void QMPMediaInfoParser::parseSeekable(qint32, const QString& a_value) {
+    m_info->seekable = a_value.toInt() != 0;
+}
+
+void QMPMediaInfoParser::parseVideoId(qint32, const QString& a_value) {
+    track(m_info->videoTracks, a_value.toInt());
+}
+
+void QMPMediaInfoParser::parseVideoName(qint32 a_index, const QString& a_value) {
+    track(m_info->videoTracks, a_index).name = a_value;
+}
+
+void QMPMediaInfoParser::parseVideoCodec(qint32, const QString& a_value) {
+    m_info->video.codec = a_value;
+}
+
+void QMPMediaInfoParser::parseVideoFormat(qint32, const QString& a_value) {
+    m_info->video.format = a_value;
+}
+
+void QMPMediaInfoParser::parseVideoBitrate(qint32, const QString& a_value) {
+    m_info->video.bitrate = a_value.toInt();
+}
+
+void QMPMediaInfoParser::parseVideoWidth(qint32, const QString& a_value) {
+    m_info->video.size.setWidth(a_value.toInt());
+}
+
+void QMPMediaInfoParser::parseVideoHeight(qint32, const QString& a_value) {
+    m_info->video.size.setHeight(a_value.toInt());
+}
+
+void QMPMediaInfoParser::parseVideoFps(qint32, const QString& a_value) {
+    m_info->video.fps = a_value.toDouble();
+}
+
+void QMPMediaInfoParser::parseVideoAspect(qint32, const QString& a_value) {
+    m_info->video.aspect = a_value.toDouble();
+}
+
+void QMPMediaInfoParser::parseAudioId(qint32, const QString& a_value) {
+    track(m_info->audioTracks, a_value.toInt());
+}
+
+void QMPMediaInfoParser::parseAudioLanguage(qint32 a_index, const QString& a_value) {
+    track(m_info->audioTracks, a_index).language = a_value;
+}
+
+void QMPMediaInfoParser::parseAudioName(qint32 a_index, const QString& a_value) {
+    track(m_info->audioTracks, a_index).name = a_value;
+}
+
+void QMPMediaInfoParser::parseAudioCodec(qint32, const QString& a_value) {
+    m_info->audio.codec = a_value;
+}
+
+void QMPMediaInfoParser::parseAudioFormat(qint32, const QString& a_value) {
+    m_info->audio.format = a_value;
+}
+
+void QMPMediaInfoParser::parseAudioBitrate(qint32, const QString& a_value) {
+    m_info->audio.bitrate = a_value.toInt();
+}
+
+void QMPMediaInfoParser::parseAudioRate(qint32, const QString& a_value) {
+    m_info->audio.sampleRate = a_value.toInt();
+}
+
+void QMPMediaInfoParser::parseAudioChannels(qint32, const QString& a_value) {
+    m_info->audio.numChannels = a_value.toInt();
+}
+
+void QMPMediaInfoParser::parseSubtitleId(qint32, const QString& a_value) {
+    track(m_info->subtitleTracks, a_value.toInt(), QMPlayer::MediaInfo::ssDemux);
+}
+
+void QMPMediaInfoParser::parseSubtitleLanguage(qint32 a_index, const QString& a_value) {
+    track(m_info->subtitleTracks, a_index, QMPlayer::MediaInfo::ssDemux).language = a_value;
+}
+
+void QMPMediaInfoParser::parseSubtitleName(qint32 a_index, const QString& a_value) {
+    track(m_info->subtitleTracks, a_index, QMPlayer::MediaInfo::ssDemux).name = a_value;
+}
+
+void QMPMediaInfoParser::parseFileSubId(qint32, const QString& a_value) {
+    m_lastFileSub = a_value.toInt();
+    track(m_info->subtitleTracks, m_lastFileSub, QMPlayer::MediaInfo::ssFile);
+}
+
+void QMPMediaInfoParser::parseFileSubName(qint32, const QString& a_value) {
+    // the file name follows the ID_FILE_SUB_ID line it belongs to
+    if (m_lastFileSub >= 0)
+        track(m_info->subtitleTracks, m_lastFileSub, QMPlayer::MediaInfo::ssFile).name = a_value;
+}
+
+void QMPMediaInfoParser::parseVobsubId(qint32, const QString& a_value) {
+    track(m_info->subtitleTracks, a_value.toInt(), QMPlayer::MediaInfo::ssVobsub);
+}
+
+void QMPMediaInfoParser::parseVobsubLanguage(qint32 a_index, const QString& a_value) {
+    track(m_info->subtitleTracks, a_index, QMPlayer::MediaInfo::ssVobsub).language = a_value;
+}
+
+void QMPMediaInfoParser::parseChapterId(qint32, const QString& a_value) {
+    chapter(a_value.toInt());
+}
+
+void QMPMediaInfoParser::parseChapterStart(qint32 a_index, const QString& a_value) {
+    // mplayer reports chapter times in ms
+    chapter(a_index).start = a_value.toDouble() / 1000.0;
+}
+
+void QMPMediaInfoParser::parseChapterEnd(qint32 a_index, const QString& a_value) {
+    chapter(a_index).end = a_value.toDouble() / 1000.0;
+}
+
+void QMPMediaInfoParser::parseChapterName(qint32 a_index, const QString& a_value) {
+    chapter(a_index).name = a_value;
+}
+
+void QMPMediaInfoParser::parseTagName(qint32 a_index, const QString& a_value) {
+    m_tagNames[a_index] = a_value;
+}
+
+void QMPMediaInfoParser::parseTagValue(qint32 a_index, const QString& a_value) {
+    QString l_name = m_tagNames.value(a_index);
+    if (!l_name.isEmpty())
+        m_info->tags.insert(l_name, a_value);
+}
@@ -0,0 +1,82 @@
+#ifndef QMPMEDIAINFOPARSER_H
+#define QMPMEDIAINFOPARSER_H
+
+#include <QString>
+#include <QHash>
+#include "qmplayer.h"
+
+// Parses the ID_ lines of "mplayer -identify" into a MediaInfo. Keys are
+// dispatched through a hash table, numbered keys (ID_AID_1_LANG,
+// ID_CLIP_INFO_NAME0, ...) share one handler with the number passed as
+// index. All state lives in the instance, one parser per stream.
+class QMPMediaInfoParser
+{
+public:
+    explicit QMPMediaInfoParser(QMPlayer::MediaInfo* a_info = 0);
+
+    void setMediaInfo(QMPlayer::MediaInfo* a_info);
+    QMPlayer::MediaInfo* mediaInfo() const;
+
+    // forget state of the previous media
+    void reset();
+
+    // returns false for lines without a known ID_ key
+    bool parse(const QString& a_line);
+
+    typedef void (QMPMediaInfoParser::*Handler)(qint32 a_index, const QString& a_value);
+
+private:
+    static QHash<QString, Handler> buildHandlers();
+
+    QMPlayer::MediaInfo::TrackInfo& track(QList<QMPlayer::MediaInfo::TrackInfo>& a_tracks, qint32 a_id,
+                                          QMPlayer::MediaInfo::SubtitleSource a_source = QMPlayer::MediaInfo::ssNone);
+    QMPlayer::MediaInfo::ChapterInfo& chapter(qint32 a_id);
+
+    void parseDemuxer(qint32, const QString& a_value);
+    void parseLength(qint32, const QString& a_value);
+    void parseSeekable(qint32, const QString& a_value);
+
+    void parseVideoId(qint32, const QString& a_value);
+    void parseVideoName(qint32 a_index, const QString& a_value);
+    void parseVideoCodec(qint32, const QString& a_value);
+    void parseVideoFormat(qint32, const QString& a_value);
+    void parseVideoBitrate(qint32, const QString& a_value);
+    void parseVideoWidth(qint32, const QString& a_value);
+    void parseVideoHeight(qint32, const QString& a_value);
+    void parseVideoFps(qint32, const QString& a_value);
+    void parseVideoAspect(qint32, const QString& a_value);
+
+    void parseAudioId(qint32, const QString& a_value);
+    void parseAudioLanguage(qint32 a_index, const QString& a_value);
+    void parseAudioName(qint32 a_index, const QString& a_value);
+    void parseAudioCodec(qint32, const QString& a_value);
+    void parseAudioFormat(qint32, const QString& a_value);
+    void parseAudioBitrate(qint32, const QString& a_value);
+    void parseAudioRate(qint32, const QString& a_value);
+    void parseAudioChannels(qint32, const QString& a_value);
+
+    void parseSubtitleId(qint32, const QString& a_value);
+    void parseSubtitleLanguage(qint32 a_index, const QString& a_value);
+    void parseSubtitleName(qint32 a_index, const QString& a_value);
+    void parseFileSubId(qint32, const QString& a_value);
+    void parseFileSubName(qint32, const QString& a_value);
+    void parseVobsubId(qint32, const QString& a_value);
+    void parseVobsubLanguage(qint32 a_index, const QString& a_value);
+
+    void parseChapterId(qint32, const QString& a_value);
+    void parseChapterStart(qint32 a_index, const QString& a_value);
+    void parseChapterEnd(qint32 a_index, const QString& a_value);
+    void parseChapterName(qint32 a_index, const QString& a_value);
+
+    void parseTagName(qint32 a_index, const QString& a_value);
+    void parseTagValue(qint32 a_index, const QString& a_value);
+
+    QMPlayer::MediaInfo* m_info;
+
+    QHash<qint32, QString> m_tagNames;
+    qint32 m_lastFileSub;
+
+    static const QHash<QString, Handler> sm_handlers;
+};
+
+#endif // QMPMEDIAINFOPARSER_H
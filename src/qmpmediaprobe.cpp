@@ -0,0 +1,231 @@
+#include "qmpmediaprobe.h"
+#include "qmpmediaindex.h"
+#include <QFileInfo>
+#include <QDateTime>
+#include <QThread>
+
+QMPMediaProbe::QMPMediaProbe(QObject* a_parent) :
+    QObject(a_parent), m_queue(), m_workers(), m_maxWorkers(qMax(1, QThread::idealThreadCount())),
+    m_timeout(10000), m_cache(4096), m_index(0), m_dispatch(), m_reaper()
+{
+    m_dispatch.setInterval(0);
+    m_dispatch.setSingleShot(true);
+    connect(&m_dispatch, SIGNAL(timeout()), SLOT(dispatch()));
+
+    m_reaper.setInterval(1000);
+    connect(&m_reaper, SIGNAL(timeout()), SLOT(reapWorkers()));
+}
+
+QMPMediaProbe::~QMPMediaProbe() {
+    cancel();
+}
+
+void QMPMediaProbe::setMaxWorkers(qint32 a_count) {
+    m_maxWorkers = qMax(1, a_count);
+    m_dispatch.start();
+}
+
+qint32 QMPMediaProbe::maxWorkers() const {
+    return m_maxWorkers;
+}
+
+void QMPMediaProbe::setTimeout(qint32 a_ms) {
+    m_timeout = a_ms;
+}
+
+qint32 QMPMediaProbe::timeout() const {
+    return m_timeout;
+}
+
+void QMPMediaProbe::setIndex(QMPMediaIndex* a_index) {
+    m_index = a_index;
+}
+
+QMPMediaIndex* QMPMediaProbe::index() const {
+    return m_index;
+}
+
+void QMPMediaProbe::setCacheSize(qint32 a_entries) {
+    m_cache.setMaxCost(a_entries);
+}
+
+qint32 QMPMediaProbe::cacheSize() const {
+    return m_cache.maxCost();
+}
+
+void QMPMediaProbe::clearCache() {
+    m_cache.clear();
+}
+
+bool QMPMediaProbe::cached(const QString& a_url, QMPlayer::MediaInfo* a_info) const {
+    QString l_key = cacheKey(a_url);
+    if (l_key.isEmpty() || !m_cache.contains(l_key)) return false;
+
+    if (a_info) *a_info = *m_cache.object(l_key);
+    return true;
+}
+
+void QMPMediaProbe::probe(const QString& a_url) {
+    m_queue.enqueue(a_url);
+    if (m_dispatch.timerId() == -1)
+        m_dispatch.start();
+}
+
+void QMPMediaProbe::probe(const QStringList& a_urls) {
+    foreach (const QString& l_url, a_urls) {
+        probe(l_url);
+    }
+}
+
+void QMPMediaProbe::cancel() {
+    m_queue.clear();
+    m_dispatch.stop();
+    m_reaper.stop();
+
+    foreach (Worker* l_worker, m_workers) {
+        l_worker->process->disconnect(this);
+        l_worker->process->kill();
+        l_worker->process->waitForFinished();
+        delete l_worker->process;
+        delete l_worker;
+    }
+    m_workers.clear();
+}
+
+qint32 QMPMediaProbe::pending() const {
+    return m_queue.count() + m_workers.count();
+}
+
+QString QMPMediaProbe::cacheKey(const QString& a_url) {
+    // only local files can be validated, streams are always probed
+    QFileInfo l_file(a_url);
+    if (!l_file.isFile()) return QString();
+
+    return QString("%1|%2|%3")
+        .arg(l_file.absoluteFilePath())
+        .arg(l_file.size())
+        .arg(l_file.lastModified().toTime_t());
+}
+
+void QMPMediaProbe::dispatch() {
+    while (!m_queue.isEmpty() && (m_workers.count() < m_maxWorkers)) {
+        QString l_url = m_queue.dequeue();
+        QString l_key = cacheKey(l_url);
+
+        if (!l_key.isEmpty() && m_cache.contains(l_key)) {
+            emit probed(l_url, *m_cache.object(l_key));
+            continue;
+        }
+
+        QMPlayer::MediaInfo l_info;
+        if (!l_key.isEmpty() && m_index && m_index->lookup(l_url, &l_info)) {
+            m_cache.insert(l_key, new QMPlayer::MediaInfo(l_info));
+            emit probed(l_url, l_info);
+            continue;
+        }
+
+        startWorker(l_url, l_key);
+    }
+
+    if (m_workers.isEmpty() && m_queue.isEmpty())
+        emit finished();
+}
+
+void QMPMediaProbe::startWorker(const QString& a_url, const QString& a_key) {
+    Worker* l_worker = new Worker;
+    l_worker->process = new QProcess(this);
+    l_worker->process->setReadChannel(QProcess::StandardOutput);
+    l_worker->url = a_url;
+    l_worker->key = a_key;
+    l_worker->info = QMPlayer::MediaInfo(a_url);
+    l_worker->parser.setMediaInfo(&l_worker->info);
+
+    connect(l_worker->process, SIGNAL(readyReadStandardOutput()), SLOT(workerReadyReadStandardOutput()));
+    connect(l_worker->process, SIGNAL(finished(int,QProcess::ExitStatus)), SLOT(workerFinished(int, QProcess::ExitStatus)));
+    connect(l_worker->process, SIGNAL(error(QProcess::ProcessError)), SLOT(workerError(QProcess::ProcessError)));
+
+    QStringList l_args;
+    l_args += "-identify";
+    l_args += "-frames";
+    l_args += "0";
+    l_args += "-vo";
+    l_args += "null";
+    l_args += "-ao";
+    l_args += "null";
+    l_args += "-noconfig";
+    l_args += "all";
+    l_args += a_url;
+
+    m_workers += l_worker;
+    l_worker->started.start();
+    l_worker->process->start(QMPlayer::mPlayerPath(), l_args);
+
+    if (!m_reaper.isActive())
+        m_reaper.start();
+}
+
+QMPMediaProbe::Worker* QMPMediaProbe::workerFor(QObject* a_process) {
+    foreach (Worker* l_worker, m_workers) {
+        if (l_worker->process == a_process) return l_worker;
+    }
+    return 0;
+}
+
+void QMPMediaProbe::reapWorkers() {
+    foreach (Worker* l_worker, m_workers) {
+        if (l_worker->started.elapsed() > m_timeout)
+            l_worker->process->kill();
+    }
+
+    if (m_workers.isEmpty())
+        m_reaper.stop();
+}
+
+void QMPMediaProbe::workerReadyReadStandardOutput() {
+    Worker* l_worker = workerFor(sender());
+    if (l_worker) readWorker(l_worker);
+}
+
+void QMPMediaProbe::readWorker(Worker* a_worker) {
+    while (a_worker->process->canReadLine()) {
+        QString l_line = QString::fromUtf8(a_worker->process->readLine()).trimmed();
+        if (l_line.startsWith("ID_"))
+            a_worker->parser.parse(l_line);
+    }
+}
+
+void QMPMediaProbe::workerFinished(int a_code, QProcess::ExitStatus a_status) {
+    Worker* l_worker = workerFor(sender());
+    if (!l_worker) return;
+
+    readWorker(l_worker);
+    l_worker->info.valid = (a_status == QProcess::NormalExit) && (a_code == 0);
+    finishWorker(l_worker);
+}
+
+void QMPMediaProbe::workerError(QProcess::ProcessError a_error) {
+    // there is no finished() for a process that never ran
+    if (a_error != QProcess::FailedToStart) return;
+
+    Worker* l_worker = workerFor(sender());
+    if (!l_worker) return;
+
+    l_worker->info.valid = false;
+    finishWorker(l_worker);
+}
+
+void QMPMediaProbe::finishWorker(Worker* a_worker) {
+    m_workers.removeAll(a_worker);
+    a_worker->process->deleteLater();
+
+    if (a_worker->info.valid && !a_worker->key.isEmpty()) {
+        m_cache.insert(a_worker->key, new QMPlayer::MediaInfo(a_worker->info));
+        if (m_index)
+            m_index->insert(a_worker->url, a_worker->info);
+    }
+
+    emit probed(a_worker->url, a_worker->info);
+    delete a_worker;
+
+    m_dispatch.start();
+}
@@ -0,0 +1,88 @@
+#ifndef QMPMEDIAPROBE_H
+#define QMPMEDIAPROBE_H
+
+#include <QObject>
+#include <QProcess>
+#include <QCache>
+#include <QQueue>
+#include <QTimer>
+#include <QElapsedTimer>
+#include "qmplayer.h"
+#include "qmpmediainfoparser.h"
+
+class QMPMediaIndex;
+
+// Headless MediaInfo probing through a bounded pool of
+// "mplayer -identify -frames 0" processes, results of local files are
+// kept in a LRU cache keyed by path, size and modification time.
+class QMPMediaProbe : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit QMPMediaProbe(QObject* a_parent = 0);
+    virtual ~QMPMediaProbe();
+
+    void setMaxWorkers(qint32 a_count);
+    qint32 maxWorkers() const;
+
+    void setTimeout(qint32 a_ms);
+    qint32 timeout() const;
+
+    // persistent second level cache, not owned
+    void setIndex(QMPMediaIndex* a_index);
+    QMPMediaIndex* index() const;
+
+    void setCacheSize(qint32 a_entries);
+    qint32 cacheSize() const;
+    void clearCache();
+
+    bool cached(const QString& a_url, QMPlayer::MediaInfo* a_info = 0) const;
+
+    void probe(const QString& a_url);
+    void probe(const QStringList& a_urls);
+    void cancel();
+
+    qint32 pending() const;
+
+    static QString cacheKey(const QString& a_url);
+
+signals:
+    void probed(const QString& a_url, const QMPlayer::MediaInfo& a_info);
+    void finished();
+
+private slots:
+    void dispatch();
+    void reapWorkers();
+    void workerReadyReadStandardOutput();
+    void workerFinished(int, QProcess::ExitStatus);
+    void workerError(QProcess::ProcessError a_error);
+
+private:
+    struct Worker {
+        QProcess* process;
+        QString url;
+        QString key;
+        QMPlayer::MediaInfo info;
+        QMPMediaInfoParser parser;
+        QElapsedTimer started;
+    };
+
+    Worker* workerFor(QObject* a_process);
+    void startWorker(const QString& a_url, const QString& a_key);
+    void readWorker(Worker* a_worker);
+    void finishWorker(Worker* a_worker);
+
+    QQueue<QString> m_queue;
+    QList<Worker*> m_workers;
+    qint32 m_maxWorkers;
+    qint32 m_timeout;
+
+    QCache<QString, QMPlayer::MediaInfo> m_cache;
+    QMPMediaIndex* m_index;
+
+    QTimer m_dispatch;
+    QTimer m_reaper;
+};
+
+#endif // QMPMEDIAPROBE_H
@@ -0,0 +1,288 @@
+#include "qmpprocess.h"
+#ifdef QMP_USE_REACTOR
+#include "qmpreactor.h"
+#endif
+#include <QFile>
+#include <QDir>
+
+#ifdef Q_OS_UNIX
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <sched.h>
+#include <sys/syscall.h>
+
+// from linux/ioprio.h
+#define QMP_IOPRIO_WHO_PROCESS 1
+#define QMP_IOPRIO_CLASS_SHIFT 13
+#endif
+
+QMPProcess::QMPProcess(QObject* a_parent) :
+    QIODevice(a_parent), m_launchOptions(), m_cpuMask(), m_cgroupProcs()
+{
+}
+
+QMPProcess::~QMPProcess() {
+}
+
+QMPProcess* QMPProcess::create(QMPProcess::Backend a_backend, QObject* a_parent) {
+#ifdef QMP_USE_REACTOR
+    if (a_backend == bkReactor)
+        return new QMPReactorProcess(a_parent);
+#else
+    Q_UNUSED(a_backend);
+#endif
+    return new QMPQtProcess(a_parent);
+}
+
+bool QMPProcess::isAvailable(QMPProcess::Backend a_backend) {
+#ifdef QMP_USE_REACTOR
+    Q_UNUSED(a_backend);
+    return true;
+#else
+    return a_backend == bkQProcess;
+#endif
+}
+
+void QMPProcess::setLaunchOptions(const QMPProcess::LaunchOptions& a_options) {
+    m_launchOptions = a_options;
+}
+
+const QMPProcess::LaunchOptions& QMPProcess::launchOptions() const {
+    return m_launchOptions;
+}
+
+QMPProcess::LaunchOptions QMPProcess::placement() const {
+    LaunchOptions l_placement;
+    Q_PID l_pid = pid();
+    if (!l_pid) return l_placement;
+
+#ifdef Q_OS_LINUX
+    cpu_set_t l_set;
+    CPU_ZERO(&l_set);
+    if (sched_getaffinity(l_pid, sizeof(l_set), &l_set) == 0) {
+        for (qint32 i = 0; i < CPU_SETSIZE; ++i) {
+            if (CPU_ISSET(i, &l_set))
+                l_placement.cpus += i;
+        }
+    }
+
+    l_placement.batch = (sched_getscheduler(l_pid) == SCHED_BATCH);
+
+    int l_ioprio = syscall(SYS_ioprio_get, QMP_IOPRIO_WHO_PROCESS, l_pid);
+    if (l_ioprio >= 0) {
+        l_placement.ioClass = (IoClass)(l_ioprio >> QMP_IOPRIO_CLASS_SHIFT);
+        l_placement.ioPriority = l_ioprio & ((1 << QMP_IOPRIO_CLASS_SHIFT) - 1);
+    }
+
+    // "0::/path" on the unified hierarchy, "N:controllers:/path" on v1
+    QFile l_cgroups(QString("/proc/%1/cgroup").arg(l_pid));
+    if (l_cgroups.open(QIODevice::ReadOnly)) {
+        foreach (const QByteArray& l_line, l_cgroups.readAll().split('\n')) {
+            if (l_line.startsWith("0::") || l_line.contains(":cpuset:")) {
+                l_placement.cgroup = QString::fromLocal8Bit(l_line.mid(l_line.indexOf(":/") + 1));
+                break;
+            }
+        }
+    }
+#endif
+
+#ifdef Q_OS_UNIX
+    errno = 0;
+    int l_nice = getpriority(PRIO_PROCESS, l_pid);
+    if (errno == 0)
+        l_placement.nice = l_nice;
+#endif
+
+    return l_placement;
+}
+
+QStringList QMPProcess::unappliedLaunchOptions() const {
+    QStringList l_unapplied;
+    if (!pid()) return l_unapplied;
+
+    LaunchOptions l_placement = placement();
+
+    if (!m_launchOptions.cpus.isEmpty()) {
+        foreach (qint32 l_cpu, l_placement.cpus) {
+            if (!m_launchOptions.cpus.contains(l_cpu)) {
+                l_unapplied += "cpus";
+                break;
+            }
+        }
+    }
+    if ((m_launchOptions.nice != 0) && (l_placement.nice != m_launchOptions.nice))
+        l_unapplied += "nice";
+    if (m_launchOptions.batch && !l_placement.batch)
+        l_unapplied += "batch";
+    if ((m_launchOptions.ioClass != ioNone)
+    &&  ((l_placement.ioClass != m_launchOptions.ioClass)
+    ||   ((m_launchOptions.ioClass != ioIdle) && (l_placement.ioPriority != m_launchOptions.ioPriority))))
+        l_unapplied += "io";
+    // the kernel reports the path below the hierarchy's mount point
+    if ((!m_launchOptions.cgroup.isEmpty())
+    &&  ((l_placement.cgroup.isEmpty())
+    ||   (!QDir::cleanPath(m_launchOptions.cgroup).endsWith(l_placement.cgroup))))
+        l_unapplied += "cgroup";
+
+    return l_unapplied;
+}
+
+bool QMPProcess::isSequential() const {
+    return true;
+}
+
+void QMPProcess::prepareLaunchOptions() {
+    m_cpuMask.clear();
+    m_cgroupProcs.clear();
+
+#ifdef Q_OS_LINUX
+    if (!m_launchOptions.cpus.isEmpty()) {
+        cpu_set_t l_set;
+        CPU_ZERO(&l_set);
+        foreach (qint32 l_cpu, m_launchOptions.cpus) {
+            if ((l_cpu >= 0) && (l_cpu < CPU_SETSIZE))
+                CPU_SET(l_cpu, &l_set);
+        }
+        m_cpuMask = QByteArray((const char*)&l_set, sizeof(l_set));
+    }
+
+    if (!m_launchOptions.cgroup.isEmpty())
+        m_cgroupProcs = QFile::encodeName(QDir(m_launchOptions.cgroup).filePath("cgroup.procs"));
+#endif
+}
+
+// Runs in the forked child for QProcess, so only async-signal-safe calls
+// and data prepared beforehand.
+bool QMPProcess::applyLaunchOptions(Q_PID a_pid) const {
+    bool l_ok = true;
+
+#ifdef Q_OS_LINUX
+    // the cgroup first, joining a cpuset resets the affinity
+    if (!m_cgroupProcs.isEmpty()) {
+        char l_digits[24];
+        char l_buffer[24];
+        pid_t l_pid = a_pid ? a_pid : getpid();
+        qint32 l_count = 0;
+        do {
+            l_digits[l_count++] = '0' + (l_pid % 10);
+            l_pid /= 10;
+        } while (l_pid > 0);
+        for (qint32 i = 0; i < l_count; ++i) {
+            l_buffer[i] = l_digits[l_count - 1 - i];
+        }
+        l_buffer[l_count++] = '\n';
+
+        int l_fd = open(m_cgroupProcs.constData(), O_WRONLY | O_CLOEXEC);
+        if ((l_fd < 0) || (write(l_fd, l_buffer, l_count) != l_count))
+            l_ok = false;
+        if (l_fd >= 0)
+            close(l_fd);
+    }
+
+    if (!m_cpuMask.isEmpty()) {
+        if (sched_setaffinity(a_pid, m_cpuMask.size(), (const cpu_set_t*)m_cpuMask.constData()) != 0)
+            l_ok = false;
+    }
+
+    if (m_launchOptions.batch) {
+        struct sched_param l_param;
+        l_param.sched_priority = 0;
+        if (sched_setscheduler(a_pid, SCHED_BATCH, &l_param) != 0)
+            l_ok = false;
+    }
+
+    if (m_launchOptions.ioClass != ioNone) {
+        int l_ioprio = (m_launchOptions.ioClass << QMP_IOPRIO_CLASS_SHIFT) | qBound(0, m_launchOptions.ioPriority, 7);
+        if (syscall(SYS_ioprio_set, QMP_IOPRIO_WHO_PROCESS, a_pid, l_ioprio) != 0)
+            l_ok = false;
+    }
+#endif
+
+#ifdef Q_OS_UNIX
+    if (m_launchOptions.nice != 0) {
+        if (setpriority(PRIO_PROCESS, a_pid, m_launchOptions.nice) != 0)
+            l_ok = false;
+    }
+#else
+    Q_UNUSED(a_pid);
+#endif
+
+    return l_ok;
+}
+
+QMPChildProcess::QMPChildProcess(const QMPProcess* a_owner) :
+    QProcess(), m_owner(a_owner)
+{
+}
+
+void QMPChildProcess::setupChildProcess() {
+    // failures show up in QMPProcess::unappliedLaunchOptions()
+    m_owner->applyLaunchOptions(0);
+}
+
+QMPQtProcess::QMPQtProcess(QObject* a_parent) :
+    QMPProcess(a_parent), m_process(this)
+{
+    connect(&m_process, SIGNAL(finished(int,QProcess::ExitStatus)), SIGNAL(finished(int,QProcess::ExitStatus)));
+    connect(&m_process, SIGNAL(readyReadStandardOutput()), SIGNAL(readyReadStandardOutput()));
+    connect(&m_process, SIGNAL(readyReadStandardError()), SIGNAL(readyReadStandardError()));
+    connect(&m_process, SIGNAL(bytesWritten(qint64)), SIGNAL(bytesWritten(qint64)));
+}
+
+QMPQtProcess::~QMPQtProcess() {
+}
+
+void QMPQtProcess::start(const QString& a_program, const QStringList& a_args) {
+    if (isOpen()) close();
+    prepareLaunchOptions();
+    m_process.start(a_program, a_args);
+    open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+}
+
+bool QMPQtProcess::waitForStarted(int a_msecs) {
+    if (m_process.waitForStarted(a_msecs)) return true;
+
+    setErrorString(m_process.errorString());
+    return false;
+}
+
+bool QMPQtProcess::waitForFinished(int a_msecs) {
+    return m_process.waitForFinished(a_msecs);
+}
+
+void QMPQtProcess::kill() {
+    m_process.kill();
+}
+
+QProcess::ProcessState QMPQtProcess::state() const {
+    return m_process.state();
+}
+
+Q_PID QMPQtProcess::pid() const {
+    return m_process.pid();
+}
+
+QByteArray QMPQtProcess::readAllStandardOutput() {
+    return m_process.readAllStandardOutput();
+}
+
+QByteArray QMPQtProcess::readAllStandardError() {
+    return m_process.readAllStandardError();
+}
+
+qint64 QMPQtProcess::bytesToWrite() const {
+    return m_process.bytesToWrite();
+}
+
+qint64 QMPQtProcess::readData(char* a_data, qint64 a_maxSize) {
+    return m_process.read(a_data, a_maxSize);
+}
+
+qint64 QMPQtProcess::writeData(const char* a_data, qint64 a_size) {
+    return m_process.write(a_data, a_size);
+}
@@ -0,0 +1,136 @@
+#ifndef QMPPROCESS_H
+#define QMPPROCESS_H
+
+#include <QIODevice>
+#include <QProcess>
+#include <QStringList>
+
+class QMPChildProcess;
+
+// The part of QProcess a player needs, writes go to the child's stdin.
+// Implemented on top of QProcess and, where available, on a shared
+// epoll reactor that serves many children from a few threads.
+class QMPProcess : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    enum Backend {
+        bkQProcess,
+        bkReactor
+    };
+
+    enum IoClass {
+        ioNone = 0,
+        ioRealtime,
+        ioBestEffort,
+        ioIdle
+    };
+
+    // Where the child runs, applied before it executes mplayer. The
+    // defaults leave everything inherited from this process.
+    struct LaunchOptions {
+        QList<qint32> cpus;
+        qint32 nice;
+        // SCHED_BATCH instead of SCHED_OTHER
+        bool batch;
+        IoClass ioClass;
+        // 0 (highest) to 7
+        qint32 ioPriority;
+        // cgroup directory, the child is added to its cgroup.procs
+        QString cgroup;
+
+        LaunchOptions() : cpus(), nice(0), batch(false), ioClass(ioNone), ioPriority(4), cgroup() {}
+    };
+
+    explicit QMPProcess(QObject* a_parent = 0);
+    virtual ~QMPProcess();
+
+    // falls back to bkQProcess when the reactor is not built in
+    static QMPProcess* create(QMPProcess::Backend a_backend, QObject* a_parent = 0);
+    static bool isAvailable(QMPProcess::Backend a_backend);
+
+    virtual void start(const QString& a_program, const QStringList& a_args) = 0;
+    virtual bool waitForStarted(int a_msecs = 30000) = 0;
+    virtual bool waitForFinished(int a_msecs = 30000) = 0;
+    virtual void kill() = 0;
+
+    virtual QProcess::ProcessState state() const = 0;
+    virtual Q_PID pid() const = 0;
+
+    virtual QByteArray readAllStandardOutput() = 0;
+    virtual QByteArray readAllStandardError() = 0;
+
+    // takes effect at the next start()
+    void setLaunchOptions(const QMPProcess::LaunchOptions& a_options);
+    const QMPProcess::LaunchOptions& launchOptions() const;
+
+    // what the running child actually got, read back from the kernel
+    QMPProcess::LaunchOptions placement() const;
+    // requested options the child did not end up with
+    QStringList unappliedLaunchOptions() const;
+
+    bool isSequential() const;
+
+protected:
+    // start() prepares, the child or its parent applies, 0 is the caller
+    void prepareLaunchOptions();
+    bool applyLaunchOptions(Q_PID a_pid) const;
+
+signals:
+    void finished(int a_exitCode, QProcess::ExitStatus a_exitStatus);
+    void readyReadStandardOutput();
+    void readyReadStandardError();
+
+private:
+    friend class QMPChildProcess;
+
+    LaunchOptions m_launchOptions;
+    // m_launchOptions in a form usable between fork and exec
+    QByteArray m_cpuMask;
+    QByteArray m_cgroupProcs;
+};
+
+// QProcess running the launch options of its owner in the child
+class QMPChildProcess : public QProcess
+{
+public:
+    explicit QMPChildProcess(const QMPProcess* a_owner);
+
+protected:
+    void setupChildProcess();
+
+private:
+    const QMPProcess* m_owner;
+};
+
+class QMPQtProcess : public QMPProcess
+{
+    Q_OBJECT
+
+public:
+    explicit QMPQtProcess(QObject* a_parent = 0);
+    virtual ~QMPQtProcess();
+
+    void start(const QString& a_program, const QStringList& a_args);
+    bool waitForStarted(int a_msecs = 30000);
+    bool waitForFinished(int a_msecs = 30000);
+    void kill();
+
+    QProcess::ProcessState state() const;
+    Q_PID pid() const;
+
+    QByteArray readAllStandardOutput();
+    QByteArray readAllStandardError();
+
+    qint64 bytesToWrite() const;
+
+protected:
+    qint64 readData(char* a_data, qint64 a_maxSize);
+    qint64 writeData(const char* a_data, qint64 a_size);
+
+private:
+    QMPChildProcess m_process;
+};
+
+#endif // QMPPROCESS_H
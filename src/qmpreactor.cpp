@@ -0,0 +1,644 @@
+#include "qmpreactor.h"
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QCoreApplication>
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include <QFile>
+#include <climits>
+
+#include <sys/epoll.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <unistd.h>
+
+extern char** environ;
+
+class QMPReactorLoop;
+
+enum Channel {
+    chStdin = 0,
+    chStdout,
+    chStderr,
+
+    chCount
+};
+
+struct QMPReactorProcess::Shared {
+    QMutex mutex;
+    QWaitCondition exitCondition;
+
+    // cleared when the QMPReactorProcess goes away before its child
+    QObject* owner;
+    bool notifyPosted;
+    QMPReactorLoop* loop;
+
+    pid_t pid;
+    int fds[chCount];
+    quint64 keys[chCount];
+    // pending stdin data, unread stdout and stderr data
+    QByteArray buffers[chCount];
+    bool fresh[chCount];
+    qint64 written;
+
+    bool exited;
+    bool exitReported;
+    int exitCode;
+    QProcess::ExitStatus exitStatus;
+
+    Shared() : mutex(), exitCondition(), owner(0), notifyPosted(false), loop(0), pid(0), written(0),
+        exited(false), exitReported(false), exitCode(0), exitStatus(QProcess::NormalExit) {
+        for (qint32 i = 0; i < chCount; ++i) {
+            fds[i] = -1;
+            keys[i] = 0;
+            fresh[i] = false;
+        }
+    }
+
+    // mutex held, one queued delivery covers everything until it runs
+    void notify() {
+        if (owner && !notifyPosted) {
+            notifyPosted = true;
+            QMetaObject::invokeMethod(owner, "deliver", Qt::QueuedConnection);
+        }
+    }
+};
+
+typedef QSharedPointer<QMPReactorProcess::Shared> SharedPointer;
+
+class QMPReactorLoop : public QThread
+{
+public:
+    QMPReactorLoop();
+    virtual ~QMPReactorLoop();
+
+    void add(const SharedPointer& a_shared);
+    // a_shared->mutex held
+    void setWriteInterest(QMPReactorProcess::Shared* a_shared, bool a_on);
+    void stop();
+
+protected:
+    void run();
+
+private:
+    struct Registration {
+        SharedPointer shared;
+        qint32 channel;
+    };
+
+    void readChannel(const SharedPointer& a_shared, qint32 a_channel);
+    void writeChannel(const SharedPointer& a_shared, quint32 a_events);
+    void closeChannel(QMPReactorProcess::Shared* a_shared, qint32 a_channel);
+    void reapChildren();
+
+    int m_epoll;
+    int m_wake[2];
+    volatile bool m_quit;
+
+    QMutex m_lock;
+    quint64 m_serial;
+    QHash<quint64, Registration> m_registrations;
+
+    // both output pipes closed, waiting for the child to exit
+    QList<SharedPointer> m_reap;
+};
+
+static QMutex sl_loopsLock;
+static QList<QMPReactorLoop*> sl_loops;
+static qint32 sl_threadCount = 0;
+static qint32 sl_nextLoop = 0;
+
+static void stopLoops() {
+    QMutexLocker l_locker(&sl_loopsLock);
+    foreach (QMPReactorLoop* l_loop, sl_loops) {
+        l_loop->stop();
+        l_loop->wait();
+        delete l_loop;
+    }
+    sl_loops.clear();
+}
+
+static QMPReactorLoop* nextLoop() {
+    QMutexLocker l_locker(&sl_loopsLock);
+
+    if (sl_loops.isEmpty()) {
+        // a child closing its stdin must not take the whole process down
+        struct sigaction l_action;
+        if ((sigaction(SIGPIPE, 0, &l_action) == 0) && (l_action.sa_handler == SIG_DFL))
+            signal(SIGPIPE, SIG_IGN);
+
+        qint32 l_count = sl_threadCount;
+        if (l_count <= 0)
+            l_count = qBound(1, QThread::idealThreadCount() / 4, 4);
+
+        for (qint32 i = 0; i < l_count; ++i) {
+            QMPReactorLoop* l_loop = new QMPReactorLoop;
+            l_loop->start();
+            sl_loops += l_loop;
+        }
+        qAddPostRoutine(stopLoops);
+    }
+
+    return sl_loops[sl_nextLoop++ % sl_loops.count()];
+}
+
+QMPReactorLoop::QMPReactorLoop() :
+    QThread(), m_epoll(-1), m_quit(false), m_lock(), m_serial(0), m_registrations(), m_reap()
+{
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (pipe2(m_wake, O_CLOEXEC | O_NONBLOCK) != 0) {
+        m_wake[0] = -1;
+        m_wake[1] = -1;
+        return;
+    }
+
+    struct epoll_event l_event;
+    l_event.events = EPOLLIN;
+    l_event.data.u64 = 0;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_wake[0], &l_event);
+}
+
+QMPReactorLoop::~QMPReactorLoop() {
+    if (m_wake[0] >= 0) {
+        close(m_wake[0]);
+        close(m_wake[1]);
+    }
+    if (m_epoll >= 0)
+        close(m_epoll);
+}
+
+void QMPReactorLoop::add(const SharedPointer& a_shared) {
+    for (qint32 i = 0; i < chCount; ++i) {
+        if (a_shared->fds[i] < 0) continue;
+
+        Registration l_registration;
+        l_registration.shared = a_shared;
+        l_registration.channel = i;
+
+        {
+            QMutexLocker l_locker(&m_lock);
+            // keys are never reused, a stale event for a closed fd finds nothing
+            a_shared->keys[i] = ++m_serial;
+            m_registrations.insert(a_shared->keys[i], l_registration);
+        }
+
+        struct epoll_event l_event;
+        l_event.events = (i == chStdin) ? 0 : EPOLLIN;
+        l_event.data.u64 = a_shared->keys[i];
+        epoll_ctl(m_epoll, EPOLL_CTL_ADD, a_shared->fds[i], &l_event);
+    }
+}
+
+void QMPReactorLoop::setWriteInterest(QMPReactorProcess::Shared* a_shared, bool a_on) {
+    if (a_shared->fds[chStdin] < 0) return;
+
+    struct epoll_event l_event;
+    l_event.events = a_on ? EPOLLOUT : 0;
+    l_event.data.u64 = a_shared->keys[chStdin];
+    epoll_ctl(m_epoll, EPOLL_CTL_MOD, a_shared->fds[chStdin], &l_event);
+}
+
+void QMPReactorLoop::stop() {
+    m_quit = true;
+    if (m_wake[1] >= 0) {
+        char l_byte = 0;
+        while ((write(m_wake[1], &l_byte, 1) < 0) && (errno == EINTR)) {}
+    }
+}
+
+void QMPReactorLoop::run() {
+    struct epoll_event l_events[64];
+
+    while (!m_quit) {
+        // exited children are polled for as SIGCHLD belongs to QProcess
+        int l_count = epoll_wait(m_epoll, l_events, 64, m_reap.isEmpty() ? -1 : 20);
+        if ((l_count < 0) && (errno != EINTR)) break;
+
+        for (int i = 0; i < l_count; ++i) {
+            quint64 l_key = l_events[i].data.u64;
+            if (l_key == 0) {
+                char l_buffer[64];
+                while (read(m_wake[0], l_buffer, sizeof(l_buffer)) > 0) {}
+                continue;
+            }
+
+            Registration l_registration;
+            {
+                QMutexLocker l_locker(&m_lock);
+                if (!m_registrations.contains(l_key)) continue;
+                l_registration = m_registrations.value(l_key);
+            }
+
+            if (l_registration.channel == chStdin)
+                writeChannel(l_registration.shared, l_events[i].events);
+            else
+                readChannel(l_registration.shared, l_registration.channel);
+        }
+
+        reapChildren();
+    }
+}
+
+void QMPReactorLoop::readChannel(const SharedPointer& a_shared, qint32 a_channel) {
+    QMutexLocker l_locker(&a_shared->mutex);
+    int l_fd = a_shared->fds[a_channel];
+    if (l_fd < 0) return;
+
+    char l_buffer[16384];
+    QByteArray l_data;
+    bool l_eof = false;
+
+    // level triggered, whatever is left over is reported again
+    for (qint32 i = 0; i < 4; ++i) {
+        ssize_t l_read = read(l_fd, l_buffer, sizeof(l_buffer));
+        if (l_read > 0) {
+            l_data.append(l_buffer, l_read);
+            if (l_read < (ssize_t)sizeof(l_buffer)) break;
+            continue;
+        }
+        if ((l_read < 0) && (errno == EINTR)) continue;
+        if ((l_read < 0) && (errno == EAGAIN)) break;
+
+        l_eof = true;
+        break;
+    }
+
+    if (!l_data.isEmpty()) {
+        a_shared->buffers[a_channel] += l_data;
+        a_shared->fresh[a_channel] = true;
+        a_shared->notify();
+    }
+
+    if (l_eof) {
+        closeChannel(a_shared.data(), a_channel);
+        if ((a_shared->fds[chStdout] < 0)
+        &&  (a_shared->fds[chStderr] < 0))
+            m_reap += a_shared;
+    }
+}
+
+void QMPReactorLoop::writeChannel(const SharedPointer& a_shared, quint32 a_events) {
+    QMutexLocker l_locker(&a_shared->mutex);
+    int l_fd = a_shared->fds[chStdin];
+    if (l_fd < 0) return;
+
+    if (a_events & (EPOLLERR | EPOLLHUP)) {
+        a_shared->buffers[chStdin].clear();
+        closeChannel(a_shared.data(), chStdin);
+        return;
+    }
+
+    QByteArray& l_pending = a_shared->buffers[chStdin];
+    if (!(a_events & EPOLLOUT) || l_pending.isEmpty()) return;
+
+    ssize_t l_written = write(l_fd, l_pending.constData(), l_pending.size());
+    if (l_written > 0) {
+        l_pending.remove(0, l_written);
+        a_shared->written += l_written;
+        a_shared->notify();
+    }
+    if (l_pending.isEmpty())
+        setWriteInterest(a_shared.data(), false);
+}
+
+void QMPReactorLoop::closeChannel(QMPReactorProcess::Shared* a_shared, qint32 a_channel) {
+    int l_fd = a_shared->fds[a_channel];
+    if (l_fd < 0) return;
+
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, l_fd, 0);
+    {
+        QMutexLocker l_locker(&m_lock);
+        m_registrations.remove(a_shared->keys[a_channel]);
+    }
+    close(l_fd);
+    a_shared->fds[a_channel] = -1;
+}
+
+void QMPReactorLoop::reapChildren() {
+    for (qint32 i = m_reap.count() - 1; i >= 0; --i) {
+        SharedPointer l_shared = m_reap.at(i);
+
+        int l_status = 0;
+        pid_t l_pid = waitpid(l_shared->pid, &l_status, WNOHANG);
+        if (l_pid == 0) continue;
+        if ((l_pid < 0) && (errno == EINTR)) continue;
+
+        QMutexLocker l_locker(&l_shared->mutex);
+        if ((l_pid == l_shared->pid) && WIFEXITED(l_status)) {
+            l_shared->exitCode = WEXITSTATUS(l_status);
+            l_shared->exitStatus = QProcess::NormalExit;
+        } else if ((l_pid == l_shared->pid) && WIFSIGNALED(l_status)) {
+            l_shared->exitCode = WTERMSIG(l_status);
+            l_shared->exitStatus = QProcess::CrashExit;
+        }
+        l_shared->buffers[chStdin].clear();
+        closeChannel(l_shared.data(), chStdin);
+
+        l_shared->exited = true;
+        l_shared->exitCondition.wakeAll();
+        l_shared->notify();
+        m_reap.removeAt(i);
+    }
+}
+
+QMPReactorProcess::QMPReactorProcess(QObject* a_parent) :
+    QMPProcess(a_parent), m_shared(), m_state(QProcess::NotRunning)
+{
+}
+
+QMPReactorProcess::~QMPReactorProcess() {
+    detach();
+}
+
+void QMPReactorProcess::start(const QString& a_program, const QStringList& a_args) {
+    detach();
+    if (isOpen()) close();
+    prepareLaunchOptions();
+
+    int l_pipes[chCount][2];
+    for (qint32 i = 0; i < chCount; ++i) {
+        if (pipe2(l_pipes[i], O_CLOEXEC) != 0) {
+            setErrorString(QString("pipe failed: %1").arg(strerror(errno)));
+            for (qint32 j = 0; j < i; ++j) {
+                close(l_pipes[j][0]);
+                close(l_pipes[j][1]);
+            }
+            return;
+        }
+    }
+
+    // the child ends, dup2 clears their close-on-exec flag
+    posix_spawn_file_actions_t l_actions;
+    posix_spawn_file_actions_init(&l_actions);
+    posix_spawn_file_actions_adddup2(&l_actions, l_pipes[chStdin][0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&l_actions, l_pipes[chStdout][1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&l_actions, l_pipes[chStderr][1], STDERR_FILENO);
+
+    // a clean signal state, SIGPIPE may be ignored in this process
+    sigset_t l_mask;
+    sigset_t l_default;
+    sigemptyset(&l_mask);
+    sigemptyset(&l_default);
+    sigaddset(&l_default, SIGPIPE);
+
+    posix_spawnattr_t l_attr;
+    posix_spawnattr_init(&l_attr);
+    posix_spawnattr_setsigmask(&l_attr, &l_mask);
+    posix_spawnattr_setsigdefault(&l_attr, &l_default);
+    short l_flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+    if (launchOptions().batch) {
+        struct sched_param l_param;
+        l_param.sched_priority = 0;
+        posix_spawnattr_setschedpolicy(&l_attr, SCHED_BATCH);
+        posix_spawnattr_setschedparam(&l_attr, &l_param);
+        l_flags |= POSIX_SPAWN_SETSCHEDULER;
+    }
+    posix_spawnattr_setflags(&l_attr, l_flags);
+
+    QList<QByteArray> l_argv;
+    l_argv += QFile::encodeName(a_program);
+    foreach (const QString& l_arg, a_args) {
+        l_argv += l_arg.toLocal8Bit();
+    }
+    QVector<char*> l_pointers;
+    for (qint32 i = 0; i < l_argv.count(); ++i) {
+        l_pointers += l_argv[i].data();
+    }
+    l_pointers += 0;
+
+    pid_t l_pid = 0;
+    int l_error = posix_spawnp(&l_pid, l_pointers[0], &l_actions, &l_attr, l_pointers.data(), environ);
+
+    posix_spawn_file_actions_destroy(&l_actions);
+    posix_spawnattr_destroy(&l_attr);
+
+    close(l_pipes[chStdin][0]);
+    close(l_pipes[chStdout][1]);
+    close(l_pipes[chStderr][1]);
+
+    if (l_error != 0) {
+        close(l_pipes[chStdin][1]);
+        close(l_pipes[chStdout][0]);
+        close(l_pipes[chStderr][0]);
+        setErrorString(QString("posix_spawn failed: %1").arg(strerror(l_error)));
+        return;
+    }
+
+    // posix_spawn has no hook before exec, the rest is applied right after;
+    // threads mplayer creates later inherit it
+    applyLaunchOptions(l_pid);
+
+    SharedPointer l_shared(new Shared);
+    l_shared->owner = this;
+    l_shared->pid = l_pid;
+    l_shared->fds[chStdin] = l_pipes[chStdin][1];
+    l_shared->fds[chStdout] = l_pipes[chStdout][0];
+    l_shared->fds[chStderr] = l_pipes[chStderr][0];
+    for (qint32 i = 0; i < chCount; ++i) {
+        fcntl(l_shared->fds[i], F_SETFL, fcntl(l_shared->fds[i], F_GETFL) | O_NONBLOCK);
+    }
+    l_shared->loop = nextLoop();
+
+    m_shared = l_shared;
+    m_state = QProcess::Running;
+    open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+
+    l_shared->loop->add(l_shared);
+}
+
+bool QMPReactorProcess::waitForStarted(int a_msecs) {
+    Q_UNUSED(a_msecs);
+
+    // posix_spawn has already reported success or failure
+    return m_state == QProcess::Running;
+}
+
+bool QMPReactorProcess::waitForFinished(int a_msecs) {
+    if (!m_shared || (m_state == QProcess::NotRunning)) return false;
+
+    {
+        QMutexLocker l_locker(&m_shared->mutex);
+        QElapsedTimer l_timer;
+        l_timer.start();
+
+        while (!m_shared->exited) {
+            unsigned long l_remaining = ULONG_MAX;
+            if (a_msecs >= 0) {
+                qint64 l_left = a_msecs - l_timer.elapsed();
+                if (l_left <= 0) return false;
+                l_remaining = l_left;
+            }
+            m_shared->exitCondition.wait(&m_shared->mutex, l_remaining);
+        }
+    }
+
+    // like QProcess, the remaining output and finished() arrive before returning
+    deliver();
+    return true;
+}
+
+void QMPReactorProcess::kill() {
+    if (!m_shared) return;
+
+    QMutexLocker l_locker(&m_shared->mutex);
+    if (!m_shared->exited)
+        ::kill(m_shared->pid, SIGKILL);
+}
+
+QProcess::ProcessState QMPReactorProcess::state() const {
+    return m_state;
+}
+
+Q_PID QMPReactorProcess::pid() const {
+    return m_shared ? m_shared->pid : 0;
+}
+
+QByteArray QMPReactorProcess::readAllStandardOutput() {
+    if (!m_shared) return QByteArray();
+
+    QMutexLocker l_locker(&m_shared->mutex);
+    QByteArray l_data;
+    l_data.swap(m_shared->buffers[chStdout]);
+    return l_data;
+}
+
+QByteArray QMPReactorProcess::readAllStandardError() {
+    if (!m_shared) return QByteArray();
+
+    QMutexLocker l_locker(&m_shared->mutex);
+    QByteArray l_data;
+    l_data.swap(m_shared->buffers[chStderr]);
+    return l_data;
+}
+
+qint64 QMPReactorProcess::bytesToWrite() const {
+    if (!m_shared) return 0;
+
+    QMutexLocker l_locker(&m_shared->mutex);
+    return m_shared->buffers[chStdin].size();
+}
+
+void QMPReactorProcess::setThreadCount(qint32 a_count) {
+    QMutexLocker l_locker(&sl_loopsLock);
+    sl_threadCount = a_count;
+}
+
+qint32 QMPReactorProcess::threadCount() {
+    QMutexLocker l_locker(&sl_loopsLock);
+    return sl_loops.isEmpty() ? sl_threadCount : sl_loops.count();
+}
+
+qint64 QMPReactorProcess::readData(char* a_data, qint64 a_maxSize) {
+    if (!m_shared) return -1;
+
+    QMutexLocker l_locker(&m_shared->mutex);
+    QByteArray& l_buffer = m_shared->buffers[chStdout];
+    qint64 l_size = qMin<qint64>(a_maxSize, l_buffer.size());
+    memcpy(a_data, l_buffer.constData(), l_size);
+    l_buffer.remove(0, l_size);
+    return l_size;
+}
+
+qint64 QMPReactorProcess::writeData(const char* a_data, qint64 a_size) {
+    if (!m_shared) return -1;
+
+    QMutexLocker l_locker(&m_shared->mutex);
+    int l_fd = m_shared->fds[chStdin];
+    if (l_fd < 0) return -1;
+
+    // try the pipe first, only the rest waits for the reactor
+    qint64 l_done = 0;
+    if (m_shared->buffers[chStdin].isEmpty()) {
+        ssize_t l_written;
+        do {
+            l_written = ::write(l_fd, a_data, a_size);
+        } while ((l_written < 0) && (errno == EINTR));
+
+        if (l_written < 0) {
+            if (errno != EAGAIN) {
+                setErrorString(QString("write failed: %1").arg(strerror(errno)));
+                return -1;
+            }
+            l_written = 0;
+        }
+
+        l_done = l_written;
+        if (l_done > 0) {
+            m_shared->written += l_done;
+            m_shared->notify();
+        }
+    }
+
+    if (l_done < a_size) {
+        m_shared->buffers[chStdin].append(a_data + l_done, a_size - l_done);
+        m_shared->loop->setWriteInterest(m_shared.data(), true);
+    }
+
+    return a_size;
+}
+
+void QMPReactorProcess::deliver() {
+    SharedPointer l_shared = m_shared;
+    if (!l_shared) return;
+
+    bool l_stdout;
+    bool l_stderr;
+    bool l_finished;
+    qint64 l_written;
+    int l_exitCode;
+    QProcess::ExitStatus l_exitStatus;
+    {
+        QMutexLocker l_locker(&l_shared->mutex);
+        l_shared->notifyPosted = false;
+
+        l_stdout = l_shared->fresh[chStdout];
+        l_stderr = l_shared->fresh[chStderr];
+        l_shared->fresh[chStdout] = false;
+        l_shared->fresh[chStderr] = false;
+        l_written = l_shared->written;
+        l_shared->written = 0;
+
+        l_finished = l_shared->exited && !l_shared->exitReported;
+        if (l_finished) l_shared->exitReported = true;
+        l_exitCode = l_shared->exitCode;
+        l_exitStatus = l_shared->exitStatus;
+    }
+
+    // a handler may already have started the next child
+    if (l_written > 0)
+        emit bytesWritten(l_written);
+    if (l_stdout && (m_shared == l_shared)) {
+        emit readyRead();
+        emit readyReadStandardOutput();
+    }
+    if (l_stderr && (m_shared == l_shared))
+        emit readyReadStandardError();
+    if (l_finished && (m_shared == l_shared)) {
+        m_state = QProcess::NotRunning;
+        emit finished(l_exitCode, l_exitStatus);
+    }
+}
+
+void QMPReactorProcess::detach() {
+    if (!m_shared) return;
+
+    {
+        // the loop reaps the child and frees the shared state after us
+        QMutexLocker l_locker(&m_shared->mutex);
+        if (!m_shared->exited)
+            ::kill(m_shared->pid, SIGKILL);
+        m_shared->owner = 0;
+    }
+
+    m_shared.clear();
+    m_state = QProcess::NotRunning;
+}
@@ -0,0 +1,52 @@
+#ifndef QMPREACTOR_H
+#define QMPREACTOR_H
+
+#include <QSharedPointer>
+#include "qmpprocess.h"
+
+// Child started with posix_spawn whose pipes are served by one of a few
+// shared epoll threads instead of per process socket notifiers. Output
+// is buffered by the reactor and announced through one queued call per
+// event loop turn.
+class QMPReactorProcess : public QMPProcess
+{
+    Q_OBJECT
+
+public:
+    explicit QMPReactorProcess(QObject* a_parent = 0);
+    virtual ~QMPReactorProcess();
+
+    void start(const QString& a_program, const QStringList& a_args);
+    bool waitForStarted(int a_msecs = 30000);
+    bool waitForFinished(int a_msecs = 30000);
+    void kill();
+
+    QProcess::ProcessState state() const;
+    Q_PID pid() const;
+
+    QByteArray readAllStandardOutput();
+    QByteArray readAllStandardError();
+
+    qint64 bytesToWrite() const;
+
+    // number of epoll threads, takes effect before the first start()
+    static void setThreadCount(qint32 a_count);
+    static qint32 threadCount();
+
+    struct Shared;
+
+protected:
+    qint64 readData(char* a_data, qint64 a_maxSize);
+    qint64 writeData(const char* a_data, qint64 a_size);
+
+private slots:
+    void deliver();
+
+private:
+    void detach();
+
+    QSharedPointer<Shared> m_shared;
+    QProcess::ProcessState m_state;
+};
+
+#endif // QMPREACTOR_H
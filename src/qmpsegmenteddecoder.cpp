@@ -0,0 +1,209 @@
+#include "qmpsegmenteddecoder.h"
+#include "qmpyuvworker.h"
+#include <QThread>
+#include <signal.h>
+
+QMPSegmentedDecoder::QMPSegmentedDecoder(QObject* a_parent) :
+    QObject(a_parent), m_segmentCount(qMax(1, QThread::idealThreadCount())), m_ordered(false), m_maxBuffered(64),
+    m_size(), m_segments(), m_head(0), m_totalFrames(0), m_delivered(0), m_running(0)
+{
+}
+
+QMPSegmentedDecoder::~QMPSegmentedDecoder() {
+    cancel();
+}
+
+void QMPSegmentedDecoder::setSegments(qint32 a_count) {
+    m_segmentCount = qMax(1, a_count);
+}
+
+qint32 QMPSegmentedDecoder::segments() const {
+    return m_segmentCount;
+}
+
+void QMPSegmentedDecoder::setOrdered(bool a_ordered) {
+    m_ordered = a_ordered;
+}
+
+bool QMPSegmentedDecoder::ordered() const {
+    return m_ordered;
+}
+
+void QMPSegmentedDecoder::setMaxBufferedFrames(qint32 a_frames) {
+    m_maxBuffered = qMax(1, a_frames);
+}
+
+qint32 QMPSegmentedDecoder::maxBufferedFrames() const {
+    return m_maxBuffered;
+}
+
+void QMPSegmentedDecoder::setSize(const QSize& a_size) {
+    m_size = QMPYuvWorker::evenSize(a_size);
+}
+
+QSize QMPSegmentedDecoder::size() const {
+    return m_size;
+}
+
+bool QMPSegmentedDecoder::start(const QMPlayer::MediaInfo& a_info) {
+    cancel();
+
+    QMPlayer::MediaInfo l_info = a_info;
+    if (!l_info.valid || !l_info.hasVideo()) return false;
+
+    // ranges need a frame count, everything else is one segment to the end
+    qint64 l_total = -1;
+    if (l_info.seekable && (l_info.length > 0) && (l_info.video.fps > 0))
+        l_total = qint64(l_info.length * l_info.video.fps);
+    qint32 l_count = (l_total > 0) ? qint32(qMin<qint64>(m_segmentCount, l_total)) : 1;
+    // a keyframe seek would number the frames of a segment from the
+    // wrong start
+    if ((l_count > 1) && !QMPlayer::mPlayerHasOption("hr-seek")) {
+        qWarning("QMPSegmentedDecoder: %s has no -hr-seek, decoding one segment", qPrintable(QMPlayer::mPlayerPath()));
+        l_count = 1;
+    }
+
+    m_totalFrames = l_total;
+    m_running = l_count;
+    for (qint32 i = 0; i < l_count; ++i) {
+        Segment* l_segment = new Segment;
+        l_segment->firstFrame = (l_total > 0) ? l_total * i / l_count : 0;
+        l_segment->frames = (l_total > 0) ? l_total * (i + 1) / l_count - l_segment->firstFrame : -1;
+        l_segment->decoded = 0;
+        l_segment->suspended = false;
+        m_segments += l_segment;
+
+        startSegment(l_segment, l_info.url, l_info.video.fps);
+    }
+    return true;
+}
+
+void QMPSegmentedDecoder::startSegment(Segment* a_segment, const QString& a_url, qreal a_fps) {
+    a_segment->worker = new QMPYuvWorker(this);
+    a_segment->worker->setDropFrames(false);
+    a_segment->worker->setMaxQueuedFrames(8);
+
+    connect(a_segment->worker, SIGNAL(imageReady(QImage)), SLOT(workerImageReady(QImage)));
+    connect(a_segment->worker, SIGNAL(finished()), SLOT(workerFinished()));
+
+    QStringList l_args;
+    if (a_segment->firstFrame > 0) {
+        l_args += "-ss";
+        l_args += QString::number(a_segment->firstFrame / a_fps, 'f', 6);
+        l_args += "-hr-seek";
+        l_args += "on";
+    }
+    if (a_segment->frames >= 0) {
+        l_args += "-frames";
+        l_args += QString::number(a_segment->frames);
+    }
+    l_args += "-benchmark";
+
+    a_segment->worker->start(l_args, a_url, m_size);
+}
+
+// may run from a frameReady() receiver, i.e. inside a reader's
+// deliver(), so nothing is deleted right away
+void QMPSegmentedDecoder::cancel() {
+    foreach (Segment* l_segment, m_segments) {
+        if (l_segment->worker) {
+            l_segment->worker->disconnect(this);
+            l_segment->worker->stop();
+            l_segment->worker->deleteLater();
+        }
+        delete l_segment;
+    }
+    m_segments.clear();
+    m_head = 0;
+    m_totalFrames = 0;
+    m_delivered = 0;
+    m_running = 0;
+}
+
+bool QMPSegmentedDecoder::isRunning() const {
+    return m_running > 0;
+}
+
+qint64 QMPSegmentedDecoder::totalFrames() const {
+    return m_totalFrames;
+}
+
+qint64 QMPSegmentedDecoder::framesDelivered() const {
+    return m_delivered;
+}
+
+QMPSegmentedDecoder::Segment* QMPSegmentedDecoder::segmentFor(QObject* a_object) {
+    if (!a_object) return 0;
+
+    foreach (Segment* l_segment, m_segments) {
+        if (l_segment->worker == a_object) return l_segment;
+    }
+    return 0;
+}
+
+void QMPSegmentedDecoder::workerImageReady(const QImage& a_image) {
+    Segment* l_segment = segmentFor(sender());
+    if (!l_segment) return;
+
+    qint64 l_frame = l_segment->firstFrame + l_segment->decoded;
+    ++l_segment->decoded;
+
+    if (!m_ordered || (m_segments.indexOf(l_segment) == m_head)) {
+        ++m_delivered;
+        emit frameReady(l_frame, a_image);
+        return;
+    }
+
+    // ahead of the head, held back and stopped before it gets too far
+    l_segment->buffered.enqueue(a_image);
+    if (l_segment->buffered.count() >= m_maxBuffered)
+        suspend(l_segment, true);
+}
+
+void QMPSegmentedDecoder::workerFinished() {
+    Segment* l_segment = segmentFor(sender());
+    if (l_segment) segmentDone(l_segment);
+}
+
+void QMPSegmentedDecoder::segmentDone(Segment* a_segment) {
+    a_segment->worker->deleteLater();
+    a_segment->worker = 0;
+    a_segment->suspended = false;
+    --m_running;
+
+    if (m_ordered) {
+        advanceHead();
+        // a receiver may have cancelled
+        if (m_segments.isEmpty()) return;
+    }
+
+    if (m_running == 0)
+        emit finished();
+}
+
+void QMPSegmentedDecoder::advanceHead() {
+    while (m_head < m_segments.count()) {
+        Segment* l_segment = m_segments.at(m_head);
+
+        // what it decoded while it was not the head
+        while (!l_segment->buffered.isEmpty()) {
+            qint64 l_frame = l_segment->firstFrame + l_segment->decoded - l_segment->buffered.count();
+            QImage l_image = l_segment->buffered.dequeue();
+            ++m_delivered;
+            emit frameReady(l_frame, l_image);
+            if (m_segments.isEmpty()) return;
+        }
+        suspend(l_segment, false);
+
+        if (l_segment->worker) return;
+        ++m_head;
+    }
+}
+
+void QMPSegmentedDecoder::suspend(Segment* a_segment, bool a_suspend) {
+    if (!a_segment->worker || (a_segment->suspended == a_suspend)) return;
+
+    // the reader then waits in fread() and mplayer where it stopped
+    if (::kill(a_segment->worker->pid(), a_suspend ? SIGSTOP : SIGCONT) == 0)
+        a_segment->suspended = a_suspend;
+}
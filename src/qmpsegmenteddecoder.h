@@ -0,0 +1,89 @@
+#ifndef QMPSEGMENTEDDECODER_H
+#define QMPSEGMENTEDDECODER_H
+
+#include <QObject>
+#include <QQueue>
+#include <QImage>
+#include <QSize>
+#include "qmplayer.h"
+
+class QMPYuvWorker;
+
+// Decodes a whole file faster than real time by splitting it into N
+// frame ranges, each decoded by its own
+// "mplayer -ss <start> -frames <count> -benchmark -vo yuv4mpeg" process
+// run by a QMPYuvWorker. No frame is dropped, a slow receiver makes
+// the processes wait on their pipes. Frames carry their global number
+// and come in the order they are decoded, or in file order, in which
+// case segments running ahead are buffered and then suspended.
+// Only -hr-seek (mplayer2, mpv) starts a segment on its first frame,
+// plain -ss lands on a keyframe and the ranges would overlap, so without
+// it the file is decoded as one segment and the numbers stay exact.
+class QMPSegmentedDecoder : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit QMPSegmentedDecoder(QObject* a_parent = 0);
+    virtual ~QMPSegmentedDecoder();
+
+    // apply to the next start()
+    void setSegments(qint32 a_count);
+    qint32 segments() const;
+    void setOrdered(bool a_ordered);
+    bool ordered() const;
+    // frames a segment may buffer ahead in ordered mode
+    void setMaxBufferedFrames(qint32 a_frames);
+    qint32 maxBufferedFrames() const;
+    // invalid for the size of the video, else a bounding box
+    void setSize(const QSize& a_size);
+    QSize size() const;
+
+    // a_info has to come from -identify, files that are not seekable or
+    // of unknown length are decoded as one segment
+    bool start(const QMPlayer::MediaInfo& a_info);
+    void cancel();
+
+    bool isRunning() const;
+    qint64 totalFrames() const;
+    qint64 framesDelivered() const;
+
+signals:
+    void frameReady(qint64 a_frame, const QImage& a_image);
+    void finished();
+
+private slots:
+    void workerImageReady(const QImage& a_image);
+    void workerFinished();
+
+private:
+    struct Segment {
+        QMPYuvWorker* worker;
+        qint64 firstFrame;
+        // -1 for up to the end
+        qint64 frames;
+        qint64 decoded;
+        QQueue<QImage> buffered;
+        bool suspended;
+    };
+
+    Segment* segmentFor(QObject* a_object);
+    void startSegment(Segment* a_segment, const QString& a_url, qreal a_fps);
+    void segmentDone(Segment* a_segment);
+    void advanceHead();
+    void suspend(Segment* a_segment, bool a_suspend);
+
+    qint32 m_segmentCount;
+    bool m_ordered;
+    qint32 m_maxBuffered;
+    QSize m_size;
+
+    QList<Segment*> m_segments;
+    // first segment not completely delivered, ordered mode only
+    qint32 m_head;
+    qint64 m_totalFrames;
+    qint64 m_delivered;
+    qint32 m_running;
+};
+
+#endif // QMPSEGMENTEDDECODER_H
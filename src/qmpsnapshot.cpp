@@ -0,0 +1,131 @@
+#include "qmpsnapshot.h"
+#include <QRunnable>
+#include <QImageWriter>
+#include <QBuffer>
+#include <QThread>
+
+// One image on its way through the pool
+class QMPSnapshotJob : public QRunnable
+{
+public:
+    QMPSnapshotJob(QMPSnapshotEncoder* a_encoder, const QImage& a_image, const QMPSnapshotEncoder::Options& a_options,
+                   QFutureInterface<QMPSnapshotEncoder::Result> a_result) :
+        m_encoder(a_encoder), m_image(a_image), m_options(a_options), m_result(a_result) {}
+
+    void run() {
+        QMPSnapshotEncoder::Result l_result = QMPSnapshotEncoder::encodeNow(m_image, m_options);
+        m_image = QImage();
+        m_encoder->release();
+        m_result.reportResult(l_result);
+        m_result.reportFinished();
+    }
+
+private:
+    QMPSnapshotEncoder* m_encoder;
+    QImage m_image;
+    QMPSnapshotEncoder::Options m_options;
+    QFutureInterface<QMPSnapshotEncoder::Result> m_result;
+};
+
+QMPSnapshotEncoder::QMPSnapshotEncoder(QObject* a_parent) :
+    QObject(a_parent), m_pool(), m_pending(0), m_maxPending(8)
+{
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+}
+
+QMPSnapshotEncoder::~QMPSnapshotEncoder() {
+    m_pool.waitForDone();
+}
+
+void QMPSnapshotEncoder::setMaxThreads(qint32 a_count) {
+    m_pool.setMaxThreadCount(qMax(1, a_count));
+}
+
+qint32 QMPSnapshotEncoder::maxThreads() const {
+    return m_pool.maxThreadCount();
+}
+
+void QMPSnapshotEncoder::setMaxPending(qint32 a_count) {
+    m_maxPending = qMax(1, a_count);
+}
+
+qint32 QMPSnapshotEncoder::maxPending() const {
+    return m_maxPending;
+}
+
+qint32 QMPSnapshotEncoder::pending() const {
+    return m_pending;
+}
+
+QFuture<QMPSnapshotEncoder::Result> QMPSnapshotEncoder::encode(const QImage& a_image, const Options& a_options) {
+    QFutureInterface<Result> l_result;
+    l_result.reportStarted();
+
+    if (acquire())
+        submit(a_image, a_options, l_result);
+    else
+        fail(l_result, "Snapshot queue full");
+    return l_result.future();
+}
+
+bool QMPSnapshotEncoder::acquire() {
+    if (m_pending.fetchAndAddOrdered(1) >= m_maxPending) {
+        m_pending.deref();
+        return false;
+    }
+    return true;
+}
+
+void QMPSnapshotEncoder::release() {
+    m_pending.deref();
+}
+
+void QMPSnapshotEncoder::submit(const QImage& a_image, const Options& a_options, QFutureInterface<Result> a_result) {
+    m_pool.start(new QMPSnapshotJob(this, a_image, a_options, a_result));
+}
+
+QMPSnapshotEncoder::Result QMPSnapshotEncoder::encodeNow(const QImage& a_image, const Options& a_options) {
+    Result l_result;
+    if (a_image.isNull()) {
+        l_result.error = "No image";
+        return l_result;
+    }
+
+    QByteArray l_format = a_options.format.toLower();
+    if (!QImageWriter::supportedImageFormats().contains(l_format)) {
+        l_result.error = "Unsupported image format " + QString::fromLatin1(a_options.format);
+        return l_result;
+    }
+
+    QImage l_image = a_image;
+    if (a_options.maxSize.isValid()
+    &&  ((l_image.width() > a_options.maxSize.width()) || (l_image.height() > a_options.maxSize.height()))) {
+        l_image = l_image.scaled(a_options.maxSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    l_result.size = l_image.size();
+
+    QBuffer l_buffer(&l_result.data);
+    QImageWriter l_writer;
+    if (a_options.path.isEmpty()) {
+        l_buffer.open(QIODevice::WriteOnly);
+        l_writer.setDevice(&l_buffer);
+    } else {
+        l_writer.setFileName(a_options.path);
+        l_result.path = a_options.path;
+    }
+    l_writer.setFormat(l_format);
+    l_writer.setQuality(a_options.quality);
+
+    if (!l_writer.write(l_image)) {
+        l_result.error = l_writer.errorString();
+        l_result.data.clear();
+    }
+    return l_result;
+}
+
+void QMPSnapshotEncoder::fail(QFutureInterface<Result> a_result, const QString& a_error) {
+    Result l_result;
+    l_result.error = a_error;
+    a_result.reportResult(l_result);
+    a_result.reportFinished();
+}
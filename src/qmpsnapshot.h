@@ -0,0 +1,71 @@
+#ifndef QMPSNAPSHOT_H
+#define QMPSNAPSHOT_H
+
+#include <QObject>
+#include <QImage>
+#include <QSize>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QFuture>
+#include <QFutureInterface>
+
+// Encodes still images on a thread pool of its own, so neither the GUI
+// thread nor the global pool pays for PNG or JPEG compression. At most
+// maxPending() images wait or encode at once, beyond that the future
+// finishes right away with an error instead of queueing without bound.
+class QMPSnapshotEncoder : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options {
+        // anything QImageWriter supports, "webp" needs the image plugin
+        QByteArray format;
+        // -1 for the default of the format
+        qint32 quality;
+        // invalid keeps the frame size, else a bounding box
+        QSize maxSize;
+        // empty returns the bytes in Result::data
+        QString path;
+
+        Options() : format("png"), quality(-1), maxSize(), path() {}
+    };
+
+    struct Result {
+        QByteArray data;
+        QString path;
+        QSize size;
+        QString error;
+
+        Result() : data(), path(), size(), error() {}
+        bool ok() const { return error.isEmpty(); }
+    };
+
+public:
+    explicit QMPSnapshotEncoder(QObject* a_parent = 0);
+    virtual ~QMPSnapshotEncoder();
+
+    void setMaxThreads(qint32 a_count);
+    qint32 maxThreads() const;
+    void setMaxPending(qint32 a_count);
+    qint32 maxPending() const;
+    qint32 pending() const;
+
+    QFuture<QMPSnapshotEncoder::Result> encode(const QImage& a_image, const Options& a_options = Options());
+
+    // encode() in two steps, for a frame that is still to come: acquire()
+    // takes a slot, submit() or release() gives it back
+    bool acquire();
+    void release();
+    void submit(const QImage& a_image, const Options& a_options, QFutureInterface<QMPSnapshotEncoder::Result> a_result);
+
+    static QMPSnapshotEncoder::Result encodeNow(const QImage& a_image, const Options& a_options);
+    static void fail(QFutureInterface<QMPSnapshotEncoder::Result> a_result, const QString& a_error);
+
+private:
+    QThreadPool m_pool;
+    QAtomicInt m_pending;
+    qint32 m_maxPending;
+};
+
+#endif // QMPSNAPSHOT_H
@@ -0,0 +1,205 @@
+#include "qmpspritecache.h"
+#include "qmpthumbnailer.h"
+#include "qmpmediaprobe.h"
+#include <QDir>
+#include <QFile>
+#include <QPainter>
+#include <QThread>
+#include <QCryptographicHash>
+#include <math.h>
+
+const qint32 QMPSpriteCache::sc_maxTiles;
+
+QMPSpriteCache::QMPSpriteCache(QObject* a_parent) :
+    QObject(a_parent), m_thumbnailer(new QMPThumbnailer(this)), m_interval(10), m_tileSize(160, 90),
+    m_directory(), m_url(), m_file(), m_step(0), m_count(0), m_columns(0), m_sprite(), m_ready(),
+    m_readyCount(0), m_done(0)
+{
+    // the player decoding next to it gets the other half
+    m_thumbnailer->setMaxWorkers(qMax(1, QThread::idealThreadCount() / 2));
+    m_thumbnailer->setSize(m_tileSize);
+
+    connect(m_thumbnailer, SIGNAL(thumbnailed(QString,qreal,QImage)), SLOT(thumbnailed(QString,qreal,QImage)));
+    connect(m_thumbnailer, SIGNAL(finished()), SLOT(thumbnailerFinished()));
+}
+
+QMPSpriteCache::~QMPSpriteCache() {
+    m_thumbnailer->cancel();
+}
+
+void QMPSpriteCache::setInterval(qreal a_seconds) {
+    m_interval = qMax<qreal>(0.1, a_seconds);
+}
+
+qreal QMPSpriteCache::interval() const {
+    return m_interval;
+}
+
+void QMPSpriteCache::setTileSize(const QSize& a_size) {
+    m_thumbnailer->setSize(a_size);
+    m_tileSize = m_thumbnailer->size();
+}
+
+QSize QMPSpriteCache::tileSize() const {
+    return m_tileSize;
+}
+
+void QMPSpriteCache::setMaxWorkers(qint32 a_count) {
+    m_thumbnailer->setMaxWorkers(a_count);
+}
+
+qint32 QMPSpriteCache::maxWorkers() const {
+    return m_thumbnailer->maxWorkers();
+}
+
+void QMPSpriteCache::setCacheDirectory(const QString& a_path) {
+    m_directory = a_path;
+}
+
+QString QMPSpriteCache::cacheDirectory() const {
+    return m_directory;
+}
+
+void QMPSpriteCache::load(const QString& a_url, qreal a_length) {
+    clear();
+    if (a_length <= 0) return;
+
+    m_url = a_url;
+    m_step = qMax(m_interval, a_length / sc_maxTiles);
+    m_count = qBound(1, qint32(ceil(a_length / m_step)), sc_maxTiles);
+    m_columns = qMin(16, m_count);
+    m_ready.resize(m_count);
+
+    // 16 bit tiles, a two hour film at 10 s is ~20 MB
+    qint32 l_rows = (m_count + m_columns - 1) / m_columns;
+    m_sprite = QImage(m_columns * m_tileSize.width(), l_rows * m_tileSize.height(), QImage::Format_RGB16);
+    m_sprite.fill(0);
+
+    m_file = cacheFile();
+    if (!m_file.isEmpty() && QFile::exists(m_file)) {
+        QImage l_cached(m_file);
+        if (l_cached.size() == m_sprite.size()) {
+            m_sprite = l_cached.convertToFormat(QImage::Format_RGB16);
+            m_ready.fill(true);
+            m_readyCount = m_count;
+            m_done = m_count;
+            emit progress(m_readyCount, m_count);
+            emit finished();
+            return;
+        }
+    }
+
+    // every 2^n-th tile first, then the ones in between
+    qint32 l_stride = 1;
+    while (l_stride * 2 < m_count)
+        l_stride *= 2;
+    for (qint32 i = 0; i < m_count; i += l_stride) {
+        m_thumbnailer->thumbnail(m_url, i * m_step);
+    }
+    for (; l_stride > 1; l_stride /= 2) {
+        for (qint32 i = l_stride / 2; i < m_count; i += l_stride) {
+            m_thumbnailer->thumbnail(m_url, i * m_step);
+        }
+    }
+}
+
+void QMPSpriteCache::clear() {
+    m_thumbnailer->cancel();
+    m_url.clear();
+    m_file.clear();
+    m_step = 0;
+    m_count = 0;
+    m_columns = 0;
+    m_sprite = QImage();
+    m_ready.clear();
+    m_readyCount = 0;
+    m_done = 0;
+}
+
+QString QMPSpriteCache::url() const {
+    return m_url;
+}
+
+qint32 QMPSpriteCache::count() const {
+    return m_count;
+}
+
+qint32 QMPSpriteCache::ready() const {
+    return m_readyCount;
+}
+
+bool QMPSpriteCache::isComplete() const {
+    return (m_count > 0) && (m_done == m_count);
+}
+
+QImage QMPSpriteCache::previewAt(qreal a_time, qreal* a_frameTime) const {
+    if (m_readyCount == 0) return QImage();
+
+    // nearest ready tile, looking both ways
+    qint32 l_index = qBound(0, qRound(a_time / m_step), m_count - 1);
+    for (qint32 d = 0; d < m_count; ++d) {
+        qint32 l_found = -1;
+        if ((l_index - d >= 0) && m_ready.testBit(l_index - d))
+            l_found = l_index - d;
+        else if ((l_index + d < m_count) && m_ready.testBit(l_index + d))
+            l_found = l_index + d;
+
+        if (l_found >= 0) {
+            if (a_frameTime) *a_frameTime = l_found * m_step;
+            return m_sprite.copy(tileRect(l_found));
+        }
+    }
+    return QImage();
+}
+
+const QImage& QMPSpriteCache::sprite() const {
+    return m_sprite;
+}
+
+void QMPSpriteCache::thumbnailed(const QString& a_url, qreal a_time, const QImage& a_image) {
+    if (a_url != m_url) return;
+
+    qint32 l_index = qRound(a_time / m_step);
+    if ((l_index < 0) || (l_index >= m_count)) return;
+
+    ++m_done;
+    if (!a_image.isNull()) {
+        // centered, the thumbnail keeps the aspect of the video
+        QRect l_tile = tileRect(l_index);
+        QPainter l_painter(&m_sprite);
+        l_painter.drawImage(l_tile.x() + (l_tile.width() - a_image.width()) / 2,
+                            l_tile.y() + (l_tile.height() - a_image.height()) / 2, a_image);
+
+        m_ready.setBit(l_index);
+        ++m_readyCount;
+    }
+    emit progress(m_readyCount, m_count);
+}
+
+void QMPSpriteCache::thumbnailerFinished() {
+    if (!isComplete()) return;
+
+    // a cached sprite is loaded as all ready, tiles that failed must not
+    // come back as black frames, they are tried again next time
+    if (!m_file.isEmpty() && (m_readyCount == m_count)) {
+        QDir().mkpath(m_directory);
+        if (!m_sprite.save(m_file, "JPG", 80))
+            qWarning("QMPSpriteCache: cannot write %s", qPrintable(m_file));
+    }
+    emit finished();
+}
+
+QRect QMPSpriteCache::tileRect(qint32 a_index) const {
+    return QRect((a_index % m_columns) * m_tileSize.width(), (a_index / m_columns) * m_tileSize.height(),
+                 m_tileSize.width(), m_tileSize.height());
+}
+
+QString QMPSpriteCache::cacheFile() const {
+    // streams and unset directories stay in memory
+    QString l_key = QMPMediaProbe::cacheKey(m_url);
+    if (l_key.isEmpty() || m_directory.isEmpty()) return QString();
+
+    l_key += QString("|%1|%2x%3").arg(m_step).arg(m_tileSize.width()).arg(m_tileSize.height());
+    QByteArray l_hash = QCryptographicHash::hash(l_key.toUtf8(), QCryptographicHash::Sha1).toHex();
+    return QDir(m_directory).filePath(QString::fromLatin1(l_hash) + ".jpg");
+}
@@ -0,0 +1,80 @@
+#ifndef QMPSPRITECACHE_H
+#define QMPSPRITECACHE_H
+
+#include <QObject>
+#include <QImage>
+#include <QBitArray>
+#include <QSize>
+#include <QRect>
+
+class QMPThumbnailer;
+
+// Low resolution frames at fixed intervals of one media, decoded in the
+// background by a QMPThumbnailer into one sprite sheet, coarse to fine
+// so the whole range is covered early. previewAt() never blocks, which
+// lets a seek slider show frames while dragging and seek on release.
+// Sheets of local files with every tile decoded are kept as JPEG in the
+// cache directory.
+class QMPSpriteCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit QMPSpriteCache(QObject* a_parent = 0);
+    virtual ~QMPSpriteCache();
+
+    // apply to the next load()
+    void setInterval(qreal a_seconds);
+    qreal interval() const;
+    void setTileSize(const QSize& a_size);
+    QSize tileSize() const;
+    void setMaxWorkers(qint32 a_count);
+    qint32 maxWorkers() const;
+
+    // empty keeps the sprites in memory only
+    void setCacheDirectory(const QString& a_path);
+    QString cacheDirectory() const;
+
+    void load(const QString& a_url, qreal a_length);
+    void clear();
+
+    QString url() const;
+    qint32 count() const;
+    qint32 ready() const;
+    bool isComplete() const;
+
+    // the cached frame closest to a_time, null if there is none yet
+    QImage previewAt(qreal a_time, qreal* a_frameTime = 0) const;
+    const QImage& sprite() const;
+
+    static const qint32 sc_maxTiles = 2048;
+
+signals:
+    void progress(qint32 a_ready, qint32 a_count);
+    void finished();
+
+private slots:
+    void thumbnailed(const QString& a_url, qreal a_time, const QImage& a_image);
+    void thumbnailerFinished();
+
+private:
+    QRect tileRect(qint32 a_index) const;
+    QString cacheFile() const;
+
+    QMPThumbnailer* m_thumbnailer;
+    qreal m_interval;
+    QSize m_tileSize;
+    QString m_directory;
+
+    QString m_url;
+    QString m_file;
+    qreal m_step;
+    qint32 m_count;
+    qint32 m_columns;
+    QImage m_sprite;
+    QBitArray m_ready;
+    qint32 m_readyCount;
+    qint32 m_done;
+};
+
+#endif // QMPSPRITECACHE_H
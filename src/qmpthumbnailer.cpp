@@ -0,0 +1,163 @@
+#include "qmpthumbnailer.h"
+#include "qmplayer.h"
+#include "qmpyuvworker.h"
+#include <QThread>
+
+QMPThumbnailer::QMPThumbnailer(QObject* a_parent) :
+    QObject(a_parent), m_queue(), m_workers(), m_maxWorkers(qMax(1, QThread::idealThreadCount())),
+    m_timeout(20000), m_size(160, 90), m_preciseSeek(false), m_dispatch(), m_reaper()
+{
+    m_dispatch.setInterval(0);
+    m_dispatch.setSingleShot(true);
+    connect(&m_dispatch, SIGNAL(timeout()), SLOT(dispatch()));
+
+    m_reaper.setInterval(1000);
+    connect(&m_reaper, SIGNAL(timeout()), SLOT(reapWorkers()));
+}
+
+QMPThumbnailer::~QMPThumbnailer() {
+    cancel();
+}
+
+void QMPThumbnailer::setMaxWorkers(qint32 a_count) {
+    m_maxWorkers = qMax(1, a_count);
+    m_dispatch.start();
+}
+
+qint32 QMPThumbnailer::maxWorkers() const {
+    return m_maxWorkers;
+}
+
+void QMPThumbnailer::setTimeout(qint32 a_ms) {
+    m_timeout = a_ms;
+}
+
+qint32 QMPThumbnailer::timeout() const {
+    return m_timeout;
+}
+
+void QMPThumbnailer::setSize(const QSize& a_size) {
+    m_size = QMPYuvWorker::evenSize(a_size);
+}
+
+QSize QMPThumbnailer::size() const {
+    return m_size;
+}
+
+void QMPThumbnailer::setPreciseSeek(bool a_precise) {
+    m_preciseSeek = a_precise;
+}
+
+bool QMPThumbnailer::preciseSeek() const {
+    return m_preciseSeek;
+}
+
+void QMPThumbnailer::thumbnail(const QString& a_url, qreal a_time) {
+    Request l_request;
+    l_request.url = a_url;
+    l_request.time = a_time;
+    m_queue.enqueue(l_request);
+    if (m_dispatch.timerId() == -1)
+        m_dispatch.start();
+}
+
+void QMPThumbnailer::thumbnail(const QString& a_url, const QList<qreal>& a_times) {
+    foreach (qreal l_time, a_times) {
+        thumbnail(a_url, l_time);
+    }
+}
+
+void QMPThumbnailer::cancel() {
+    m_queue.clear();
+    m_dispatch.stop();
+    m_reaper.stop();
+
+    foreach (Worker* l_worker, m_workers) {
+        l_worker->worker->disconnect(this);
+        l_worker->worker->stop();
+        l_worker->worker->deleteLater();
+        delete l_worker;
+    }
+    m_workers.clear();
+}
+
+qint32 QMPThumbnailer::pending() const {
+    return m_queue.count() + m_workers.count();
+}
+
+void QMPThumbnailer::dispatch() {
+    while (!m_queue.isEmpty() && (m_workers.count() < m_maxWorkers)) {
+        startWorker(m_queue.dequeue());
+    }
+
+    if (m_workers.isEmpty() && m_queue.isEmpty())
+        emit finished();
+}
+
+void QMPThumbnailer::startWorker(const Request& a_request) {
+    Worker* l_worker = new Worker;
+    l_worker->worker = new QMPYuvWorker(this);
+    l_worker->request = a_request;
+
+    connect(l_worker->worker, SIGNAL(imageReady(QImage)), SLOT(workerImageReady(QImage)));
+    connect(l_worker->worker, SIGNAL(finished()), SLOT(workerFinished()));
+
+    QStringList l_args;
+    l_args += "-ss";
+    l_args += QString::number(a_request.time, 'f', 3);
+    if (m_preciseSeek && QMPlayer::mPlayerHasOption("hr-seek")) {
+        l_args += "-hr-seek";
+        l_args += "on";
+    }
+    l_args += "-frames";
+    l_args += "1";
+
+    m_workers += l_worker;
+    l_worker->started.start();
+    l_worker->worker->start(l_args, a_request.url, m_size);
+
+    if (!m_reaper.isActive())
+        m_reaper.start();
+}
+
+QMPThumbnailer::Worker* QMPThumbnailer::workerFor(QObject* a_object) {
+    foreach (Worker* l_worker, m_workers) {
+        if (l_worker->worker == a_object) return l_worker;
+    }
+    return 0;
+}
+
+void QMPThumbnailer::reapWorkers() {
+    foreach (Worker* l_worker, m_workers) {
+        if (!l_worker->worker->isProcessDone() && (l_worker->started.elapsed() > m_timeout))
+            l_worker->worker->kill();
+    }
+
+    if (m_workers.isEmpty())
+        m_reaper.stop();
+}
+
+void QMPThumbnailer::workerImageReady(const QImage& a_image) {
+    Worker* l_worker = workerFor(sender());
+    if (l_worker) l_worker->image = a_image;
+}
+
+void QMPThumbnailer::workerFinished() {
+    Worker* l_worker = workerFor(sender());
+    if (l_worker) finishWorker(l_worker);
+}
+
+void QMPThumbnailer::finishWorker(Worker* a_worker) {
+    m_workers.removeAll(a_worker);
+    a_worker->worker->deleteLater();
+
+    QImage l_image = a_worker->image;
+    if (!l_image.isNull() && m_size.isValid()
+    &&  ((l_image.width() > m_size.width()) || (l_image.height() > m_size.height())))
+        l_image = l_image.scaled(m_size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+    emit thumbnailed(a_worker->request.url, a_worker->request.time, l_image);
+    delete a_worker;
+
+    m_dispatch.start();
+}
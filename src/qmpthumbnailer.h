@@ -0,0 +1,86 @@
+#ifndef QMPTHUMBNAILER_H
+#define QMPTHUMBNAILER_H
+
+#include <QObject>
+#include <QQueue>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QSize>
+
+class QMPYuvWorker;
+
+// Headless poster frames through a bounded pool of
+// "mplayer -ss <time> -frames 1 -vo yuv4mpeg" processes, one
+// QMPYuvWorker per request. mplayer scales to
+// the thumbnail size, so the conversion only ever sees small frames.
+class QMPThumbnailer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit QMPThumbnailer(QObject* a_parent = 0);
+    virtual ~QMPThumbnailer();
+
+    void setMaxWorkers(qint32 a_count);
+    qint32 maxWorkers() const;
+
+    void setTimeout(qint32 a_ms);
+    qint32 timeout() const;
+
+    // bounding box, the aspect ratio of the video is kept, invalid for
+    // the size of the video
+    void setSize(const QSize& a_size);
+    QSize size() const;
+
+    // the exact frame instead of the keyframe before it, slower; only
+    // mplayer2 and mpv have -hr-seek, with others this does nothing
+    void setPreciseSeek(bool a_precise);
+    bool preciseSeek() const;
+
+    void thumbnail(const QString& a_url, qreal a_time);
+    void thumbnail(const QString& a_url, const QList<qreal>& a_times);
+    void cancel();
+
+    qint32 pending() const;
+
+signals:
+    // a null image if there is no frame at a_time
+    void thumbnailed(const QString& a_url, qreal a_time, const QImage& a_image);
+    void finished();
+
+private slots:
+    void dispatch();
+    void reapWorkers();
+    void workerImageReady(const QImage& a_image);
+    void workerFinished();
+
+private:
+    struct Request {
+        QString url;
+        qreal time;
+    };
+
+    struct Worker {
+        QMPYuvWorker* worker;
+        Request request;
+        QImage image;
+        QElapsedTimer started;
+    };
+
+    Worker* workerFor(QObject* a_object);
+    void startWorker(const Request& a_request);
+    void finishWorker(Worker* a_worker);
+
+    QQueue<Request> m_queue;
+    QList<Worker*> m_workers;
+    qint32 m_maxWorkers;
+    qint32 m_timeout;
+    QSize m_size;
+    bool m_preciseSeek;
+
+    QTimer m_dispatch;
+    QTimer m_reaper;
+};
+
+#endif // QMPTHUMBNAILER_H
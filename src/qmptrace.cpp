@@ -0,0 +1,139 @@
+#include "qmptrace.h"
+#include <QIODevice>
+#include <string.h>
+
+namespace {
+
+const quint64 sc_maxRecord = 64 * 1024 * 1024;
+
+}
+
+const char QMPTrace::sc_magic[4] = { 'Q', 'M', 'P', 'T' };
+
+QMPTraceWriter::QMPTraceWriter(QIODevice* a_device) :
+    m_device(a_device), m_clock(), m_last(0), m_records(0), m_buffer()
+{
+}
+
+bool QMPTraceWriter::writeHeader() {
+    m_clock.start();
+    m_last = 0;
+
+    // magic, version, start time as ms since the epoch
+    m_buffer.clear();
+    m_buffer.append(QMPTrace::sc_magic, sizeof(QMPTrace::sc_magic));
+    m_buffer.append(char(QMPTrace::sc_version));
+    writeVarint(quint64(QDateTime::currentDateTime().toMSecsSinceEpoch()));
+
+    return m_device->write(m_buffer) == m_buffer.size();
+}
+
+bool QMPTraceWriter::write(QMPTrace::Stream a_stream, const QByteArray& a_data) {
+    return write(a_stream, a_data.constData(), a_data.size());
+}
+
+bool QMPTraceWriter::write(QMPTrace::Stream a_stream, const char* a_data, qint32 a_size) {
+    qint64 l_now = m_clock.nsecsElapsed() / 1000;
+
+    m_buffer.clear();
+    writeVarint((quint64(l_now - m_last) << 2) | quint64(a_stream));
+    writeVarint(quint64(a_size));
+    m_buffer.append(a_data, a_size);
+    m_last = l_now;
+    ++m_records;
+
+    return m_device->write(m_buffer) == m_buffer.size();
+}
+
+QIODevice* QMPTraceWriter::device() const {
+    return m_device;
+}
+
+qint64 QMPTraceWriter::records() const {
+    return m_records;
+}
+
+void QMPTraceWriter::writeVarint(quint64 a_value) {
+    while (a_value >= 0x80) {
+        m_buffer.append(char((a_value & 0x7f) | 0x80));
+        a_value >>= 7;
+    }
+    m_buffer.append(char(a_value));
+}
+
+
+QMPTraceReader::QMPTraceReader(QIODevice* a_device) :
+    m_device(a_device), m_startTime(), m_time(0), m_error()
+{
+}
+
+bool QMPTraceReader::readHeader() {
+    char l_magic[sizeof(QMPTrace::sc_magic) + 1];
+    if ((m_device->read(l_magic, sizeof(l_magic)) != sizeof(l_magic))
+    ||  (memcmp(l_magic, QMPTrace::sc_magic, sizeof(QMPTrace::sc_magic)) != 0)) {
+        m_error = "Not a trace";
+        return false;
+    }
+    if (quint8(l_magic[sizeof(QMPTrace::sc_magic)]) != QMPTrace::sc_version) {
+        m_error = QString("Unsupported trace version %1").arg(quint8(l_magic[sizeof(QMPTrace::sc_magic)]));
+        return false;
+    }
+
+    quint64 l_start;
+    if (!readVarint(&l_start)) {
+        m_error = "Truncated header";
+        return false;
+    }
+
+    m_startTime = QDateTime::fromMSecsSinceEpoch(qint64(l_start));
+    m_time = 0;
+    return true;
+}
+
+bool QMPTraceReader::next(QMPTrace::Record* a_record) {
+    quint64 l_key;
+    if (!readVarint(&l_key)) return false;
+
+    // a corrupt length must not turn into a huge allocation
+    quint64 l_size;
+    if (!readVarint(&l_size) || (l_size > sc_maxRecord)) {
+        if (m_error.isEmpty()) m_error = "Corrupt record";
+        return false;
+    }
+
+    a_record->data = m_device->read(qint64(l_size));
+    if (quint64(a_record->data.size()) != l_size) {
+        m_error = "Truncated record";
+        return false;
+    }
+
+    m_time += qint64(l_key >> 2);
+    a_record->time = m_time;
+    a_record->stream = QMPTrace::Stream(l_key & 0x3);
+    return true;
+}
+
+QDateTime QMPTraceReader::startTime() const {
+    return m_startTime;
+}
+
+QString QMPTraceReader::errorString() const {
+    return m_error;
+}
+
+bool QMPTraceReader::readVarint(quint64* a_value) {
+    *a_value = 0;
+    for (qint32 l_shift = 0; l_shift < 64; l_shift += 7) {
+        char l_byte;
+        if (!m_device->getChar(&l_byte)) {
+            if (l_shift > 0) m_error = "Truncated record";
+            return false;
+        }
+
+        *a_value |= quint64(uchar(l_byte) & 0x7f) << l_shift;
+        if (!(uchar(l_byte) & 0x80)) return true;
+    }
+
+    m_error = "Corrupt varint";
+    return false;
+}
@@ -0,0 +1,84 @@
+#ifndef QMPTRACE_H
+#define QMPTRACE_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QString>
+
+class QIODevice;
+
+// Slave protocol trace: a header followed by records of what went over
+// stdin, stdout and stderr, each a varint of the µs since the previous
+// record shifted left by two with the stream in the low bits, a varint
+// length and the raw bytes. A playing mplayer costs a few bytes per
+// status line.
+class QMPTrace
+{
+public:
+    enum Stream {
+        tsStdin = 0,
+        tsStdout,
+        tsStderr,
+        // process start/exit, written by the player
+        tsEvent
+    };
+
+    struct Record {
+        // µs since the trace was started
+        qint64 time;
+        Stream stream;
+        QByteArray data;
+    };
+
+    static const char sc_magic[4];
+    static const quint8 sc_version = 1;
+};
+
+class QMPTraceWriter
+{
+public:
+    // a_device has to be open for writing, it is not owned
+    explicit QMPTraceWriter(QIODevice* a_device);
+
+    bool writeHeader();
+    bool write(QMPTrace::Stream a_stream, const QByteArray& a_data);
+    bool write(QMPTrace::Stream a_stream, const char* a_data, qint32 a_size);
+
+    QIODevice* device() const;
+    qint64 records() const;
+
+private:
+    void writeVarint(quint64 a_value);
+
+    QIODevice* m_device;
+    QElapsedTimer m_clock;
+    qint64 m_last;
+    qint64 m_records;
+    QByteArray m_buffer;
+};
+
+class QMPTraceReader
+{
+public:
+    // a_device has to be open for reading, it is not owned
+    explicit QMPTraceReader(QIODevice* a_device);
+
+    bool readHeader();
+    // false at the end or on a truncated record, see errorString()
+    bool next(QMPTrace::Record* a_record);
+
+    // wall clock time the trace was started at
+    QDateTime startTime() const;
+    QString errorString() const;
+
+private:
+    bool readVarint(quint64* a_value);
+
+    QIODevice* m_device;
+    QDateTime m_startTime;
+    qint64 m_time;
+    QString m_error;
+};
+
+#endif // QMPTRACE_H
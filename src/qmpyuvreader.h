@@ -20,14 +20,21 @@
 #include <QImage>
 #include <QDir>
 #include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
 #include <QThread>
+#include <QAtomicInt>
+#include <QElapsedTimer>
 
 #ifdef Q_WS_WIN
  #include "windows.h"
 #endif
 
 #include <cstdio>
+#include <cstring>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 
 // Internal YUV pipe reader
@@ -38,20 +45,22 @@ class QMPYuvReader : public QThread
     public:
     	// Constructor
     	QMPYuvReader(QObject *parent = 0)
-    	    : QThread(parent), m_saveme(NULL), m_savemeSize(-1)
+    	    : QThread(parent), m_stop(false), m_maxQueued(0), m_dropFrames(false), m_saveme(NULL), m_savemeSize(-1)
     	{
-    	    // Create pipe in a temporary directory
-    	    char temp[12];
-    	    while (true) {
-    	    	strcpy(temp, "XXXXXX");
-    	    	mkdtemp(temp);
-    	    	strcat(temp, "/fifo");
-    	    	if (mkfifo(temp, 0600) == 0) {
-    	    	    break;
+    	    // Create pipe in a temporary directory, not the working one, which
+    	    // may be read-only for batch jobs
+    	    QByteArray temp = QFile::encodeName(QDir::temp().filePath("qmpyuv-XXXXXX"));
+    	    if (mkdtemp(temp.data()) != NULL) {
+    	    	temp += "/fifo";
+    	    	if (mkfifo(temp.constData(), 0600) == 0) {
+    	    	    m_pipe = QFile::decodeName(temp);
     	    	}
     	    }
-    	    m_pipe = temp;
 
+    	    for (int i = 0; i < 2; ++i) {
+    	    	memset(m_counters[i].values, 0, sizeof(m_counters[i].values));
+    	    }
+    	    m_clock.start();
     	    initTables();
     	}
 
@@ -72,11 +81,85 @@ class QMPYuvReader : public QThread
             if (isRunning()) {
                 m_mutex.lock();
                 m_stop = true;
+                m_notFull.wakeAll();
                 m_mutex.unlock();
                 wait();
+                m_stop = false;
             }
     	}
 
+    	// Pipeline counters, the ns ones are totals unless named last*.
+    	// queue is the time from conversion to imageReady().
+    	struct Stats {
+    	    qint64 framesRead;
+    	    qint64 framesConverted;
+    	    qint64 framesDelivered;
+    	    qint64 framesDropped;
+    	    qint64 readNs;
+    	    qint64 upsampleNs;
+    	    qint64 convertNs;
+    	    qint64 queueNs;
+    	    qint64 lastReadNs;
+    	    qint64 lastUpsampleNs;
+    	    qint64 lastConvertNs;
+    	    qint64 lastQueueNs;
+    	    qint64 maxQueueNs;
+    	};
+
+    	// Consistent snapshot of the counters, callable from any thread
+    	Stats stats() const
+    	{
+    	    qint64 values[2][cCount];
+    	    for (int i = 0; i < 2; ++i) {
+    	    	readCounters(m_counters[i], values[i]);
+    	    }
+
+    	    Stats s;
+    	    s.framesRead = values[wReader][cFramesRead];
+    	    s.framesConverted = values[wReader][cFramesConverted];
+    	    s.framesDropped = values[wReader][cFramesDropped];
+    	    s.readNs = values[wReader][cReadNs];
+    	    s.upsampleNs = values[wReader][cUpsampleNs];
+    	    s.convertNs = values[wReader][cConvertNs];
+    	    s.lastReadNs = values[wReader][cLastReadNs];
+    	    s.lastUpsampleNs = values[wReader][cLastUpsampleNs];
+    	    s.lastConvertNs = values[wReader][cLastConvertNs];
+    	    s.framesDelivered = values[wDelivery][cFramesDelivered];
+    	    s.queueNs = values[wDelivery][cQueueNs];
+    	    s.lastQueueNs = values[wDelivery][cLastQueueNs];
+    	    s.maxQueueNs = values[wDelivery][cMaxQueueNs];
+    	    return s;
+    	}
+
+    	// Frames that may wait for delivery, 0 (the default) for no limit. At
+    	// the limit the reader waits, or drops with setDropFrames(true).
+    	void setMaxQueuedFrames(int frames)
+    	{
+    	    QMutexLocker locker(&m_mutex);
+    	    m_maxQueued = qMax(0, frames);
+    	    m_notFull.wakeAll();
+    	}
+
+    	// Off by default, nothing is lost. On, a frame converted while the
+    	// queue is full replaces the oldest one, which counts as dropped; for
+    	// live display. Without a limit set dropping keeps the last two.
+    	void setDropFrames(bool drop)
+    	{
+    	    QMutexLocker locker(&m_mutex);
+    	    m_dropFrames = drop;
+    	    m_notFull.wakeAll();
+    	}
+
+    	// Unblocks a run() still waiting for a writer in fopen(), for when
+    	// mplayer exits without ever opening the pipe
+    	void release()
+    	{
+    	    int fd = open(QFile::encodeName(m_pipe).constData(), O_WRONLY | O_NONBLOCK);
+    	    if (fd >= 0) {
+    	    	close(fd);
+    	    }
+    	}
+
     protected:
     	// Main thread loop
     	void run()
@@ -113,15 +196,35 @@ class QMPYuvReader : public QThread
     	    	}
     	    	m_mutex.unlock();
 
-    	    	fread(yuv[0], 1, 6, f);
-    	    	fread(yuv[0], 1, ysize, f);
-    	    	fread(yuv[1], 1, csize, f);
-    	    	fread(yuv[2], 1, csize, f);
+    	    	qint64 start = m_clock.nsecsElapsed();
+    	    	// a short read is the end of the stream
+    	    	if ((fread(yuv[0], 1, 6, f) != 6)
+    	    	||  (fread(yuv[0], 1, ysize, f) != size_t(ysize))
+    	    	||  (fread(yuv[1], 1, csize, f) != size_t(csize))
+    	    	||  (fread(yuv[2], 1, csize, f) != size_t(csize))) {
+    	    	    break;
+    	    	}
+    	    	qint64 read = m_clock.nsecsElapsed();
     	    	supersample(yuv[1], width, height);
     	    	supersample(yuv[2], width, height);
+    	    	qint64 upsampled = m_clock.nsecsElapsed();
     	    	yuvToQImage(yuv, &image, width, height);
-
-    	    	emit imageReady(image);
+    	    	qint64 converted = m_clock.nsecsElapsed();
+
+    	    	bool dropped = enqueue(image, converted);
+
+    	    	CounterBlock &c = m_counters[wReader];
+    	    	beginWrite(c);
+    	    	c.values[cFramesRead] += 1;
+    	    	c.values[cFramesConverted] += 1;
+    	    	c.values[cFramesDropped] += dropped ? 1 : 0;
+    	    	c.values[cReadNs] += read - start;
+    	    	c.values[cUpsampleNs] += upsampled - read;
+    	    	c.values[cConvertNs] += converted - upsampled;
+    	    	c.values[cLastReadNs] = read - start;
+    	    	c.values[cLastUpsampleNs] = upsampled - read;
+    	    	c.values[cLastConvertNs] = converted - upsampled;
+    	    	endWrite(c);
     	    }
 
     	    delete[] yuv[0];
@@ -251,6 +354,105 @@ class QMPYuvReader : public QThread
     signals:
     	void imageReady(const QImage &image);
 
+    private slots:
+    	// Runs in the thread the reader belongs to
+    	void deliver()
+    	{
+    	    while (true) {
+    	    	m_mutex.lock();
+    	    	if (m_queue.isEmpty()) {
+    	    	    m_mutex.unlock();
+    	    	    break;
+    	    	}
+    	    	QueuedFrame frame = m_queue.dequeue();
+    	    	m_notFull.wakeOne();
+    	    	m_mutex.unlock();
+
+    	    	qint64 waited = m_clock.nsecsElapsed() - frame.converted;
+    	    	emit imageReady(frame.image);
+
+    	    	CounterBlock &c = m_counters[wDelivery];
+    	    	beginWrite(c);
+    	    	c.values[cFramesDelivered] += 1;
+    	    	c.values[cQueueNs] += waited;
+    	    	c.values[cLastQueueNs] = waited;
+    	    	c.values[cMaxQueueNs] = qMax(c.values[cMaxQueueNs], waited);
+    	    	endWrite(c);
+    	    }
+    	}
+
+    private:
+    	// Hands a frame to deliver(), returns true if an older one was dropped
+    	bool enqueue(const QImage &image, qint64 converted)
+    	{
+    	    QueuedFrame frame;
+    	    frame.image = image;
+    	    frame.converted = converted;
+
+    	    bool dropped = false;
+    	    m_mutex.lock();
+    	    while (!m_dropFrames && !m_stop && (m_maxQueued > 0) && (m_queue.count() >= m_maxQueued)) {
+    	    	m_notFull.wait(&m_mutex);
+    	    }
+    	    int limit = ((m_maxQueued == 0) && m_dropFrames) ? 2 : m_maxQueued;
+    	    bool wasEmpty = m_queue.isEmpty();
+    	    while ((limit > 0) && (m_queue.count() >= limit)) {
+    	    	m_queue.dequeue();
+    	    	dropped = true;
+    	    }
+    	    m_queue.enqueue(frame);
+    	    m_mutex.unlock();
+
+    	    if (wasEmpty) {
+    	    	QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+    	    }
+    	    return dropped;
+    	}
+
+    	// Counters come in two blocks, one written by the reader thread and
+    	// one by deliver(). A block is consistent when its sequence is even
+    	// and the same before and after copying it.
+    	enum Writer { wReader, wDelivery };
+    	enum Counter {
+    	    cFramesRead, cFramesConverted, cFramesDropped,
+    	    cReadNs, cUpsampleNs, cConvertNs, cLastReadNs, cLastUpsampleNs, cLastConvertNs,
+    	    cFramesDelivered, cQueueNs, cLastQueueNs, cMaxQueueNs,
+    	    cCount
+    	};
+    	struct CounterBlock {
+    	    QAtomicInt sequence;
+    	    qint64 values[cCount];
+    	};
+
+    	static void beginWrite(CounterBlock &block)
+    	{
+    	    block.sequence.fetchAndAddOrdered(1);
+    	}
+
+    	static void endWrite(CounterBlock &block)
+    	{
+    	    block.sequence.fetchAndAddRelease(1);
+    	}
+
+    	static void readCounters(CounterBlock &block, qint64 *values)
+    	{
+    	    while (true) {
+    	    	int before = block.sequence.fetchAndAddAcquire(0);
+    	    	if (before & 1) {
+    	    	    continue;
+    	    	}
+    	    	memcpy(values, (const void *)block.values, sizeof(block.values));
+    	    	if (block.sequence.fetchAndAddAcquire(0) == before) {
+    	    	    break;
+    	    	}
+    	    }
+    	}
+
+    	struct QueuedFrame {
+    	    QImage image;
+    	    qint64 converted;
+    	};
+
     public:
     	QString m_pipe;
 
@@ -258,6 +460,15 @@ class QMPYuvReader : public QThread
     	QMutex m_mutex;
     	bool m_stop;
 
+    	// Frames waiting for deliver(), guarded by m_mutex
+    	QQueue<QueuedFrame> m_queue;
+    	int m_maxQueued;
+    	bool m_dropFrames;
+    	QWaitCondition m_notFull;
+
+    	QElapsedTimer m_clock;
+    	mutable CounterBlock m_counters[2];
+
     	// Conversion tables
     	int RGB_Y[256];
     	int R_Cr[256];
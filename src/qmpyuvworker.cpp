@@ -0,0 +1,124 @@
+#include "qmpyuvworker.h"
+#include "qmplayer.h"
+#include "qmpyuvreader.h"
+
+QMPYuvWorker::QMPYuvWorker(QObject* a_parent) :
+    QObject(a_parent), m_process(new QProcess(this)), m_reader(new QMPYuvReader()),
+    m_processDone(false), m_readerDone(false), m_release()
+{
+    connect(m_process, SIGNAL(finished(int,QProcess::ExitStatus)), SLOT(processFinished(int, QProcess::ExitStatus)));
+    connect(m_process, SIGNAL(error(QProcess::ProcessError)), SLOT(processError(QProcess::ProcessError)));
+    connect(m_reader, SIGNAL(imageReady(QImage)), SIGNAL(imageReady(QImage)));
+    connect(m_reader, SIGNAL(finished()), SLOT(readerFinished()));
+
+    // a reader that was not in fopen() yet when its process died
+    m_release.setInterval(100);
+    connect(&m_release, SIGNAL(timeout()), SLOT(releaseReader()));
+}
+
+QMPYuvWorker::~QMPYuvWorker() {
+    stop();
+    // its deliver() may still be on the stack
+    m_reader->deleteLater();
+}
+
+QSize QMPYuvWorker::evenSize(const QSize& a_size) {
+    if (!a_size.isValid()) return QSize();
+    return QSize(qMax(2, a_size.width() & ~1), qMax(2, a_size.height() & ~1));
+}
+
+void QMPYuvWorker::setMaxQueuedFrames(qint32 a_frames) {
+    m_reader->setMaxQueuedFrames(a_frames);
+}
+
+void QMPYuvWorker::setDropFrames(bool a_drop) {
+    m_reader->setDropFrames(a_drop);
+}
+
+void QMPYuvWorker::start(const QStringList& a_args, const QString& a_url, const QSize& a_size) {
+    // dsize fits the box keeping the display aspect, scale=0:0 scales to it
+    QStringList l_args = a_args;
+    l_args += "-nosound";
+    l_args += "-vo";
+    l_args += "yuv4mpeg:file=" + m_reader->m_pipe;
+    if (a_size.isValid()) {
+        l_args += "-vf";
+        l_args += QString("dsize=%1:%2:0:2,scale=0:0").arg(a_size.width()).arg(a_size.height());
+    }
+    l_args += "-really-quiet";
+    l_args += "-noconfig";
+    l_args += "all";
+    l_args += a_url;
+
+    m_reader->start();
+    m_process->start(QMPlayer::mPlayerPath(), l_args);
+}
+
+void QMPYuvWorker::kill() {
+    m_process->kill();
+}
+
+void QMPYuvWorker::stop() {
+    m_release.stop();
+    m_process->disconnect(this);
+    m_reader->disconnect(this);
+
+    if (!m_processDone) {
+        m_process->kill();
+        m_process->waitForFinished();
+        m_processDone = true;
+    }
+
+    // dropping again, nothing delivers while we wait here
+    m_reader->setDropFrames(true);
+    // the reader may not have opened the pipe yet
+    while (!m_reader->wait(10)) {
+        m_reader->release();
+    }
+    m_readerDone = true;
+}
+
+Q_PID QMPYuvWorker::pid() const {
+    return m_process->pid();
+}
+
+bool QMPYuvWorker::isProcessDone() const {
+    return m_processDone;
+}
+
+void QMPYuvWorker::processFinished(int, QProcess::ExitStatus) {
+    // mplayer fails before opening the pipe for missing files
+    setProcessDone();
+}
+
+void QMPYuvWorker::processError(QProcess::ProcessError a_error) {
+    // there is no finished() for a process that never ran
+    if (a_error != QProcess::FailedToStart) return;
+
+    qWarning("QMPYuvWorker: cannot start %s", qPrintable(QMPlayer::mPlayerPath()));
+    setProcessDone();
+}
+
+void QMPYuvWorker::readerFinished() {
+    m_readerDone = true;
+    m_release.stop();
+    checkDone();
+}
+
+void QMPYuvWorker::releaseReader() {
+    m_reader->release();
+}
+
+void QMPYuvWorker::setProcessDone() {
+    m_processDone = true;
+    m_reader->release();
+    if (!m_readerDone)
+        m_release.start();
+    checkDone();
+}
+
+void QMPYuvWorker::checkDone() {
+    // the last imageReady() is delivered before the reader's finished()
+    if (m_processDone && m_readerDone)
+        emit finished();
+}
@@ -0,0 +1,65 @@
+#ifndef QMPYUVWORKER_H
+#define QMPYUVWORKER_H
+
+#include <QObject>
+#include <QProcess>
+#include <QStringList>
+#include <QTimer>
+#include <QImage>
+#include <QSize>
+
+class QMPYuvReader;
+
+// One "mplayer ... -vo yuv4mpeg:file=<pipe>" process and the QMPYuvReader
+// reading its pipe, the unit of work of QMPThumbnailer and
+// QMPSegmentedDecoder. finished() comes once both are done, after the
+// last imageReady(), also when mplayer failed or never ran.
+class QMPYuvWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit QMPYuvWorker(QObject* a_parent = 0);
+    virtual ~QMPYuvWorker();
+
+    // yuv4mpeg wants even dimensions, an invalid size stays invalid
+    static QSize evenSize(const QSize& a_size);
+
+    // the reader's queue, see QMPYuvReader, before start()
+    void setMaxQueuedFrames(qint32 a_frames);
+    void setDropFrames(bool a_drop);
+
+    // a_args select the input, e.g. -ss and -frames, the output options
+    // are added here; a_size is a bounding box, invalid for the video size
+    void start(const QStringList& a_args, const QString& a_url, const QSize& a_size);
+    // finished() still follows
+    void kill();
+    // kills and waits for both without emitting anything more; may be
+    // called from an imageReady() receiver, so delete with deleteLater()
+    void stop();
+
+    Q_PID pid() const;
+    bool isProcessDone() const;
+
+signals:
+    void imageReady(const QImage& a_image);
+    void finished();
+
+private slots:
+    void processFinished(int, QProcess::ExitStatus);
+    void processError(QProcess::ProcessError a_error);
+    void readerFinished();
+    void releaseReader();
+
+private:
+    void setProcessDone();
+    void checkDone();
+
+    QProcess* m_process;
+    QMPYuvReader* m_reader;
+    bool m_processDone;
+    bool m_readerDone;
+    QTimer m_release;
+};
+
+#endif // QMPYUVWORKER_H
@@ -0,0 +1,580 @@
+#include "fakemplayer.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace {
+
+// mplayer options without a value, every other option takes one
+const char* const sl_flags[] = {
+    "slave", "idle", "zoom", "noautosub", "framedrop", "fontconfig", "double", "noquiet", "quiet",
+    "really-quiet", "identify", "nosound", "novideo", "fs", "nocache", "noconsolecontrols", "nolirc"
+};
+
+bool isFlag(const QString& a_option) {
+    for (qint32 i = 0; i < qint32(sizeof(sl_flags) / sizeof(sl_flags[0])); ++i) {
+        if (a_option == sl_flags[i]) return true;
+    }
+    return false;
+}
+
+}
+
+bool FakeMPlayer::parseArguments(const QStringList& a_args, FakeMPlayer::Options* a_options, QString* a_error) {
+    for (qint32 i = 0; i < a_args.count(); ++i) {
+        const QString& l_arg = a_args[i];
+
+        if (!l_arg.startsWith('-') || (l_arg == "-")) {
+            a_options->files += l_arg;
+            continue;
+        }
+
+        QString l_option = l_arg.mid(1);
+        if (isFlag(l_option)) {
+            if (l_option == "idle")
+                a_options->idle = true;
+            continue;
+        }
+
+        if (i + 1 >= a_args.count()) {
+            *a_error = QString("Option %1 requires a value").arg(l_arg);
+            return false;
+        }
+        QString l_value = a_args[++i];
+        bool l_ok = true;
+
+        if (l_option == "vo") {
+            // the last output of the list that writes a stream wins
+            foreach (const QString& l_output, l_value.split(',', QString::SkipEmptyParts)) {
+                if (l_output.startsWith("yuv4mpeg"))
+                    a_options->yuvPath = l_output.contains(":file=") ? l_output.section(":file=", 1) : "stream.yuv";
+            }
+        } else if (l_option == "fake-status-rate") {
+            a_options->statusRate = l_value.toDouble(&l_ok);
+        } else if (l_option == "fake-identify-rate") {
+            a_options->identifyRate = l_value.toDouble(&l_ok);
+        } else if (l_option == "fake-length") {
+            a_options->length = l_value.toDouble(&l_ok);
+        } else if (l_option == "fake-load-delay") {
+            a_options->loadDelay = l_value.toInt(&l_ok);
+        } else if (l_option == "fake-latency") {
+            a_options->replyLatency = l_value.toInt(&l_ok);
+        } else if (l_option == "fake-crash-at") {
+            a_options->crashAt = l_value.toDouble(&l_ok);
+        } else if (l_option == "fake-stall-at") {
+            a_options->stallAt = l_value.toDouble(&l_ok);
+        } else if (l_option == "fake-script") {
+            a_options->script = l_value;
+        } else if (l_option == "fake-yuv-fps") {
+            a_options->yuvFps = l_value.toDouble(&l_ok);
+        } else if (l_option == "fake-yuv-size") {
+            QStringList l_size = l_value.split('x');
+            l_ok = (l_size.count() == 2);
+            if (l_ok) {
+                a_options->yuvWidth = l_size[0].toInt(&l_ok);
+                if (l_ok) a_options->yuvHeight = l_size[1].toInt(&l_ok);
+            }
+            // 4:2:0 needs even dimensions
+            l_ok = l_ok && (a_options->yuvWidth > 0) && (a_options->yuvHeight > 0)
+                && !(a_options->yuvWidth % 2) && !(a_options->yuvHeight % 2);
+        }
+
+        if (!l_ok) {
+            *a_error = QString("Invalid value for %1: %2").arg(l_arg).arg(l_value);
+            return false;
+        }
+    }
+
+    if ((a_options->statusRate <= 0) || (a_options->yuvFps <= 0) || (a_options->length <= 0)) {
+        *a_error = "Rates and length must be positive";
+        return false;
+    }
+    return true;
+}
+
+FakeMPlayer::FakeMPlayer(const FakeMPlayer::Options& a_options, QObject* a_parent) :
+    QObject(a_parent), m_options(a_options), m_stdin(0), m_input(), m_clock(), m_output(), m_flush(),
+    m_url(), m_playlist(), m_loaded(false), m_playing(false), m_paused(false), m_basePosition(0), m_baseTime(0),
+    m_frames(0), m_startPlayback(), m_status(), m_properties(), m_yuv(-1), m_frame(), m_frameData()
+{
+    m_clock.start();
+
+    m_flush.setSingleShot(true);
+    connect(&m_flush, SIGNAL(timeout()), SLOT(flushOutput()));
+
+    m_startPlayback.setSingleShot(true);
+    connect(&m_startPlayback, SIGNAL(timeout()), SLOT(startPlayback()));
+
+    m_status.setInterval(qMax(1, qRound(1000 / m_options.statusRate)));
+    connect(&m_status, SIGNAL(timeout()), SLOT(printStatus()));
+
+    m_frame.setInterval(qMax(1, qRound(1000 / m_options.yuvFps)));
+    connect(&m_frame, SIGNAL(timeout()), SLOT(writeFrame()));
+
+    m_properties["volume"] = "100.000000";
+    m_properties["mute"] = "no";
+    m_properties["audio_delay"] = "0.000000";
+    m_properties["speed"] = "1.00";
+    m_properties["brightness"] = "0";
+    m_properties["contrast"] = "0";
+    m_properties["gamma"] = "0";
+    m_properties["hue"] = "0";
+    m_properties["saturation"] = "0";
+}
+
+FakeMPlayer::~FakeMPlayer() {
+    closeYuv();
+}
+
+bool FakeMPlayer::start() {
+    if (m_options.files.isEmpty() && !m_options.idle) {
+        printError("No file given and -idle not set");
+        return false;
+    }
+
+    print("MPlayer fake (qmplayer slave protocol stand-in)");
+
+    m_stdin = new QSocketNotifier(STDIN_FILENO, QSocketNotifier::Read, this);
+    connect(m_stdin, SIGNAL(activated(int)), SLOT(readCommands()));
+
+    if (!m_options.files.isEmpty()) {
+        m_playlist = m_options.files;
+        load(m_playlist.takeFirst());
+    }
+    return true;
+}
+
+void FakeMPlayer::readCommands() {
+    char l_buffer[4096];
+    ssize_t l_read = ::read(STDIN_FILENO, l_buffer, sizeof(l_buffer));
+    if (l_read < 0) {
+        if (errno == EINTR || errno == EAGAIN) return;
+        quit(1);
+        return;
+    }
+    if (l_read == 0) {
+        // the controller went away
+        m_stdin->setEnabled(false);
+        quit(0);
+        return;
+    }
+
+    m_input.append(l_buffer, l_read);
+    qint32 l_end;
+    while ((l_end = m_input.indexOf('\n')) >= 0) {
+        QString l_command = QString::fromUtf8(m_input.constData(), l_end).trimmed();
+        m_input.remove(0, l_end + 1);
+        if (!l_command.isEmpty())
+            execute(l_command);
+    }
+}
+
+void FakeMPlayer::execute(const QString& a_command) {
+    QStringList l_words = a_command.split(' ', QString::SkipEmptyParts);
+
+    // the pausing prefixes only matter for whether playback resumes
+    QString l_prefix;
+    if (l_words.first().startsWith("pausing")) {
+        l_prefix = l_words.takeFirst();
+        if (l_words.isEmpty()) return;
+    }
+
+    QString l_name = l_words.takeFirst();
+    QString l_arg = l_words.value(0);
+    bool l_wasPaused = m_paused;
+
+    if (l_name == "loadfile") {
+        QString l_url = a_command.section(' ', l_prefix.isEmpty() ? 1 : 2);
+        bool l_append = false;
+        // loadfile 'url' 1
+        if (l_url.startsWith('\'')) {
+            qint32 l_close = l_url.lastIndexOf('\'');
+            l_append = (l_url.mid(l_close + 1).trimmed().toInt() != 0);
+            l_url = l_url.mid(1, l_close - 1);
+        } else if (l_words.count() > 1) {
+            l_append = (l_words.last().toInt() != 0);
+            l_url = l_url.section(' ', 0, -2);
+        }
+
+        if (l_append && m_loaded) {
+            m_playlist += l_url;
+        } else {
+            m_playlist.clear();
+            load(l_url);
+        }
+    } else if (l_name == "pause") {
+        setPaused(!m_paused);
+        return;
+    } else if (l_name == "frame_step") {
+        if (m_playing) {
+            setPosition(position() + 1 / m_options.yuvFps);
+            print(statusLine());
+        }
+        setPaused(true);
+        return;
+    } else if (l_name == "stop") {
+        stopPlayback();
+    } else if (l_name == "seek") {
+        seek(l_arg.toDouble(), l_words.value(1).toInt());
+    } else if (l_name == "pt_step") {
+        if (!m_playlist.isEmpty())
+            load(m_playlist.takeFirst());
+    } else if (l_name == "get_property") {
+        getProperty(l_arg);
+    } else if (l_name == "set_property") {
+        if (m_properties.contains(l_arg))
+            m_properties[l_arg] = l_words.value(1);
+        else
+            reply("ANS_ERROR=PROPERTY_UNKNOWN");
+    } else if (l_name == "get_time_pos") {
+        reply(m_loaded ? QString("ANS_TIME_POSITION=%1").arg(position(), 0, 'f', 1) : "ANS_ERROR=PROPERTY_UNAVAILABLE");
+    } else if (l_name == "get_time_length") {
+        reply(m_loaded ? QString("ANS_LENGTH=%1").arg(m_options.length, 0, 'f', 2) : "ANS_ERROR=PROPERTY_UNAVAILABLE");
+    } else if (l_name == "get_percent_pos") {
+        reply(m_loaded ? QString("ANS_PERCENT_POSITION=%1").arg(qint32(100 * position() / m_options.length)) : "ANS_ERROR=PROPERTY_UNAVAILABLE");
+    } else if (l_name == "get_file_name") {
+        reply(m_loaded ? QString("ANS_FILENAME='%1'").arg(QFileInfo(m_url).fileName()) : "ANS_ERROR=PROPERTY_UNAVAILABLE");
+    } else if ((l_name == "volume") || (l_name == "brightness") || (l_name == "contrast") || (l_name == "gamma")
+           ||  (l_name == "hue") || (l_name == "saturation") || (l_name == "audio_delay")) {
+        // [abs] set, else adjust
+        qreal l_value = l_arg.toDouble();
+        if (l_words.value(1).toInt() == 0)
+            l_value += m_properties.value(l_name).toDouble();
+        m_properties[l_name] = QString::number(l_value, 'f', (l_name == "volume" || l_name == "audio_delay") ? 6 : 0);
+    } else if (l_name == "mute") {
+        bool l_mute = l_words.isEmpty() ? (m_properties["mute"] == "no") : (l_arg.toInt() != 0);
+        m_properties["mute"] = l_mute ? "yes" : "no";
+    } else if (l_name == "quit") {
+        quit(l_arg.toInt());
+        return;
+    } else if ((l_name == "osd") || (l_name == "osd_show_text") || (l_name == "vo_fullscreen")) {
+        // nothing on screen to change
+    } else {
+        printError(QString("Command %1 is not supported by the fake player").arg(l_name));
+    }
+
+    // any other command resumes playback unless a prefix says otherwise
+    if (!m_paused || !m_playing) return;
+    if (l_prefix.isEmpty())
+        setPaused(false);
+    else if (l_prefix == "pausing_toggle")
+        setPaused(!l_wasPaused);
+}
+
+void FakeMPlayer::load(const QString& a_url) {
+    stopPlayback();
+
+    // "fake:" urls always exist, anything else has to be a real file
+    if (!a_url.startsWith("fake:") && !QFile::exists(a_url)) {
+        print(QString("File not found: '%1'").arg(a_url));
+        print("Failed to open " + a_url + ".");
+        return;
+    }
+
+    m_url = a_url;
+    m_loaded = true;
+    print(QString("Playing %1.").arg(a_url));
+
+    qint32 l_delay = 0;
+    foreach (const QString& l_line, identifyLines()) {
+        print(l_line, l_delay);
+        if (m_options.identifyRate > 0)
+            l_delay += qRound(1000 / m_options.identifyRate);
+    }
+
+    m_startPlayback.start(qMax(l_delay, m_options.loadDelay) + m_options.replyLatency);
+}
+
+void FakeMPlayer::startPlayback() {
+    print("Starting playback...");
+
+    m_playing = true;
+    m_paused = false;
+    m_frames = 0;
+    setPosition(0);
+    m_status.start();
+
+    if (!m_options.yuvPath.isEmpty())
+        m_frame.start();
+}
+
+void FakeMPlayer::printStatus() {
+    qreal l_position = position();
+
+    if ((m_options.crashAt >= 0) && (l_position >= m_options.crashAt)) {
+        printError("MPlayer interrupted by signal 11 in module: decode_video");
+        ::abort();
+    }
+    if (l_position >= m_options.length) {
+        endOfFile();
+        return;
+    }
+
+    print(statusLine());
+}
+
+void FakeMPlayer::writeFrame() {
+    if (!m_playing || m_paused) return;
+    if ((m_yuv < 0) && !openYuv()) return;
+
+    const qint32 l_ysize = m_options.yuvWidth * m_options.yuvHeight;
+    if (m_frameData.isEmpty()) {
+        m_frameData = QByteArray("FRAME\n") + QByteArray(l_ysize, 0) + QByteArray(l_ysize / 2, char(128));
+    }
+
+    // a diagonal bar moving one pixel per frame
+    char* l_y = m_frameData.data() + 6;
+    for (qint32 y = 0; y < m_options.yuvHeight; ++y) {
+        for (qint32 x = 0; x < m_options.yuvWidth; ++x)
+            *l_y++ = char(((x + y + m_frames) % 64) < 8 ? 235 : 16 + (x * 219) / m_options.yuvWidth);
+    }
+    ++m_frames;
+
+    const char* l_data = m_frameData.constData();
+    qint64 l_left = m_frameData.size();
+    while (l_left > 0) {
+        ssize_t l_written = ::write(m_yuv, l_data, l_left);
+        if (l_written < 0) {
+            if (errno == EINTR) continue;
+            // the reader is gone, wait for the next one
+            closeYuv();
+            return;
+        }
+        l_data += l_written;
+        l_left -= l_written;
+    }
+}
+
+void FakeMPlayer::flushOutput() {
+    qint64 l_now = m_clock.elapsed();
+    while (!m_output.isEmpty() && (m_output.first().due <= l_now)) {
+        write(m_output.takeFirst());
+    }
+    if (!m_output.isEmpty())
+        m_flush.start(qMax<qint64>(0, m_output.first().due - l_now));
+}
+
+void FakeMPlayer::stopPlayback() {
+    m_startPlayback.stop();
+    m_status.stop();
+    m_frame.stop();
+    m_playing = false;
+    m_paused = false;
+    m_loaded = false;
+    setPosition(0);
+}
+
+void FakeMPlayer::endOfFile() {
+    stopPlayback();
+    print("");
+    print("EOF code: 1  ");
+
+    if (!m_playlist.isEmpty()) {
+        load(m_playlist.takeFirst());
+        return;
+    }
+
+    if (!m_options.idle) {
+        print("");
+        print("Exiting... (End of file)");
+        print("ID_EXIT=EOF");
+        quit(0);
+    }
+}
+
+void FakeMPlayer::setPaused(bool a_paused) {
+    if (!m_playing || (a_paused == m_paused)) return;
+
+    setPosition(position());
+    m_paused = a_paused;
+    if (m_paused) {
+        m_status.stop();
+        print("ID_PAUSED");
+    } else {
+        m_status.start();
+    }
+}
+
+void FakeMPlayer::seek(qreal a_value, qint32 a_type) {
+    if (!m_playing) return;
+
+    qreal l_target = a_value;
+    if (a_type == 0)
+        l_target += position();
+    else if (a_type == 1)
+        l_target = m_options.length * a_value / 100;
+
+    setPosition(qBound<qreal>(0, l_target, m_options.length));
+    // mplayer prints the new position with the next frame
+    print(statusLine(), m_options.replyLatency);
+}
+
+void FakeMPlayer::getProperty(const QString& a_name) {
+    QString l_value;
+
+    if (a_name == "time_pos") {
+        if (m_loaded) l_value = QString::number(position(), 'f', 6);
+    } else if (a_name == "length") {
+        if (m_loaded) l_value = QString::number(m_options.length, 'f', 6);
+    } else if (a_name == "percent_pos") {
+        if (m_loaded) l_value = QString::number(qint32(100 * position() / m_options.length));
+    } else if (a_name == "pause") {
+        l_value = m_paused ? "yes" : "no";
+    } else if ((a_name == "filename") || (a_name == "path")) {
+        if (m_loaded) l_value = (a_name == "path") ? m_url : QFileInfo(m_url).fileName();
+    } else if (a_name == "demuxer") {
+        if (m_loaded) l_value = "fake";
+    } else if (m_properties.contains(a_name)) {
+        l_value = m_properties.value(a_name);
+    } else {
+        printError(QString("Failed to get value of property '%1'.").arg(a_name));
+        reply("ANS_ERROR=PROPERTY_UNKNOWN");
+        return;
+    }
+
+    // like mplayer a warning on stderr, which arrives first, and the
+    // answer on stdout
+    if (l_value.isNull()) {
+        printError(QString("Failed to get value of property '%1'.").arg(a_name));
+        reply("ANS_ERROR=PROPERTY_UNAVAILABLE");
+    } else
+        reply(QString("ANS_%1=%2").arg(a_name).arg(l_value));
+}
+
+void FakeMPlayer::quit(qint32 a_code) {
+    stopPlayback();
+    print("");
+    print("Exiting... (Quit)");
+
+    // whatever is still delayed goes out now
+    while (!m_output.isEmpty())
+        write(m_output.takeFirst());
+    closeYuv();
+
+    QCoreApplication::exit(a_code);
+}
+
+QStringList FakeMPlayer::identifyLines() const {
+    QStringList l_lines;
+
+    if (!m_options.script.isEmpty()) {
+        QFile l_file(m_options.script);
+        if (l_file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            QTextStream l_in(&l_file);
+            while (!l_in.atEnd()) {
+                QString l_line = l_in.readLine();
+                if (l_line.startsWith('#')) continue;
+                l_lines += l_line.replace("%FILE%", m_url).replace("%LENGTH%", QString::number(m_options.length, 'f', 2));
+            }
+            return l_lines;
+        }
+    }
+
+    l_lines << "ID_VIDEO_ID=0" << "ID_AUDIO_ID=0" << "ID_AID_0_LANG=eng"
+            << "ID_FILENAME=" + m_url << "ID_DEMUXER=fake"
+            << "ID_VIDEO_FORMAT=I420" << "ID_VIDEO_BITRATE=0"
+            << QString("ID_VIDEO_WIDTH=%1").arg(m_options.yuvWidth) << QString("ID_VIDEO_HEIGHT=%1").arg(m_options.yuvHeight)
+            << QString("ID_VIDEO_FPS=%1").arg(m_options.yuvFps, 0, 'f', 3) << "ID_VIDEO_ASPECT=0.0000"
+            << "ID_AUDIO_FORMAT=1" << "ID_AUDIO_BITRATE=1411200" << "ID_AUDIO_RATE=44100" << "ID_AUDIO_NCH=2"
+            << "ID_START_TIME=0.00" << QString("ID_LENGTH=%1").arg(m_options.length, 0, 'f', 2)
+            << "ID_SEEKABLE=1" << "ID_CHAPTERS=0"
+            << "ID_VIDEO_CODEC=rawi420" << "ID_AUDIO_CODEC=pcm";
+    return l_lines;
+}
+
+QString FakeMPlayer::statusLine() const {
+    qreal l_position = position();
+    return QString("A:%1 V:%1 A-V:  0.000 ct:  0.000 %2/%2  1%  0%  0.1% 0 0 ")
+        .arg(l_position, 6, 'f', 1).arg(qint32(l_position * m_options.yuvFps), 4);
+}
+
+qreal FakeMPlayer::position() const {
+    if (!m_playing || m_paused)
+        return m_basePosition;
+
+    qreal l_position = m_basePosition + (m_clock.elapsed() - m_baseTime) / 1000.0;
+    // a stalled decoder keeps printing the same position
+    if ((m_options.stallAt >= 0) && (m_basePosition <= m_options.stallAt))
+        l_position = qMin(l_position, m_options.stallAt);
+    return l_position;
+}
+
+void FakeMPlayer::setPosition(qreal a_position) {
+    m_basePosition = a_position;
+    m_baseTime = m_clock.elapsed();
+}
+
+void FakeMPlayer::print(const QString& a_line, qint32 a_delay) {
+    Output l_output;
+    l_output.due = m_clock.elapsed() + a_delay;
+    l_output.data = a_line.toUtf8() + '\n';
+    l_output.error = false;
+
+    // keep the order, nothing overtakes a line that was delayed
+    if (m_output.isEmpty() && (a_delay <= 0)) {
+        write(l_output);
+        return;
+    }
+    if (!m_output.isEmpty())
+        l_output.due = qMax(l_output.due, m_output.last().due);
+    m_output += l_output;
+    if (!m_flush.isActive())
+        m_flush.start(qMax<qint64>(0, m_output.first().due - m_clock.elapsed()));
+}
+
+void FakeMPlayer::printError(const QString& a_line) {
+    Output l_output;
+    l_output.due = 0;
+    l_output.data = a_line.toUtf8() + '\n';
+    l_output.error = true;
+    write(l_output);
+}
+
+void FakeMPlayer::reply(const QString& a_line) {
+    print(a_line, m_options.replyLatency);
+}
+
+void FakeMPlayer::write(const FakeMPlayer::Output& a_output) {
+    int l_fd = a_output.error ? STDERR_FILENO : STDOUT_FILENO;
+    const char* l_data = a_output.data.constData();
+    qint64 l_left = a_output.data.size();
+
+    while (l_left > 0) {
+        ssize_t l_written = ::write(l_fd, l_data, l_left);
+        if (l_written < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        l_data += l_written;
+        l_left -= l_written;
+    }
+}
+
+bool FakeMPlayer::openYuv() {
+    QByteArray l_path = QFile::encodeName(m_options.yuvPath);
+
+    // a fifo without a reader fails with ENXIO, the next frame tries again
+    m_yuv = ::open(l_path.constData(), O_WRONLY | O_NONBLOCK | O_CREAT, 0600);
+    if (m_yuv < 0) return false;
+    ::fcntl(m_yuv, F_SETFL, ::fcntl(m_yuv, F_GETFL) & ~O_NONBLOCK);
+
+    QByteArray l_header = QString("YUV4MPEG2 W%1 H%2 F%3:1 Ip A1:1\n")
+        .arg(m_options.yuvWidth).arg(m_options.yuvHeight).arg(qRound(m_options.yuvFps)).toAscii();
+    if (::write(m_yuv, l_header.constData(), l_header.size()) != l_header.size()) {
+        closeYuv();
+        return false;
+    }
+    return true;
+}
+
+void FakeMPlayer::closeYuv() {
+    if (m_yuv < 0) return;
+
+    ::close(m_yuv);
+    m_yuv = -1;
+}
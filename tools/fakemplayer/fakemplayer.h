@@ -0,0 +1,121 @@
+#ifndef FAKEMPLAYER_H
+#define FAKEMPLAYER_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QHash>
+#include <QList>
+#include <QSocketNotifier>
+
+// Stand-in for "mplayer -slave": reads slave commands from stdin and
+// answers with the same ID_, status and ANS_ lines mplayer prints,
+// without decoding anything. Every "file" plays for a fixed length, the
+// rates and delays of the output come from the -fake-* options.
+class FakeMPlayer : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options {
+        // status lines per second while playing
+        qreal statusRate;
+        // ID_ lines per second, 0 prints the block at once
+        qreal identifyRate;
+        // length of every file in seconds
+        qreal length;
+        // from "Playing" to "Starting playback..."
+        qint32 loadDelay;
+        // delay of every answer to a command
+        qint32 replyLatency;
+        // the process aborts / positions stop advancing at this position, < 0 never
+        qreal crashAt;
+        qreal stallAt;
+        // lines printed instead of the built-in ID_ block
+        QString script;
+        // -vo yuv4mpeg:file=...
+        QString yuvPath;
+        qint32 yuvWidth;
+        qint32 yuvHeight;
+        qreal yuvFps;
+        bool idle;
+        QStringList files;
+
+        Options() : statusRate(25), identifyRate(0), length(60), loadDelay(100), replyLatency(0), crashAt(-1),
+            stallAt(-1), script(), yuvPath(), yuvWidth(320), yuvHeight(240), yuvFps(25), idle(false), files() {}
+    };
+
+    // mplayer's own options are accepted and ignored
+    static bool parseArguments(const QStringList& a_args, FakeMPlayer::Options* a_options, QString* a_error);
+
+public:
+    explicit FakeMPlayer(const FakeMPlayer::Options& a_options, QObject* a_parent = 0);
+    virtual ~FakeMPlayer();
+
+    bool start();
+
+private slots:
+    void readCommands();
+    void startPlayback();
+    void printStatus();
+    void writeFrame();
+    void flushOutput();
+
+private:
+    struct Output {
+        qint64 due;
+        QByteArray data;
+        bool error;
+    };
+
+    void execute(const QString& a_command);
+    void load(const QString& a_url);
+    void stopPlayback();
+    void endOfFile();
+    void setPaused(bool a_paused);
+    void seek(qreal a_value, qint32 a_type);
+    void getProperty(const QString& a_name);
+    void quit(qint32 a_code);
+
+    QStringList identifyLines() const;
+    QString statusLine() const;
+    qreal position() const;
+    void setPosition(qreal a_position);
+
+    // a_delay is added to the reply latency
+    void print(const QString& a_line, qint32 a_delay = 0);
+    void printError(const QString& a_line);
+    void reply(const QString& a_line);
+    void write(const Output& a_output);
+
+    bool openYuv();
+    void closeYuv();
+
+    Options m_options;
+    QSocketNotifier* m_stdin;
+    QByteArray m_input;
+
+    QElapsedTimer m_clock;
+    QList<Output> m_output;
+    QTimer m_flush;
+
+    QString m_url;
+    QStringList m_playlist;
+    bool m_loaded;
+    bool m_playing;
+    bool m_paused;
+    qreal m_basePosition;
+    qint64 m_baseTime;
+    qint32 m_frames;
+    QTimer m_startPlayback;
+    QTimer m_status;
+
+    QHash<QString, QString> m_properties;
+
+    int m_yuv;
+    QTimer m_frame;
+    QByteArray m_frameData;
+};
+
+#endif // FAKEMPLAYER_H
@@ -0,0 +1,19 @@
+#
+#  qmplayer - A Qt controller for embedding MPlayer
+#  Copyright (C) 2010 by Jonas Gehring
+#
+
+# Stand-in for the mplayer binary, point QMPlayer::setMPlayerPath() at it
+# to run players without decoding. Unix only, it reads stdin through a
+# socket notifier.
+
+TEMPLATE = app
+TARGET = fakemplayer
+DESTDIR = ../..
+
+QT -= gui
+CONFIG += console
+CONFIG -= app_bundle
+
+HEADERS += fakemplayer.h
+SOURCES += fakemplayer.cpp main.cpp
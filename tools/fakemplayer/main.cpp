@@ -0,0 +1,40 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <signal.h>
+#include <stdio.h>
+#include "fakemplayer.h"
+
+// Usage: fakemplayer [mplayer options] [-fake-* options] [files]
+//
+//   -fake-status-rate <n>    status lines per second (25)
+//   -fake-identify-rate <n>  ID_ lines per second, 0 prints them at once (0)
+//   -fake-length <s>         length of every file (60)
+//   -fake-load-delay <ms>    "Playing" to "Starting playback..." (100)
+//   -fake-latency <ms>       delay of every ANS_ reply and seek (0)
+//   -fake-crash-at <s>       abort at this position
+//   -fake-stall-at <s>       stop advancing at this position
+//   -fake-script <file>      ID_ lines to print on load, %FILE% and %LENGTH% are replaced
+//   -fake-yuv-size <WxH>     frames written for -vo yuv4mpeg:file=<path> (320x240)
+//   -fake-yuv-fps <n>        (25)
+//
+// Files named "fake:<anything>" always exist.
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    // a yuv4mpeg reader closing the fifo must not kill us
+    signal(SIGPIPE, SIG_IGN);
+
+    FakeMPlayer::Options l_options;
+    QString l_error;
+    if (!FakeMPlayer::parseArguments(app.arguments().mid(1), &l_options, &l_error)) {
+        fprintf(stderr, "%s\n", qPrintable(l_error));
+        return 1;
+    }
+
+    FakeMPlayer l_player(l_options);
+    if (!l_player.start())
+        return 1;
+
+    return app.exec();
+}
@@ -0,0 +1,80 @@
+#include <QCoreApplication>
+#include <QFile>
+#include <QStringList>
+#include <stdio.h>
+#include "tracereplay.h"
+
+// Usage: qmpreplay [-realtime] [-passes n] [-v] <trace>
+//
+// Replays a trace from QMPlayer::startTrace() into the parsers. With -v
+// every line and the player's reactions are printed with their time,
+// which is what reproducing a bug needs. Without -realtime the trace is
+// parsed as fast as possible and the throughput printed at the end.
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    bool l_realtime = false;
+    bool l_verbose = false;
+    qint32 l_passes = 1;
+    QString l_path;
+
+    QStringList l_args = app.arguments().mid(1);
+    for (qint32 i = 0; i < l_args.count(); ++i) {
+        if (l_args[i] == "-realtime") {
+            l_realtime = true;
+        } else if (l_args[i] == "-v") {
+            l_verbose = true;
+        } else if ((l_args[i] == "-passes") && (i + 1 < l_args.count())) {
+            l_passes = l_args[++i].toInt();
+        } else if (!l_args[i].startsWith('-') && l_path.isEmpty()) {
+            l_path = l_args[i];
+        } else {
+            l_path.clear();
+            break;
+        }
+    }
+    if (l_path.isEmpty()) {
+        fprintf(stderr, "Usage: qmpreplay [-realtime] [-passes n] [-v] <trace>\n");
+        return 1;
+    }
+
+    QFile l_file(l_path);
+    if (!l_file.open(QIODevice::ReadOnly)) {
+        fprintf(stderr, "%s: %s\n", qPrintable(l_path), qPrintable(l_file.errorString()));
+        return 1;
+    }
+
+    // read it all first, the file I/O is not what is measured
+    QMPTraceReader l_reader(&l_file);
+    if (!l_reader.readHeader()) {
+        fprintf(stderr, "%s: %s\n", qPrintable(l_path), qPrintable(l_reader.errorString()));
+        return 1;
+    }
+    QList<QMPTrace::Record> l_records;
+    QMPTrace::Record l_record;
+    while (l_reader.next(&l_record)) {
+        l_records += l_record;
+    }
+    if (!l_reader.errorString().isEmpty())
+        fprintf(stderr, "%s: %s, replaying %d records\n", qPrintable(l_path), qPrintable(l_reader.errorString()), l_records.count());
+
+    TraceReplay l_replay(l_records);
+    l_replay.setRealtime(l_realtime);
+    l_replay.setVerbose(l_verbose);
+    l_replay.setPasses(l_passes);
+    QObject::connect(&l_replay, SIGNAL(finished()), &app, SLOT(quit()));
+
+    printf("trace of %s, %d records\n", qPrintable(l_reader.startTime().toString(Qt::ISODate)), l_records.count());
+    l_replay.start();
+    app.exec();
+
+    const TraceReplay::Stats& l_stats = l_replay.stats();
+    double l_seconds = qMax<qint64>(l_stats.nsecs, 1) / 1e9;
+    printf("%lld records, %lld lines, %lld bytes in %.3f s: %.0f lines/s, %.2f MB/s, final state %d\n",
+           l_stats.records, l_stats.lines, l_stats.bytes, l_seconds, l_stats.lines / l_seconds,
+           l_stats.bytes / l_seconds / (1024 * 1024), int(l_replay.player()->state()));
+    printf("%lld queries, %lld replies, %d unanswered\n",
+           l_stats.queries, l_stats.replies, l_replay.player()->pendingQueries());
+    return 0;
+}
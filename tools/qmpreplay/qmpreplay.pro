@@ -0,0 +1,20 @@
+#
+#  qmplayer - A Qt controller for embedding MPlayer
+#  Copyright (C) 2010 by Jonas Gehring
+#
+
+# Feeds a trace recorded with QMPlayer::startTrace() into the parsers
+TEMPLATE = app
+TARGET = qmpreplay
+DESTDIR = ../..
+
+QT += network
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../../src
+QMAKE_LIBDIR += ../..
+LIBS += -lqmplayer
+
+HEADERS += tracereplay.h
+SOURCES += tracereplay.cpp main.cpp
@@ -0,0 +1,133 @@
+#include "tracereplay.h"
+#include <stdio.h>
+
+TraceReplay::TraceReplay(const QList<QMPTrace::Record>& a_records, QObject* a_parent) :
+    QObject(a_parent), m_records(a_records), m_player(), m_realtime(false), m_verbose(false), m_passes(1),
+    m_pass(0), m_next(0), m_clock(), m_step(), m_current(0), m_stats(), m_out(stdout)
+{
+    m_step.setSingleShot(true);
+    connect(&m_step, SIGNAL(timeout()), SLOT(step()));
+
+    connect(&m_player, SIGNAL(stateChange(QMPlayer::State,QMPlayer::State)),
+            SLOT(playerStateChange(QMPlayer::State,QMPlayer::State)));
+    connect(&m_player, SIGNAL(error(QMPlayer::ErrType,QString)), SLOT(playerError(QMPlayer::ErrType,QString)));
+    connect(&m_player, SIGNAL(propertyReply(qint32,QString,QString,bool)),
+            SLOT(playerPropertyReply(qint32,QString,QString,bool)));
+}
+
+void TraceReplay::setRealtime(bool a_realtime) {
+    m_realtime = a_realtime;
+}
+
+void TraceReplay::setVerbose(bool a_verbose) {
+    m_verbose = a_verbose;
+}
+
+void TraceReplay::setPasses(qint32 a_passes) {
+    m_passes = qMax(1, a_passes);
+}
+
+ReplayPlayer* TraceReplay::player() {
+    return &m_player;
+}
+
+const TraceReplay::Stats& TraceReplay::stats() const {
+    return m_stats;
+}
+
+void TraceReplay::start() {
+    m_pass = 0;
+    m_next = 0;
+    m_stats = Stats();
+    m_clock.start();
+    m_current = 0;
+    m_step.start(0);
+}
+
+void TraceReplay::step() {
+    while (m_pass < m_passes) {
+        if (m_next == m_records.count()) {
+            m_next = 0;
+            ++m_pass;
+            m_current = m_clock.elapsed();
+            continue;
+        }
+
+        const QMPTrace::Record& l_record = m_records.at(m_next);
+        if (m_realtime) {
+            // the record times are relative to the start of the pass
+            qint64 l_due = m_current + l_record.time / 1000 - m_clock.elapsed();
+            if (l_due > 0) {
+                m_step.start(l_due);
+                return;
+            }
+        }
+
+        feed(l_record);
+        ++m_next;
+    }
+
+    m_stats.nsecs = m_clock.nsecsElapsed();
+    m_out.flush();
+    emit finished();
+}
+
+void TraceReplay::playerStateChange(QMPlayer::State a_new, QMPlayer::State a_old) {
+    if (!m_verbose) return;
+    print(m_clock.nsecsElapsed() / 1000, '=', QString("state %1 -> %2").arg(a_old).arg(a_new).toUtf8());
+}
+
+void TraceReplay::playerError(QMPlayer::ErrType a_type, const QString& a_error) {
+    print(m_clock.nsecsElapsed() / 1000, (a_type == QMPlayer::etFatal) ? 'E' : 'W', a_error.toUtf8());
+}
+
+void TraceReplay::playerPropertyReply(qint32 a_id, const QString& a_name, const QString& a_value, bool a_ok) {
+    Q_UNUSED(a_id);
+
+    ++m_stats.replies;
+    if (!m_verbose) return;
+    print(m_clock.nsecsElapsed() / 1000, '?', (a_ok ? a_name + " = " + a_value : a_name + " failed").toUtf8());
+}
+
+void TraceReplay::feed(const QMPTrace::Record& a_record) {
+    ++m_stats.records;
+
+    switch (a_record.stream) {
+        case QMPTrace::tsStdout:
+            m_stats.bytes += a_record.data.size();
+            m_stats.lines += a_record.data.count('\n');
+            if (m_verbose) print(a_record.time, '<', a_record.data);
+            m_player.parseStandardOutput(a_record.data);
+            break;
+        case QMPTrace::tsStderr:
+            m_stats.bytes += a_record.data.size();
+            m_stats.lines += a_record.data.count('\n');
+            if (m_verbose) print(a_record.time, '!', a_record.data);
+            m_player.parseStandardError(a_record.data);
+            break;
+        case QMPTrace::tsStdin:
+            if (m_verbose) print(a_record.time, '>', a_record.data);
+            // the answers follow in the stdout records
+            foreach (const QByteArray& l_line, a_record.data.split('\n')) {
+                QList<QByteArray> l_words = l_line.simplified().split(' ');
+                qint32 l_verb = l_words.indexOf("get_property");
+                if ((l_verb >= 0) && (l_verb + 1 < l_words.count())) {
+                    m_player.expectPropertyReply(QString::fromUtf8(l_words.at(l_verb + 1)));
+                    ++m_stats.queries;
+                }
+            }
+            break;
+        case QMPTrace::tsEvent:
+            if (m_verbose) print(a_record.time, '*', a_record.data);
+            break;
+    }
+}
+
+void TraceReplay::print(qint64 a_time, char a_marker, const QByteArray& a_data) {
+    QString l_time = QString("%1.%2").arg(a_time / 1000000, 6).arg(a_time % 1000000, 6, 10, QChar('0'));
+
+    foreach (const QByteArray& l_line, a_data.split('\n')) {
+        if (l_line.isEmpty()) continue;
+        m_out << l_time << ' ' << a_marker << ' ' << QString::fromUtf8(l_line) << '\n';
+    }
+}
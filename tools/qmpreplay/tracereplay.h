@@ -0,0 +1,83 @@
+#ifndef TRACEREPLAY_H
+#define TRACEREPLAY_H
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QList>
+#include <QTextStream>
+#include "qmplayer.h"
+#include "qmptrace.h"
+
+// Gets at the protocol parsers of QMPlayer without a process
+class ReplayPlayer : public QMPlayer
+{
+public:
+    explicit ReplayPlayer(QObject* a_parent = 0) : QMPlayer(a_parent) {}
+
+    using QMPlayer::parseStandardOutput;
+    using QMPlayer::parseStandardError;
+    using QMPlayer::expectPropertyReply;
+};
+
+// Feeds the stdout and stderr records of a trace to a ReplayPlayer, with
+// the recorded gaps or as fast as possible. Of the stdin records only the
+// get_property lines matter, the player expects their answers in order.
+class TraceReplay : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Stats {
+        qint64 records;
+        qint64 bytes;
+        qint64 lines;
+        qint64 nsecs;
+        qint64 queries;
+        qint64 replies;
+
+        Stats() : records(0), bytes(0), lines(0), nsecs(0), queries(0), replies(0) {}
+    };
+
+public:
+    TraceReplay(const QList<QMPTrace::Record>& a_records, QObject* a_parent = 0);
+
+    void setRealtime(bool a_realtime);
+    void setVerbose(bool a_verbose);
+    void setPasses(qint32 a_passes);
+
+    ReplayPlayer* player();
+    const TraceReplay::Stats& stats() const;
+
+public slots:
+    void start();
+
+signals:
+    void finished();
+
+private slots:
+    void step();
+    void playerStateChange(QMPlayer::State a_new, QMPlayer::State a_old);
+    void playerError(QMPlayer::ErrType a_type, const QString& a_error);
+    void playerPropertyReply(qint32 a_id, const QString& a_name, const QString& a_value, bool a_ok);
+
+private:
+    void feed(const QMPTrace::Record& a_record);
+    void print(qint64 a_time, char a_marker, const QByteArray& a_data);
+
+    QList<QMPTrace::Record> m_records;
+    ReplayPlayer m_player;
+    bool m_realtime;
+    bool m_verbose;
+    qint32 m_passes;
+
+    qint32 m_pass;
+    qint32 m_next;
+    QElapsedTimer m_clock;
+    QTimer m_step;
+    qint64 m_current;
+    Stats m_stats;
+    QTextStream m_out;
+};
+
+#endif // TRACEREPLAY_H